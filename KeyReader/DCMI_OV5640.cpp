@@ -23,24 +23,111 @@
 #include "DCMI_OV5640.h"
 #include <Wire.h>
 #include "ValueReader.h"
+#include "YUYVLineScanner.h"
+
+static_assert(HiResWindow::kFrameLines == OV5640::kHRYOutputSize &&
+				HiResWindow::kFrameColumns == OV5640::kHRXOutputSize,
+				"HiResWindow frame doesn't match the hi-res output size");
 
 DCMI_HandleTypeDef hdcmi;
 DMA_HandleTypeDef hdma_dcmi;
 
-uint16_t DCMI_OV5640::s2LineBuf[OV5640::kHRXOutputSize * 2];
+// The preview line buffer (see StartDMA)
+uint16_t DCMI_OV5640::s2LineBuf[OV5640::kXOutputSize * 2] __attribute__((aligned(4)));
+/*
+*	The hi-res lines are received into the slots of sLineRing by the DMA in
+*	double buffer mode.  The DMA interrupt (HiResLineReceived) only publishes
+*	the line just received and gives the DMA the next free slot.  The lines
+*	are scanned by ProcessLineRing, called from the lowest priority PendSV
+*	interrupt.  A line that takes longer than a line time to scan no longer
+*	gets overwritten by the DMA, the following lines wait in the ring.
+*
+*	When the ring is full the line is received into sOverrunLine and is lost.
+*	A lost line of a sample frame, including the last lines of the frame, is
+*	an error (sError 3), handled the same as any other line error.
+*	sDMATargetSlot is the slot of each DMA memory target (0 and 1), kNoSlot
+*	when the target is sOverrunLine.
+*/
+DCMI_OV5640::HiResLineRing DCMI_OV5640::sLineRing;
+uint16_t DCMI_OV5640::sOverrunLine[OV5640::kHRXOutputSize] __attribute__((aligned(4)));
+uint8_t DCMI_OV5640::sDMATargetSlot[2];
+const uint8_t kNoSlot = 0xFF;
+LineFrameTracker DCMI_OV5640::sLineFrames;
 uint16_t DCMI_OV5640::sKeyData[OV5640::kHRYOutputSize];
+/*
+*	keyDataQ8 parallels sKeyData over the decode lines, entry 0 is frame line
+*	HiResWindow::kDecodeFirstLine.  When sSubPixelMode is set, each entry is
+*	the line width in 24.8 fixed point pixels, with both transitions located
+*	by interpolating the luminance crossing of sScanBWThreshold.  A line of
+*	the window outside of the decode lines only has its sKeyData entry.
+*/
+DCMI_OV5640::SDecodeLineData DCMI_OV5640::sDecodeLineData;
+/*
+*	sLinesReceived is the number of sKeyData (and keyDataQ8) entries of the
+*	sample frame written so far.  It's only advanced while the frame is error
+*	free, and not when sampling multiple frames (the median isn't known till
+*	all of the frames have been received.)  This allows the main loop to
+*	decode the key data while the remainder of the frame is being received.
+*	See XKeyView::StreamKeyData.
+*/
+volatile uint32_t DCMI_OV5640::sLinesReceived;
+/*
+*	When sDualEdgeMode is set, the pixel index of both B&W transitions of each
+*	line (the two blade edges) are saved as a structure of arrays.  An edge
+*	that wasn't found is 0.  When sampling multiple frames, the edges are
+*	those of the last frame sampled.  See XKeyView::UpdateSkew.
+*/
+bool	DCMI_OV5640::sDualEdgeMode = false;
+/*
+*	Multi-frame median mode:  When sMedianFrames is non-zero, the line widths
+*	of sMedianFrames consecutive frames, starting at kHiResSampleFrameIndex,
+*	are saved in frameWidthsQ4.  The widths are stored as 12.4 fixed point to
+*	keep the buffer compact while preserving most of the sub-pixel resolution.
+*	StopHiResStream replaces sKeyData (and keyDataQ8) with the per-line
+*	median of the sampled frames.  The lines of the window outside of the
+*	decode lines are taken from the last frame sampled.
+*
+*	Retries:  In either mode, a sample frame containing errors is discarded
+*	and the next frame of the stream is sampled in its place (a soft retry.)
+*	The camera is left streaming, so a soft retry costs one frame time.  Only
+*	after kMaxDiscardedFrames are discarded is the camera reset and the scan
+*	restarted from eScanPowerUp (a hard retry, see sHiResRetries.)
+*	sSampleAttempt is advanced each time the sample frame is restarted so that
+*	the main loop knows to restart the streaming decode.
+*/
+const uint32_t kMaxDiscardedFrames = 4;
+uint8_t DCMI_OV5640::sMedianFrames = 0;
+uint8_t DCMI_OV5640::sFramesSampled;
+volatile uint8_t DCMI_OV5640::sFramesDiscarded;
+volatile uint32_t DCMI_OV5640::sSampleAttempt;
+uint32_t DCMI_OV5640::sDiscardError;
+uint32_t DCMI_OV5640::sDiscardErrorLine;
 const uint32_t kHiResSampleFrameIndex = 4;
+/*
+*	The hi-res scan bring-up (see UpdateScanState.)  kResetWaitMs is the time
+*	from the software reset till the registers are written (the 5ms reset
+*	time plus 50ms.)  kRegsPerUpdate limits the time spent writing registers
+*	in each Update.
+*/
+const uint32_t kResetWaitMs = 55;
+const uint32_t kRegsPerUpdate = 8;
 const uint32_t kHiResMaxRetries = 6;
 uint32_t DCMI_OV5640::sFrameIndex;
 uint32_t DCMI_OV5640::sHiResRetries;
 uint32_t DCMI_OV5640::sError;
 uint32_t DCMI_OV5640::sErrorCount;	// Number of consecutive errors
 uint32_t DCMI_OV5640::kErrorCountThreshold = 15; // Cancel scan if < sErrorCount
+/*
+*	sHiResWindow is the part of the hi-res frame captured using the DCMI crop
+*	feature.  The lines outside of the window are filled by StartHiResStream
+*	as lines where no edge was found.  See HiResWindow.h
+*/
+HiResWindow DCMI_OV5640::sHiResWindow;
 uint32_t DCMI_OV5640::sErrorLine;
 /*
 *	The sBWThreshold is overridden by SetBWThreshold on startup.
 *	sBWThreshold determins the amount of luminance that is considered white in
-*	the HiResLineCompleteCallback.
+*	ScanHiResLine.
 *
 *	sBWThreshold changed be set by saving the settings to SD, modify bwThreshold,
 *	then load the settings from SD.  sBWThreshold can also be changed by the
@@ -50,8 +137,54 @@ uint32_t DCMI_OV5640::sErrorLine;
 */
 uint16_t DCMI_OV5640::sBWThreshold = 150;
 uint16_t DCMI_OV5640::sPreviewBWThreshold = 150;
-bool	DCMI_OV5640::sPreviewIsRGB = false;
+/*
+*	Auto threshold:  When sAutoBWThreshold is set, a sparse luminance histogram
+*	is built from the kHistogramFrames stabilization frames that precede the
+*	sample frame.  At the end of the last of these frames the Otsu threshold of
+*	the histogram becomes sScanBWThreshold, the threshold used to scan the
+*	sample frame(s).  When not set, sScanBWThreshold is sBWThreshold.
+*	sHistogram has 64 bins, each 4 luminance levels wide.
+*/
+const uint32_t kHistogramFrames = 2;
+const uint32_t kHistogramLineStep = 16;
+const uint32_t kHistogramPixelStep = 8;
+const uint32_t kHistogramBins = 64;
+uint32_t DCMI_OV5640::sHistogram[kHistogramBins];
+uint16_t DCMI_OV5640::sScanBWThreshold = 150;
+bool	DCMI_OV5640::sAutoBWThreshold = false;
+/*
+*	sWhiteMargin is the number of pixels following the first white pixel of a
+*	line that are known to be white (the band between the edge of the light
+*	and the key.)  These pixels aren't examined when searching for the key.
+*/
+uint16_t DCMI_OV5640::sWhiteMargin = 10;
+DCMI_OV5640::EPreviewFormat	DCMI_OV5640::sPreviewFormat = ePreviewBW;
+/*
+*	Grayscale preview:  The luminance of each pixel is replaced by the
+*	RGB565 gray of sGrayLUT.  When sGrayStretch is set, a sparse luminance
+*	histogram of each preview frame (in sHistogram, not otherwise used while
+*	previewing) sets the contrast stretch of sGrayLUT for the next frame.
+*/
+const uint32_t kGrayLineStep = 8;
+const uint32_t kGrayPixelStep = 4;
+GrayLUT	DCMI_OV5640::sGrayLUT;
+bool	DCMI_OV5640::sGrayStretch = true;
+/*
+*	The DWT cycle count of copying each preview line to the display, per
+*	EPreviewFormat (see DumpPreviewLineCycles.)
+*/
+DCMI_OV5640::SLineCycles	DCMI_OV5640::sPreviewLineCycles[3];
+/*
+*	Live alignment:  In the B&W and grayscale preview, a sample of the lines
+*	are scanned for the blade edges (see PreviewAlign.)  The edges found are
+*	drawn in kEdgeHighlightColor.  kPreviewWhiteMargin is sWhiteMargin at
+*	the preview scale.
+*/
+PreviewAlign	DCMI_OV5640::sPreviewAlign;
+const uint16_t kEdgeHighlightColor = 0x4665;	// XFont::eGreen
+const uint32_t kPreviewWhiteMargin = 1;
 bool	DCMI_OV5640::sHiResFrameCaptured = false;
+bool	DCMI_OV5640::sSubPixelMode = false;
 
 // Pixel clock can be no more than 54MHz as per STM32F429 doc.
 //	const pin_t		kCameraXClkPin		= PA7;
@@ -61,9 +194,13 @@ bool	DCMI_OV5640::sHiResFrameCaptured = false;
 /******************************** DCMI_OV5640 *********************************/
 DCMI_OV5640::DCMI_OV5640(
 	TwoWire&	inWire)
-	: mWire(inWire), mDCMIInitialized(false), mHiResInProgress(false),
-	  mPreviewIsStreaming(false), mKeyDataIsValid(false)
+	: mWire(inWire), mRegWriter(inWire, Config::kOV5640DeviceAddr),
+	  mDCMIInitialized(false), mHiResInProgress(false),
+	  mPreviewIsStreaming(false), mKeyDataIsValid(false), mScanState(eScanIdle),
+	  mScanStartTime(0)
 {
+	memset(mScanStateTime, 0, sizeof(mScanStateTime));
+	memset(&mRetryStats, 0, sizeof(mRetryStats));
 }
 
 /************************************ begin ***********************************/
@@ -151,13 +288,91 @@ void DCMI_OV5640::SetBWThresholdFromStr(
 	Serial.printf(".BWThreshold = %hu\n", sBWThreshold);
 }
 
+/****************************** SetMedianFrames *******************************/
+/*
+*	Setting inMedianFrames to 0 or 1 samples a single frame (the default.)
+*/
+void DCMI_OV5640::SetMedianFrames(
+	uint8_t	inMedianFrames)
+{
+	if (inMedianFrames <= kMaxMedianFrames)
+	{
+		sMedianFrames = inMedianFrames > 1 ? inMedianFrames : 0;
+	}
+}
+
+/*************************** SetMedianFramesFromStr ***************************/
+void DCMI_OV5640::SetMedianFramesFromStr(
+	const char*	inStr)
+{
+	uint32_t	medianFrames;
+	ValueReader valueReader(inStr);
+	valueReader.ReadUInt32Number(sMedianFrames, medianFrames);
+	SetMedianFrames(medianFrames);
+	Serial.printf(".MedianFrames = %hu\n", (uint16_t)sMedianFrames);
+}
+
+/*************************** SetHiResWindowFromStr ***************************/
+/*
+*	Example: "r L(300,1460),C(0,1000)"
+*	L(first line, number of lines), C(first column, number of columns)
+*	Either can be omitted to leave it unchanged.  "r L(0,1918),C(0,1000)" is
+*	the full frame (no cropping.)  Can't be changed while a scan is in progress.
+*/
+void DCMI_OV5640::SetHiResWindowFromStr(
+	const char*	inStr)
+{
+	if (!mHiResInProgress)
+	{
+		ValueReader	valueReader(inStr);
+		uint32_t	firstLine = sHiResWindow.FirstLine();
+		uint32_t	numLines = sHiResWindow.NumLines();
+		uint32_t	firstColumn = sHiResWindow.FirstColumn();
+		uint32_t	numColumns = sHiResWindow.NumColumns();
+		uint32_t	value1, value2;
+		char		a;
+		/*
+		*	An omitted value, i.e. L(,1320), is returned as 9999 and leaves
+		*	that value unchanged.
+		*/
+		while ((a = valueReader.ReadXYValue(9999, value1, value2)) != 0)
+		{
+			switch (a)
+			{
+				case 'L':
+					firstLine = value1 != 9999 ? value1 : firstLine;
+					numLines = value2 != 9999 ? value2 : numLines;
+					break;
+				case 'C':
+					firstColumn = value1 != 9999 ? value1 : firstColumn;
+					numColumns = value2 != 9999 ? value2 : numColumns;
+					break;
+			}
+		}
+		if (!sHiResWindow.Set(firstLine, numLines, firstColumn, numColumns))
+		{
+			Serial.printf("Invalid window\n");
+		}
+	}
+	Serial.printf(".HiResWindow L(%u,%u) C(%u,%u)\n",
+					sHiResWindow.FirstLine(), sHiResWindow.NumLines(),
+					sHiResWindow.FirstColumn(), sHiResWindow.NumColumns());
+}
 
 /******************************** ResetCamera ********************************/
-void DCMI_OV5640::ResetCamera(void)
+/*
+*	inWait is false when the caller waits for the reset to complete (see
+*	UpdateScanState.)
+*/
+void DCMI_OV5640::ResetCamera(
+	bool	inWait)
 {
 	WriteReg(0x3103, 0x11);	// Select system input clock from pad clock (D1=0)
 	WriteReg(0x3008, 0x82);	// Software reset
-	delay(5);
+	if (inWait)
+	{
+		delay(5);
+	}
 }
 
 /*
@@ -188,6 +403,40 @@ void DCMI_OV5640::StartHiResStream(
 		mKeyDataIsValid = false;
 		sHiResFrameCaptured = false;
 		sFrameIndex = 0;
+		sFramesSampled = 0;
+		sFramesDiscarded = 0;
+		sLinesReceived = 0;
+		sSampleAttempt++;
+		/*
+		*	The DMA has been stopped and PendSV (lower priority than the
+		*	DMA, higher than the main loop) can't be pending at this point,
+		*	so the ring isn't in use.
+		*/
+		sLineRing.Reset();
+		sLineFrames.Reset();
+		/*
+		*	The lines outside of the window are never received.  They're set
+		*	as lines where no edge was found.
+		*/
+		if (!sHiResWindow.IsFullFrame())
+		{
+			for (uint32_t line = 0; line < OV5640::kHRYOutputSize; line++)
+			{
+				if (!sHiResWindow.ContainsLine(line))
+				{
+					sKeyData[line] = 2;
+					if (IsDecodeLine(line))
+					{
+						uint32_t	decodeLine = line - HiResWindow::kDecodeFirstLine;
+						sDecodeLineData.keyDataQ8[decodeLine] = 2 << 8;
+						sDecodeLineData.edgeLeft[decodeLine] = 0;
+						sDecodeLineData.edgeRight[decodeLine] = 0;
+					}
+				}
+			}
+		}
+		sScanBWThreshold = sBWThreshold;
+		memset(sHistogram, 0, sizeof(sHistogram));
 		sError = 0;
 		sErrorLine = 0;
 		sErrorCount = 0;
@@ -197,32 +446,172 @@ void DCMI_OV5640::StartHiResStream(
 			sHiResRetries = kHiResMaxRetries;
 		}
 		
-		digitalWrite(Config::kKRBacklightPin, HIGH);
-		ResetCamera();
-		delay(50);
-		WriteRegArray(OV5640::kCommonInit);
 		/*
-		*	Manual exposure and gain.
+		*	The camera bring-up is done by Update (see UpdateScanState.)
 		*/
+		if (inResetRetries)
 		{
-			WriteReg(0x3503, 0x07);	// Turn off AGC & AEC (i.e. go to manual mode)
-			//WriteReg(0x3500, 0x00);	// Exposure [19:16]
-			WriteReg(0x3501, 0x14);	// Exposure [15:8]	0x12	0x0E
-			WriteReg(0x3502, 0x00);	// Exposure [7:0]	 0x70
-			//WriteReg(0x350A, 0x00);	// Gain [9:8]
-			WriteReg(0x350B, 0x0A);	// Gain [7:0]	0x10
+			mScanStartTime = micros();
+			memset(&mRetryStats, 0, sizeof(mRetryStats));
 		}
-		//WriteRegArray(OV5640::k1080P_Init);
-		WriteRegArray(OV5640::kHiResInit);
-		/*
-		*	The DMA data size is Word.  In terms of STM32 DMA, that's 32 bits,
-		*	so inLineBufLen is half the number of pixels in inLineBuf.
-		*/
-		StartDMA(&hdcmi, DCMI_MODE_CONTINUOUS, (uint32_t)s2LineBuf,
-						OV5640::kHRXOutputSize, OV5640::kHRYOutputSize, false);
+		mFramesDiscardedSeen = 0;
+		memset(mScanStateTime, 0, sizeof(mScanStateTime));
+		SetScanState(eScanPowerUp);
 	}
 }
 
+/******************************* SetScanState *********************************/
+/*
+*	mScanStateTime is the time each state of the current attempt was entered,
+*	for profiling the scan latency (see DumpScanTiming.)
+*/
+void DCMI_OV5640::SetScanState(
+	EScanState	inScanState)
+{
+	mScanState = inScanState;
+	mScanStateTime[inScanState] = micros();
+}
+
+/****************************** UpdateScanState *******************************/
+/*
+*	Advances the hi-res scan, called from Update.  Each call returns promptly
+*	so that the UI stays responsive while the camera is brought up.  The
+*	register arrays are written kRegsPerUpdate registers per call.
+*
+*	eScanPowerUp	Backlight on, software reset of the camera.
+*	eScanResetWait	Wait kResetWaitMs for the camera to come out of reset.
+*	eScanLoadRegs	Write kCommonInit, the manual exposure and gain, then
+*					kHiResInit.  Start the DMA.
+*	eScanWarmUp		Frames received before the sample frame (the camera
+*					stabilizes, and the auto threshold histogram is built.)
+*	eScanSample		The sample frame(s) are being scanned.  Once captured,
+*					StopHiResStream reports the key data, or, when the frame
+*					had errors, retries starting at eScanPowerUp.
+*/
+void DCMI_OV5640::UpdateScanState(void)
+{
+	switch (mScanState)
+	{
+		case eScanPowerUp:
+			digitalWrite(Config::kKRBacklightPin, HIGH);
+			ResetCamera(false);
+			SetScanState(eScanResetWait);
+			break;
+		case eScanResetWait:
+			if ((micros() - mScanStateTime[eScanResetWait]) >= (kResetWaitMs * 1000))
+			{
+				mRegArray = OV5640::kCommonInit;
+				mRegArrayIndex = 0;
+				SetScanState(eScanLoadRegs);
+			}
+			break;
+		case eScanLoadRegs:
+			if (WriteRegArrayStep(kRegsPerUpdate))
+			{
+				/*
+				*	Next array: common init, manual exposure and gain, then
+				*	hi-res.
+				*/
+				mRegArrayIndex++;
+				if (mRegArrayIndex == 1)
+				{
+					mRegArray = OV5640::kHiResExposure;
+				} else if (mRegArrayIndex == 2)
+				{
+					//mRegArray = OV5640::k1080P_Init;
+					mRegArray = OV5640::kHiResInit;
+				} else
+				{
+					/*
+					*	The DMA data size is Word.  In terms of STM32 DMA,
+					*	that's 32 bits, so inLineBufLen, the length of two
+					*	lines, is the number of pixels in one line.  Only the
+					*	lines and columns of the window are transferred.  The
+					*	lines are received into sLineRing rather than
+					*	inLineBuf.
+					*/
+					StartDMA(&hdcmi, DCMI_MODE_CONTINUOUS, 0,
+							sHiResWindow.NumColumns(), sHiResWindow.NumLines(), false);
+					SetScanState(eScanWarmUp);
+				}
+			}
+			break;
+		case eScanWarmUp:
+			if (sFrameIndex < kHiResSampleFrameIndex)
+			{
+				break;
+			}
+			SetScanState(eScanSample);
+			/*
+			*	If this attempt follows a hard retry THEN
+			*	its latency is the time from the failed frame till now.
+			*/
+			if (mRetryStats.hardRetryStart)
+			{
+				mRetryStats.hardRetryTime += (mScanStateTime[eScanSample] -
+												mRetryStats.hardRetryStart);
+				mRetryStats.hardRetryStart = 0;
+			}
+			mSampleStartTime = mScanStateTime[eScanSample];
+			// Fall through
+		case eScanSample:
+			/*
+			*	If frames were discarded since the last call (soft retries) THEN
+			*	account for them and report the last error.  The latency is the
+			*	time spent sampling the discarded frame(s).
+			*/
+			if (sFramesDiscarded != mFramesDiscardedSeen &&
+				sFramesDiscarded <= kMaxDiscardedFrames)
+			{
+				uint32_t	now = micros();
+				mRetryStats.softRetries += (sFramesDiscarded - mFramesDiscardedSeen);
+				mRetryStats.softRetryTime += (now - mSampleStartTime);
+				mSampleStartTime = now;
+				mFramesDiscardedSeen = sFramesDiscarded;
+				snprintf(mStatusMessage, 128, "Resample %u, err %u at line %u",
+							mFramesDiscardedSeen, sDiscardError, sDiscardErrorLine);
+				mScanStatusCB(mStatusMessage);
+			}
+			if (sHiResFrameCaptured)
+			{
+				StopHiResStream();
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/******************************* DumpScanTiming *******************************/
+/*
+*	Prints the time spent in each state of the last attempt of the last scan,
+*	the total time of the scan, and the number and latency of the retries of
+*	each policy (soft: the next frame is sampled, hard: the camera is reset.)
+*/
+void DCMI_OV5640::DumpScanTiming(void) const
+{
+	static const char* const	kStateName[] =
+		{"Power up", "Reset wait", "Load regs", "Warm up", "Sample"};
+	for (uint32_t state = eScanPowerUp; state < eScanIdle; state++)
+	{
+		if (mScanStateTime[state] &&
+			mScanStateTime[state+1])
+		{
+			Serial.printf(".%-10s %7u us\n", kStateName[state],
+							mScanStateTime[state+1] - mScanStateTime[state]);
+		}
+	}
+	if (mScanStateTime[eScanIdle])
+	{
+		Serial.printf(".Total      %7u us\n",
+						mScanStateTime[eScanIdle] - mScanStartTime);
+	}
+	Serial.printf(".Soft retries %u, %u us\n", mRetryStats.softRetries,
+						mRetryStats.softRetryTime);
+	Serial.printf(".Hard retries %u, %u us\n", mRetryStats.hardRetries,
+						mRetryStats.hardRetryTime);
+}
+
 /****************************** StopHiResStream *******************************/
 void DCMI_OV5640::StopHiResStream(
 	bool	inCancel)
@@ -231,7 +620,12 @@ void DCMI_OV5640::StopHiResStream(
 	{
 		mHiResInProgress = false;
 		
-		HAL_DCMI_Stop(&hdcmi);
+		// The DMA is only running once the registers have been loaded.
+		if (mScanState >= eScanWarmUp)
+		{
+			HAL_DCMI_Stop(&hdcmi);
+		}
+		SetScanState(eScanIdle);
 	#if 0
 		{
 			WriteReg(0x3503, 0x07);	// Turn off AGC & AEC (i.e. go to manual mode)
@@ -255,11 +649,17 @@ void DCMI_OV5640::StopHiResStream(
 		} else if (sError == 0)
 		{
 			digitalWrite(Config::kKRBacklightPin, LOW);
+			if (sMedianFrames)
+			{
+				MedianOfSampledFrames();
+			}
 			mKeyDataIsValid = true;
 			mKeyDataChangedCB(sKeyData);
 		} else if (sHiResRetries)
 		{
 			sHiResRetries--;
+			mRetryStats.hardRetries++;
+			mRetryStats.hardRetryStart = mScanStateTime[eScanIdle];
 			snprintf(mStatusMessage, 128, "Retry %u, err %u at line %u",
 						kHiResMaxRetries - sHiResRetries, sError, sErrorLine);
 			mScanStatusCB(mStatusMessage);
@@ -274,24 +674,79 @@ void DCMI_OV5640::StopHiResStream(
 	}
 }
 
+/*************************** MedianOfSampledFrames ****************************/
+/*
+*	Replaces sKeyData and keyDataQ8 with the per-line median of the widths of
+*	the sampled frames.  For an even number of frames the two middle widths
+*	are averaged.
+*
+*	keyDataQ8 shares its buffer with frameWidthsQ4.  The keyDataQ8 entry of a
+*	line is within the frameWidthsQ4 entries of that line and the lines
+*	before it, so the lines are replaced in order, each after its widths have
+*	been read.  The decode lines outside of the window had their keyDataQ8
+*	entries overwritten by the sampled widths, so they're set again.
+*/
+void DCMI_OV5640::MedianOfSampledFrames(void)
+{
+	uint16_t	widths[kMaxMedianFrames];
+	uint32_t	numFrames = sFramesSampled;
+	for (uint32_t decodeLine = 0; decodeLine < kDecodeLines; decodeLine++)
+	{
+		uint32_t	line = decodeLine + HiResWindow::kDecodeFirstLine;
+		if (!sHiResWindow.ContainsLine(line))
+		{
+			sDecodeLineData.keyDataQ8[decodeLine] = 2 << 8;
+			continue;
+		}
+		const uint16_t*	lineWidths = sDecodeLineData.frameWidthsQ4[decodeLine];
+		/*
+		*	Insertion sort of this line's widths (at most kMaxMedianFrames)
+		*/
+		for (uint32_t i = 0; i < numFrames; i++)
+		{
+			uint16_t	width = lineWidths[i];
+			uint32_t	j = i;
+			for (; j > 0 && widths[j-1] > width; j--)
+			{
+				widths[j] = widths[j-1];
+			}
+			widths[j] = width;
+		}
+		uint32_t	medianQ4 = (numFrames & 1) ? widths[numFrames/2] :
+						((widths[numFrames/2 - 1] + widths[numFrames/2] + 1) / 2);
+		sKeyData[line] = (medianQ4 + 8) >> 4;
+		sDecodeLineData.keyDataQ8[decodeLine] = medianQ4 << 4;
+	}
+}
+
 /********************************* GetKeyData *********************************/
 const uint16_t* DCMI_OV5640::GetKeyData(void)
 {
 	return(mKeyDataIsValid ? sKeyData : nullptr);
 }
 
+/******************************** GetKeyDataQ8 ********************************/
+/*
+*	Returns the sub-pixel line widths of the decode lines, or nullptr if the
+*	last scan wasn't captured in sub-pixel mode.
+*/
+const uint32_t* DCMI_OV5640::GetKeyDataQ8(void)
+{
+	return(mKeyDataIsValid && sSubPixelMode ? sDecodeLineData.keyDataQ8 : nullptr);
+}
+
 /****************************** InitPreviewStream *****************************/
 /*
 *	This is code factored out of StartPreviewStream so that it can be shared
 *	with both StartPreviewStream and ChangePreviewFormat.
 */
 void DCMI_OV5640::InitPreviewStream(
-	bool	inPreviewIsRGB)
+	EPreviewFormat	inPreviewFormat)
 {
 	ResetCamera();
 	WriteRegArray(OV5640::kCommonInit);
-	sPreviewIsRGB = inPreviewIsRGB;
-	if (inPreviewIsRGB)
+	sPreviewFormat = inPreviewFormat;
+	if (inPreviewFormat == ePreviewRGB)
 	{
 		digitalWrite(Config::kKRBacklightPin, LOW); // Key backlight OFF
 		WriteReg(0x4300, 0x6F); // Set RGB565 Format
@@ -304,8 +759,14 @@ void DCMI_OV5640::InitPreviewStream(
 		WriteReg(0x3502, 0x50);	// Exposure [7:0]
 		//WriteReg(0x350A, 0x00);	// Gain [9:8]
 		WriteReg(0x350B, 0x8B);	// Gain [7:0]	0xFB
+	/*
+	*	Else B&W or grayscale, both are the luminance of YUV422.
+	*/
 	} else
 	{
+		sGrayLUT.Build(0, 255);
+		memset(sHistogram, 0, sizeof(sHistogram));
+		sPreviewAlign.Reset();
 		digitalWrite(Config::kKRBacklightPin, HIGH); // Key backlight ON
 		WriteReg(0x4300, 0x30); // Set YUV422 Format
 		WriteReg(0x501F, 0x00); // Format 0=YUV
@@ -323,7 +784,7 @@ void DCMI_OV5640::InitPreviewStream(
 
 /***************************** StartPreviewStream *****************************/
 void DCMI_OV5640::StartPreviewStream(
-	bool	inPreviewIsRGB)
+	EPreviewFormat	inPreviewFormat)
 {
 	/*
 	*	At this point the camera has been powered up and a hardware reset has
@@ -336,7 +797,7 @@ void DCMI_OV5640::StartPreviewStream(
 		mPreviewIsStreaming = true;
 		mPreviewSuspended = 0;
 		sFrameIndex = 0;
-		InitPreviewStream(inPreviewIsRGB);
+		InitPreviewStream(inPreviewFormat);
 		// Setup XKeyView for preview
 		mEnterPreviewModeCB(true);
 		/*
@@ -362,7 +823,7 @@ bool DCMI_OV5640::StopPreviewStream(void)
 		mPreviewIsStreaming = false;
 		mPreviewSuspended = 0;
 		HAL_DCMI_Stop(&hdcmi);
-		if (sPreviewIsRGB)
+		if (sPreviewFormat == ePreviewRGB)
 		{
 			WriteReg(0x3B00, 0x03); // Strobe/LED OFF
 		} else
@@ -415,11 +876,11 @@ void DCMI_OV5640::SuspendPreview(void)
 *	SuspendPreview must have been called before calling this routine.
 */
 void DCMI_OV5640::ChangePreviewFormat(
-	bool	inPreviewIsRGB)
+	EPreviewFormat	inPreviewFormat)
 {
 	if (mPreviewIsStreaming)
 	{
-		if (sPreviewIsRGB)
+		if (sPreviewFormat == ePreviewRGB)
 		{
 			WriteReg(0x3B00, 0x03); // Strobe/LED OFF
 		} else
@@ -427,8 +888,51 @@ void DCMI_OV5640::ChangePreviewFormat(
 			digitalWrite(Config::kKRBacklightPin, LOW); // Key backlight OFF
 		}
 		WriteReg(0x3008, 0x42);	// Software power down
-		InitPreviewStream(inPreviewIsRGB);
+		InitPreviewStream(inPreviewFormat);
+	}
+}
+
+/******************************* SetGrayStretch *******************************/
+/*
+*	When off, the grayscale preview is the unstretched luminance.
+*/
+void DCMI_OV5640::SetGrayStretch(
+	bool	inGrayStretch)
+{
+	sGrayStretch = inGrayStretch;
+	if (!inGrayStretch)
+	{
+		sGrayLUT.Build(0, 255);
+	}
+}
+
+/*************************** DumpPreviewLineCycles ****************************/
+/*
+*	Prints the mean and max cycles taken to copy a preview line to the display
+*	in each of the preview formats used since the last call, then resets the
+*	counts.  Includes the histogram sampling of the grayscale stretch and
+*	the edge scan of the live alignment.
+*/
+void DCMI_OV5640::DumpPreviewLineCycles(void)
+{
+	static const char* const	kFormatName[] = {"RGB565", "B&W", "Gray"};
+	for (uint32_t format = ePreviewRGB; format <= ePreviewGray; format++)
+	{
+		const SLineCycles&	lineCycles = sPreviewLineCycles[format];
+		if (lineCycles.lines)
+		{
+			Serial.printf(".%-6s %6u lines, %4u cycles/line, max %u\n",
+						kFormatName[format], lineCycles.lines,
+						(uint32_t)(lineCycles.cycles / lineCycles.lines),
+						lineCycles.maxCycles);
+		}
+	}
+	if (sPreviewFormat == ePreviewGray)
+	{
+		Serial.printf(".Gray stretch %s, %u..%u\n", sGrayStretch ? "ON":"OFF",
+						sGrayLUT.Low(), sGrayLUT.High());
 	}
+	memset(sPreviewLineCycles, 0, sizeof(sPreviewLineCycles));
 }
 
 /******************************** ResumePreview *******************************/
@@ -683,10 +1187,9 @@ void DCMI_OV5640::StrobeOff(void)
 /*********************************** Update ***********************************/
 void DCMI_OV5640::Update(void)
 {
-	if (mHiResInProgress &&
-		sHiResFrameCaptured)
+	if (mHiResInProgress)
 	{
-		StopHiResStream();
+		UpdateScanState();
 	}
 }
 
@@ -706,30 +1209,50 @@ uint8_t DCMI_OV5640::ReadReg(
 }
 
 /********************************** WriteReg **********************************/
+/*
+*	The write is skipped if the register already holds inValue (see
+*	RegWriter.)
+*/
 void DCMI_OV5640::WriteReg(
 	uint16_t	inAddress,
-	uint8_t		inValue) const
+	uint8_t		inValue)
 {
-	mWire.beginTransmission(Config::kOV5640DeviceAddr);
-	mWire.write(inAddress >> 8);
-	mWire.write(inAddress);
-	mWire.write(inValue);
-	mWire.endTransmission(true);
+	mRegWriter.WriteReg(inAddress, inValue);
 }
 
 /******************************** WriteRegArray *******************************/
+/*
+*	Runs of consecutive register addresses are written as a single burst, and
+*	registers that already hold the value are skipped (see RegWriter.)
+*/
 void DCMI_OV5640::WriteRegArray(
-	const uint16_t*	inRegArray) const
+	const uint16_t*	inRegArray)
 {
-	/*
-	*	Note that even though the I2C supports writing an array of bytes, the
-	*	camera interface requires a begin/end transaction for each register
-	*	access.
-	*/
-	for (uint16_t regAddr = *(inRegArray++); regAddr; regAddr = *(inRegArray++))
-	{
-		WriteReg(regAddr, *(inRegArray++));
-	}
+	mRegWriter.WriteRegArray(inRegArray);
+}
+
+/***************************** WriteRegArrayStep ******************************/
+/*
+*	Writes up to inMaxRegs registers of mRegArray.  Returns true when all of
+*	the registers of mRegArray have been written.
+*/
+bool DCMI_OV5640::WriteRegArrayStep(
+	uint32_t	inMaxRegs)
+{
+	mRegArray = mRegWriter.WriteRegArray(mRegArray, inMaxRegs);
+	return(*mRegArray == 0);
+}
+
+/***************************** DumpRegWriteStats ******************************/
+/*
+*	Prints the I2C register writes since the last call.
+*/
+void DCMI_OV5640::DumpRegWriteStats(void)
+{
+	Serial.printf(".Reg writes: %u transactions, %u bytes, %u skipped, %u failed\n",
+					mRegWriter.Transactions(), mRegWriter.Bytes(),
+					mRegWriter.Skipped(), mRegWriter.Failures());
+	mRegWriter.ResetStats();
 }
 
 /********************************** DCMI_Init *********************************/
@@ -777,6 +1300,12 @@ void DCMI_OV5640::DMA_Init(void)
   /* DMA2_Stream1_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(DMA2_Stream1_IRQn, 5, 0);
   HAL_NVIC_EnableIRQ(DMA2_Stream1_IRQn);
+  /* The hi-res lines are scanned from PendSV, below the DMA interrupt */
+  HAL_NVIC_SetPriority(PendSV_IRQn, 15, 0);
+  /* The cycle counter is used to profile the preview line copy */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
 }
 #if 0
@@ -815,6 +1344,10 @@ void DCMI_OV5640::DMA_Deinit(void)
 *	mark and when full.  When the interrupt occurs, half of the buffer is
 *	processed while the other half is being filled by the DMA controller.
 *
+*	The hi-res stream uses the DMA double buffer mode instead, one line per
+*	memory target, and inLineBuf isn't used.  Each line is received into a
+*	slot of sLineRing (see HiResLineReceived.)
+*
 *	Note that this is not be standard DCMI behavior.  The standard behavior is
 *	to have a frame buffer the size of the image being recorded.  This is a
 *	modified version of HAL_DCMI_Start_DMA found in stm32f4xx_hal_dcmi.c
@@ -848,6 +1381,22 @@ HAL_StatusTypeDef DCMI_OV5640::StartDMA(
 	inHDCMI->Instance->CR &= ~(DCMI_CR_CM);
 	inHDCMI->Instance->CR |= inDCMI_Mode;
 
+	/*
+	*	The preview is never cropped.  The hi-res stream is cropped to
+	*	sHiResWindow unless the window is the full frame.  The crop registers
+	*	must be set before capture is enabled.
+	*/
+	if (inIsPreview ||
+		sHiResWindow.IsFullFrame())
+	{
+		inHDCMI->Instance->CR &= ~DCMI_CR_CROP;
+	} else
+	{
+		inHDCMI->Instance->CWSTRTR = sHiResWindow.CropStartReg();
+		inHDCMI->Instance->CWSIZER = sHiResWindow.CropSizeReg();
+		inHDCMI->Instance->CR |= DCMI_CR_CROP;
+	}
+
 	/* Set the DMA memory0 conversion complete callback */
 	{
 		DMA_HandleTypeDef*	dmaHndl = inHDCMI->DMA_Handle;
@@ -855,10 +1404,13 @@ HAL_StatusTypeDef DCMI_OV5640::StartDMA(
 		{
 			dmaHndl->XferCpltCallback =
 				dmaHndl->XferHalfCpltCallback = PreviewLineCompleteCallback;
+			dmaHndl->XferM1CpltCallback = nullptr;
 		} else
 		{
-			dmaHndl->XferCpltCallback =
-				dmaHndl->XferHalfCpltCallback = HiResLineCompleteCallback;
+			// Double buffer mode, no half transfer interrupt.
+			dmaHndl->XferCpltCallback = HiResM0CompleteCallback;
+			dmaHndl->XferM1CpltCallback = HiResM1CompleteCallback;
+			dmaHndl->XferHalfCpltCallback = nullptr;
 		}
 	}
 	/* Set the DMA error callback */
@@ -873,7 +1425,19 @@ HAL_StatusTypeDef DCMI_OV5640::StartDMA(
 
 	/* Enable the DMA Stream */
 	// The 2nd Param is the source address
-	HAL_DMA_Start_IT(inHDCMI->DMA_Handle, (uint32_t)&inHDCMI->Instance->DR, (uint32_t)inLineBuf, inLineBufLen);
+	if (inIsPreview)
+	{
+		HAL_DMA_Start_IT(inHDCMI->DMA_Handle, (uint32_t)&inHDCMI->Instance->DR, (uint32_t)inLineBuf, inLineBufLen);
+	} else
+	{
+		/*
+		*	Each memory target receives one line into a slot of sLineRing.
+		*/
+		uint32_t	target0 = (uint32_t)NextHiResLineBuf(0);
+		uint32_t	target1 = (uint32_t)NextHiResLineBuf(1);
+		HAL_DMAEx_MultiBufferStart_IT(inHDCMI->DMA_Handle, (uint32_t)&inHDCMI->Instance->DR,
+										target0, target1, inLineBufLen/2);
+	}
 
 	/* Enable Capture */
 	inHDCMI->Instance->CR |= DCMI_CR_CAPTURE;
@@ -885,11 +1449,37 @@ HAL_StatusTypeDef DCMI_OV5640::StartDMA(
 	return HAL_OK;
 }
 
+/***************************** CopyPreviewPixels ******************************/
+/*
+*	Copies inCount pixels of a preview line to the display in the current
+*	preview format.
+*/
+inline void DCMI_OV5640::CopyPreviewPixels(
+	const uint16_t*	inLine,
+	uint32_t		inCount)
+{
+	switch (sPreviewFormat)
+	{
+		case ePreviewRGB:
+			PreviewLine::CopyRGB565(inLine, inCount, FMC_DataAddr);
+			break;
+		case ePreviewBW:
+			PreviewLine::CopyBW(inLine, inCount, sPreviewBWThreshold, FMC_DataAddr);
+			break;
+		default:
+			PreviewLine::CopyGray(inLine, inCount, sGrayLUT.LUT(), FMC_DataAddr);
+			break;
+	}
+}
+
 /************************ PreviewLineCompleteCallback *************************/
 /*
 *	Gets called by the DMA controller when either half of the line buffer is
-*	full.  This callback copies either the RGB565 data to the display or the
-*	Y of the YUV422 data interpreted as either 100% black or 100% white.
+*	full.  This callback copies either the RGB565 data to the display, or the
+*	Y of the YUV422 data interpreted as either 100% black or 100% white, or
+*	as a gray via sGrayLUT (see PreviewLine.h.)  For the luminance formats,
+*	the lines sampled by sPreviewAlign are scanned for the blade edges before
+*	being copied, and the edges are drawn in kEdgeHighlightColor.
 */
 void DCMI_OV5640::PreviewLineCompleteCallback(
 	DMA_HandleTypeDef*	inHDMA)
@@ -905,27 +1495,63 @@ void DCMI_OV5640::PreviewLineCompleteCallback(
 	{
 		lineBufferPtr += OV5640::kXOutputSize;
 	}
-	if (sPreviewIsRGB)
+	uint32_t	startCycles = DWT->CYCCNT;
+	uint32_t	line = hdcmi->XferCount;
+	uint16_t	left = 0;
+	uint16_t	right = 0;
+	if (sPreviewFormat != ePreviewRGB &&
+		PreviewAlign::IsSampleLine(line))
 	{
-		for (uint32_t i = 0; i < OV5640::kXOutputSize; i++)
-		{
-			*FMC_DataAddr = lineBufferPtr[i];
-		}
-	/*
-	*	Else B&W preview
-	*/
+		YUYVLineScanner::Scan<uint32_t>(lineBufferPtr, OV5640::kXOutputSize,
+							sPreviewBWThreshold, kPreviewWhiteMargin, left, right);
+		sPreviewAlign.AddLine(line, left, right);
+	}
+	if (right > left)
+	{
+		CopyPreviewPixels(lineBufferPtr, left);
+		*FMC_DataAddr = kEdgeHighlightColor;
+		CopyPreviewPixels(&lineBufferPtr[left+1], right - left - 1);
+		*FMC_DataAddr = kEdgeHighlightColor;
+		CopyPreviewPixels(&lineBufferPtr[right+1], OV5640::kXOutputSize - right - 1);
 	} else
 	{
-		for (uint32_t i = 0; i < OV5640::kXOutputSize; i++)
+		CopyPreviewPixels(lineBufferPtr, OV5640::kXOutputSize);
+	}
+	if (sPreviewFormat == ePreviewGray &&
+		sGrayStretch &&
+		(line % kGrayLineStep) == 0)
+	{
+		for (uint32_t i = 0; i < OV5640::kXOutputSize; i += kGrayPixelStep)
 		{
-			*FMC_DataAddr = (lineBufferPtr[i] & 0xFF) < sPreviewBWThreshold ? 0:0xFFFF;
+			sHistogram[(lineBufferPtr[i] & 0xFF) >> 2]++;
 		}
 	}
+	uint32_t	cycles = DWT->CYCCNT - startCycles;
+	SLineCycles&	lineCycles = sPreviewLineCycles[sPreviewFormat];
+	lineCycles.lines++;
+	lineCycles.cycles += cycles;
+	if (cycles > lineCycles.maxCycles)
+	{
+		lineCycles.maxCycles = cycles;
+	}
 	hdcmi->XferCount++;
 	/* Check if the frame is transferred */
 	if (hdcmi->XferCount == hdcmi->XferTransferNumber)
 	{
 		sFrameIndex++;
+		/*
+		*	The stretch of the next frame is that of this frame.
+		*/
+		if (sPreviewFormat == ePreviewGray &&
+			sGrayStretch)
+		{
+			sGrayLUT.StretchFromHistogram(sHistogram, kHistogramBins);
+			memset(sHistogram, 0, sizeof(sHistogram));
+		}
+		if (sPreviewFormat != ePreviewRGB)
+		{
+			sPreviewAlign.EndFrame();
+		}
 		/* Enable the Frame interrupt */
 		__HAL_DCMI_ENABLE_IT(hdcmi, DCMI_IT_FRAME);
 
@@ -938,34 +1564,152 @@ void DCMI_OV5640::PreviewLineCompleteCallback(
 	}
 }
 
-/************************** HiResLineCompleteCallback *************************/
+/****************************** NextHiResLineBuf ******************************/
 /*
-*	Gets called by the DMA controller when either half of the line buffer is
-*	full.  This hi-res version  of the line complete callback scans the line
-*	recording only the first transition from white to black and the following
-*	transition from black to white.  The line data is YUV422, and only the
-*	luminance, or Y value of YUV is used.
+*	Returns the buffer the DMA memory target inTarget is to receive the next
+*	line into.  This is the next free slot of sLineRing, or sOverrunLine when
+*	the ring is full.
 */
-void DCMI_OV5640::HiResLineCompleteCallback(
+uint16_t* DCMI_OV5640::NextHiResLineBuf(
+	uint32_t	inTarget)
+{
+	uint32_t	slot;
+	if (sLineRing.Acquire(slot))
+	{
+		sDMATargetSlot[inTarget] = slot;
+		return(sLineRing.Slot(slot));
+	}
+	sDMATargetSlot[inTarget] = kNoSlot;
+	return(sOverrunLine);
+}
+
+/************************** HiResM0CompleteCallback ***************************/
+void DCMI_OV5640::HiResM0CompleteCallback(
+	DMA_HandleTypeDef*	inHDMA)
+{
+	HiResLineReceived(inHDMA, 0);
+}
+
+/************************** HiResM1CompleteCallback ***************************/
+void DCMI_OV5640::HiResM1CompleteCallback(
 	DMA_HandleTypeDef*	inHDMA)
+{
+	HiResLineReceived(inHDMA, 1);
+}
+
+/***************************** HiResLineReceived ******************************/
+/*
+*	Gets called by the DMA controller when the memory target inTarget is full.
+*	The DMA is now receiving the next line into the other target.  The line
+*	received is published to sLineRing tagged with its frame index and window
+*	line, and the target is given the buffer for the line after next.  The
+*	lines are scanned by ProcessLineRing, from PendSV.
+*/
+void DCMI_OV5640::HiResLineReceived(
+	DMA_HandleTypeDef*	inHDMA,
+	uint32_t			inTarget)
 {
 	DCMI_HandleTypeDef* hdcmi = ( DCMI_HandleTypeDef* )((DMA_HandleTypeDef* )inHDMA)->Parent;
+	if (sDMATargetSlot[inTarget] != kNoSlot)
+	{
+		sLineRing.Publish((sFrameIndex << 16) | hdcmi->XferCount);
+	}
+	HAL_DMAEx_ChangeMemory(inHDMA, (uint32_t)NextHiResLineBuf(inTarget),
+								inTarget ? MEMORY1 : MEMORY0);
+	hdcmi->XferCount++;
+	/* Check if the frame is transferred */
+	if (hdcmi->XferCount == hdcmi->XferTransferNumber)
+	{
+		sFrameIndex++;
+		/* Enable the Frame interrupt */
+		__HAL_DCMI_ENABLE_IT(hdcmi, DCMI_IT_FRAME);
+
+		/* When snapshot mode, set dcmi state to ready */
+		if ((hdcmi->Instance->CR & DCMI_CR_CM) == DCMI_MODE_SNAPSHOT)
+		{
+			hdcmi->State = HAL_DCMI_STATE_READY;
+		}
+		hdcmi->XferCount = 0;
+	}
+	SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;	// Run ProcessLineRing
+}
+
+/****************************** ProcessLineRing *******************************/
+/*
+*	Scans the lines waiting in sLineRing, in the order received.  Called from
+*	PendSV, so it's only preempted by the higher priority interrupts,
+*	including the DMA interrupt that fills the ring.  sLineFrames tracks the
+*	frames and the lost lines (see LineFrameTracker.)
+*/
+void DCMI_OV5640::ProcessLineRing(void)
+{
+	uint32_t		tag;
+	const uint16_t*	line;
+	while ((line = sLineRing.Peek(tag)) != nullptr)
+	{
+		sLineFrames.Line<HiResLines>(line, tag, sHiResWindow.NumLines());
+		sLineRing.Release();
+	}
+}
+
+/******************************** LinesLost *********************************/
+/*
+*	Lines of the frame were lost, either a gap (the ring was full) or the
+*	last lines of the frame.  The key data of the lost lines is left over
+*	from an earlier frame, so a sample frame is an error.
+*/
+void DCMI_OV5640::HiResLines::LinesLost(
+	uint32_t	inFrameIndex,
+	uint32_t	inFirstLostLine)
+{
+	if (inFrameIndex >= kHiResSampleFrameIndex &&
+		!sHiResFrameCaptured)
+	{
+		sError = 3;
+		sErrorLine = sHiResWindow.FrameLine(inFirstLostLine);
+	}
+}
+
+/********************************* ScanLine *********************************/
+/*
+*	Scans the line, ending the frame early when there are too many errors.
+*/
+bool DCMI_OV5640::HiResLines::ScanLine(
+	const uint16_t*	inLine,
+	uint32_t		inWindowLine,
+	uint32_t		inFrameIndex)
+{
+	ScanHiResLine(inLine, inWindowLine, inFrameIndex);
+	return(sErrorCount > kErrorCountThreshold);
+}
+
+/******************************* ScanHiResLine ********************************/
+/*
+*	This hi-res version of the line processing scans the line recording only
+*	the first transition from white to black and the following transition
+*	from black to white.  The line data is YUV422, and only the luminance, or
+*	Y value of YUV is used.
+*/
+void DCMI_OV5640::ScanHiResLine(
+	const uint16_t*	inLine,
+	uint32_t		inWindowLine,
+	uint32_t		inFrameIndex)
+{
+	uint32_t	numColumns = sHiResWindow.NumColumns();
+	/*
+	*	inWindowLine is the line within the window.  frameLine is the index of
+	*	the line within the frame (and the key data.)
+	*/
+	uint32_t	frameLine = sHiResWindow.FrameLine(inWindowLine);
 	/*
 	*	Not taking the first frame allows the camera time to stabilze.
 	*
 	*	If this is the sample frame THEN
 	*	do the sample.
 	*/
-	if (sFrameIndex == kHiResSampleFrameIndex)
+	if (inFrameIndex >= kHiResSampleFrameIndex &&
+		!sHiResFrameCaptured)
 	{
-		uint16_t*	lineBufferPtr = s2LineBuf;
-		/*
-		*	When odd, copy from the 2nd half of the line buffer
-		*/
-		if (hdcmi->XferCount & 1)
-		{
-			lineBufferPtr += OV5640::kHRXOutputSize;
-		}
 		/*
 		*	Scan the YUV422 YUYV line, only looking at the luminance Y value to
 		*	determine if the pixel is black or white.  The delta of the two B&W
@@ -974,28 +1718,47 @@ void DCMI_OV5640::HiResLineCompleteCallback(
 		{
 			uint16_t	left = 1;
 			uint16_t	right = 2;
-			bool isBlack, isWhite;
-			for (uint16_t i = 0; i < OV5640::kHRXOutputSize; i++)
+		#if 1
+			/*
+			*	The packed scan tests 2 pixels per 32 bit word.
+			*/
+			YUYVLineScanner::Scan<uint32_t>(inLine, numColumns,
+								sScanBWThreshold, sWhiteMargin, left, right);
+		#else
+			YUYVLineScanner::ScanScalar(inLine, numColumns,
+								sScanBWThreshold, sWhiteMargin, left, right);
+		#endif
+			/*
+			*	The lines outside of the decode lines only have sKeyData.
+			*/
+			if (!IsDecodeLine(frameLine))
+			{
+				sKeyData[frameLine] = right > left ? (right-left) : 2;
+			} else
 			{
-				isBlack = (lineBufferPtr[i] & 0xFF) < sBWThreshold;
-				if (isBlack)continue;
-				for (i+=10; i < OV5640::kHRXOutputSize; i++)
+				uint32_t	decodeLine = frameLine - HiResWindow::kDecodeFirstLine;
+				if (sDualEdgeMode)
 				{
-					isWhite = (lineBufferPtr[i] & 0xFF) >= sBWThreshold;
-					if (isWhite)continue;
-					left = i;
-					for (i+=10; i < OV5640::kHRXOutputSize; i++)
+					uint32_t	firstColumn = sHiResWindow.FirstColumn();
+					sDecodeLineData.edgeLeft[decodeLine] = right > left ? left + firstColumn : 0;
+					sDecodeLineData.edgeRight[decodeLine] = right > left ? right + firstColumn : 0;
+				}
+				if (sMedianFrames)
+				{
+					sDecodeLineData.frameWidthsQ4[decodeLine][sFramesSampled] = right <= left ? (2 << 4) :
+						(sSubPixelMode ? ((SubPixelEdgeQ8(inLine, right) -
+							SubPixelEdgeQ8(inLine, left) + 8) >> 4) : ((right-left) << 4));
+				} else
+				{
+					sKeyData[frameLine] = right > left ? (right-left) : 2;
+					if (sSubPixelMode)
 					{
-						isBlack = (lineBufferPtr[i] & 0xFF) < sBWThreshold;
-						if (isBlack)continue;
-						right = i;
-						break;
+						sDecodeLineData.keyDataQ8[decodeLine] = right > left ?
+								(SubPixelEdgeQ8(inLine, right) -
+									SubPixelEdgeQ8(inLine, left)) : (2 << 8);
 					}
-					break;
 				}
-				break;
 			}
-			sKeyData[hdcmi->XferCount] = right > left ? (right-left) : 2;
 			
 			/*
 			*
@@ -1007,41 +1770,172 @@ void DCMI_OV5640::HiResLineCompleteCallback(
 			*	give up and reset the camera.
 			*/
 		#if 1
-			if (hdcmi->XferCount >= 450 &&
-				hdcmi->XferCount <= 1700 &&
+			if (frameLine >= 450 &&
+				frameLine <= 1700 &&
 				right == 2)
 			{
 				sErrorCount++;
 				sError = 2;
-				sErrorLine = hdcmi->XferCount;
+				sErrorLine = frameLine;
 			} else
 			{
 				sErrorCount = 0;
 			}
 		#endif
+			if (sMedianFrames == 0 &&
+				sError == 0)
+			{
+				__DMB();	// The key data must be written before it's published
+				sLinesReceived = frameLine + 1;
+			}
+		}
+	/*
+	*	Else if auto threshold and this is one of the stabilization frames
+	*	that precede the sample frame THEN
+	*	add a sparse sample of this line's luminance to the histogram.
+	*/
+	} else if (sAutoBWThreshold &&
+		inFrameIndex >= (kHiResSampleFrameIndex - kHistogramFrames) &&
+		inFrameIndex < kHiResSampleFrameIndex &&
+		(inWindowLine % kHistogramLineStep) == 0)
+	{
+		for (uint32_t i = 0; i < numColumns; i += kHistogramPixelStep)
+		{
+			sHistogram[(inLine[i] & 0xFF) >> 2]++;
 		}
 	}
-	hdcmi->XferCount++;
-	/* Check if the frame is transferred */
-	if (hdcmi->XferCount == hdcmi->XferTransferNumber ||
-		sErrorCount > kErrorCountThreshold)
+}
+
+/***************************** HiResFrameComplete *****************************/
+/*
+*	Called once all of the lines of frame inFrameIndex have been scanned, or
+*	the frame has too many line errors to continue.
+*/
+void DCMI_OV5640::HiResFrameComplete(
+	uint32_t	inFrameIndex)
+{
+	if (sAutoBWThreshold &&
+		inFrameIndex == (kHiResSampleFrameIndex - 1))
+	{
+		sScanBWThreshold = OtsuThreshold();
+	} else if (inFrameIndex >= kHiResSampleFrameIndex &&
+		!sHiResFrameCaptured)
 	{
-		if (sFrameIndex == kHiResSampleFrameIndex)
+		/*
+		*	If this frame has errors THEN
+		*	discard it and sample the next frame in its place.  If too many
+		*	frames have been discarded, leave sError set so that the camera
+		*	gets reset by StopHiResStream.
+		*/
+		if (sError)
+		{
+			sFramesDiscarded++;
+			if (sFramesDiscarded > kMaxDiscardedFrames)
+			{
+				sHiResFrameCaptured = true;
+			} else
+			{
+				sDiscardError = sError;
+				sDiscardErrorLine = sErrorLine;
+				sError = 0;
+				sErrorCount = 0;
+				/*
+				*	Every line of the window is rewritten by the next frame.
+				*/
+				sLinesReceived = 0;
+				sSampleAttempt++;
+			}
+		} else if (sMedianFrames == 0)
 		{
 			sHiResFrameCaptured = true;
+		} else
+		{
+			sFramesSampled++;
+			sHiResFrameCaptured = sFramesSampled >= sMedianFrames;
 		}
-		
-		sFrameIndex++;
-		/* Enable the Frame interrupt */
-		__HAL_DCMI_ENABLE_IT(hdcmi, DCMI_IT_FRAME);
+	}
+}
 
-		/* When snapshot mode, set dcmi state to ready */
-		if ((hdcmi->Instance->CR & DCMI_CR_CM) == DCMI_MODE_SNAPSHOT)
+/******************************* SubPixelEdgeQ8 *******************************/
+/*
+*	inIndex is the first pixel past a B&W transition (as recorded by
+*	ScanHiResLine.)  The transition lies between pixels inIndex-1
+*	and inIndex.  The position where the luminance crosses sScanBWThreshold is
+*	linearly interpolated between the two pixels and returned in 24.8 fixed
+*	point.  This works for either transition direction.
+*
+*	Because the scan skips 10 pixels after each transition, the pixel before
+*	inIndex may already be on the same side of the threshold.  In this case
+*	the crossing can't be interpolated and the integer position is returned.
+*/
+uint32_t DCMI_OV5640::SubPixelEdgeQ8(
+	const uint16_t*	inLine,
+	uint32_t		inIndex)
+{
+	int32_t	y0 = inLine[inIndex-1] & 0xFF;
+	int32_t	y1 = inLine[inIndex] & 0xFF;
+	int32_t	threshold = sScanBWThreshold;
+	if ((y0 < threshold) != (y1 < threshold))
+	{
+		int32_t	fraction = ((y0 - threshold) << 8) / (y0 - y1);
+		return(((inIndex - 1) << 8) + fraction);
+	}
+	return(inIndex << 8);
+}
+
+/******************************** OtsuThreshold *******************************/
+/*
+*	Returns the threshold that best separates the luminance histogram into
+*	black and white classes (maximum between-class variance, Otsu's method.)
+*	The result is limited to the same range as SetBWThreshold.  If the
+*	histogram is empty sBWThreshold is returned.
+*/
+uint16_t DCMI_OV5640::OtsuThreshold(void)
+{
+	uint32_t	total = 0;
+	float		sum = 0;
+	for (uint32_t bin = 0; bin < kHistogramBins; bin++)
+	{
+		total += sHistogram[bin];
+		sum += (float)bin * sHistogram[bin];
+	}
+	uint16_t	threshold = sBWThreshold;
+	if (total)
+	{
+		uint32_t	weightB = 0;
+		float		sumB = 0;
+		float		maxVariance = 0;
+		for (uint32_t bin = 0; bin < kHistogramBins; bin++)
 		{
-			hdcmi->State = HAL_DCMI_STATE_READY;
+			weightB += sHistogram[bin];
+			if (weightB == 0)
+			{
+				continue;
+			}
+			uint32_t	weightF = total - weightB;
+			if (weightF == 0)
+			{
+				break;
+			}
+			sumB += (float)bin * sHistogram[bin];
+			float	meanDelta = (sumB / weightB) - ((sum - sumB) / weightF);
+			float	variance = (float)weightB * (float)weightF * meanDelta * meanDelta;
+			if (variance > maxVariance)
+			{
+				maxVariance = variance;
+				// Pixels in this bin and below are black.
+				threshold = (bin + 1) << 2;
+			}
+		}
+		if (threshold < 100)
+		{
+			threshold = 100;
+		} else if (threshold > 200)
+		{
+			threshold = 200;
 		}
-		hdcmi->XferCount = 0;
 	}
+	return(threshold);
 }
 
 /****************************** DMAErrorCallback ******************************/
@@ -1276,6 +2170,17 @@ void DMA2_Stream1_IRQHandler(void)
 	HAL_DMA_IRQHandler(&hdma_dcmi);
 }
 
+/******************************* PendSV_Handler *******************************/
+/*
+*	PendSV is set pending by the hi-res DMA interrupt to scan the lines it
+*	received.  It's at the lowest priority (see DMA_Init.)  PendSV isn't
+*	otherwise used (there's no RTOS.)
+*/
+void PendSV_Handler(void)
+{
+	DCMI_OV5640::ProcessLineRing();
+}
+
 /**
   * @brief DCMI MSP De-Initialization
   * This function freeze the hardware resources used in this example
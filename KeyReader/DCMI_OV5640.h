@@ -27,6 +27,11 @@
 #include "Config.h"
 #include "HardwareTimer.h"
 #include "OV5640.h"
+#include "HiResWindow.h"
+#include "LineRing.h"
+#include "RegWriter.h"
+#include "PreviewLine.h"
+#include "PreviewAlign.h"
 
 class TwoWire;
 typedef std::function<void(const uint16_t*)> DataChangedCallback;
@@ -36,6 +41,12 @@ typedef std::function<void(const char*)> ScanStatusCallback;
 class DCMI_OV5640
 {
 public:
+	enum EPreviewFormat
+	{
+		ePreviewRGB,		// RGB565 from the camera
+		ePreviewBW,			// YUV422 luminance thresholded to black or white
+		ePreviewGray		// YUV422 luminance via sGrayLUT
+	};
 							DCMI_OV5640(
 								TwoWire&				inWire);
 	void					begin(
@@ -49,18 +60,64 @@ public:
 								{return(sBWThreshold);}
 	static void				SetBWThresholdFromStr(
 								const char*				inStr);
+	static void				SetSubPixelMode(
+								bool					inSubPixelMode)
+								{sSubPixelMode = inSubPixelMode;}
+	static bool				SubPixelMode(void)
+								{return(sSubPixelMode);}
+	static void				SetAutoBWThreshold(
+								bool					inAutoBWThreshold)
+								{sAutoBWThreshold = inAutoBWThreshold;}
+	static bool				AutoBWThreshold(void)
+								{return(sAutoBWThreshold);}
+								// The threshold used by the last hi-res scan
+	static uint16_t			GetScanBWThreshold(void)
+								{return(sScanBWThreshold);}
+	static void				SetDualEdgeMode(
+								bool					inDualEdgeMode)
+								{sDualEdgeMode = inDualEdgeMode;}
+	static bool				DualEdgeMode(void)
+								{return(sDualEdgeMode);}
+	static void				SetMedianFrames(
+								uint8_t					inMedianFrames);
+	static uint8_t			GetMedianFrames(void)
+								{return(sMedianFrames);}
+	static void				SetMedianFramesFromStr(
+								const char*				inStr);
+	void					SetHiResWindowFromStr(
+								const char*				inStr);
+	static const HiResWindow& GetHiResWindow(void)
+								{return(sHiResWindow);}
+	static void				SetWhiteMargin(
+								uint16_t				inWhiteMargin)
+								{sWhiteMargin = inWhiteMargin;}
 	bool					ChipIDIs5640(void) const;
 	void					StartHiResStream(
 								bool					inResetRetries = true);
 	void					StopHiResStream(
 								bool					inCancel = false);
 	void					StartPreviewStream(
-								bool					inPreviewIsRGB = true);
+								EPreviewFormat			inPreviewFormat = ePreviewRGB);
 	void					InitPreviewStream(
-								bool					inPreviewIsRGB);
+								EPreviewFormat			inPreviewFormat);
 	bool					StopPreviewStream(void);
 	void					ChangePreviewFormat(
-								bool					inPreviewIsRGB);
+								EPreviewFormat			inPreviewFormat);
+	static void				SetGrayStretch(
+								bool					inGrayStretch);
+	static bool				GrayStretch(void)
+								{return(sGrayStretch);}
+	static void				DumpPreviewLineCycles(void);
+								/*
+								*	The alignment of the key in the preview,
+								*	B&W and grayscale formats only.
+								*/
+	static const PreviewAlign& GetPreviewAlign(void)
+								{return(sPreviewAlign);}
+	bool					PreviewAlignIsValid(void) const
+								{return(mPreviewIsStreaming &&
+										sPreviewFormat != ePreviewRGB &&
+										sPreviewAlign.FramesScored() != 0);}
 	void					SuspendPreview(void);
 	void					ResumePreview(void);
 	bool					PreviewIsStreaming(void) const
@@ -82,11 +139,42 @@ public:
 	bool					KeyDataIsValid(void) const
 								{return(mKeyDataIsValid);}
 	const uint16_t*			GetKeyData(void);
+	const uint32_t*			GetKeyDataQ8(void);
+								// Valid entries of the frame being received
+	uint32_t				LinesReceived(void) const
+								{return(sLinesReceived);}
+								/*
+								*	Changes each time the sample frame is
+								*	restarted (a retry), LinesReceived
+								*	restarts from 0.
+								*/
+	uint32_t				SampleAttempt(void) const
+								{return(sSampleAttempt);}
+								/*
+								*	Absolute edge positions, dual-edge mode
+								*	only.  Like the sub-pixel widths, only
+								*	the decode lines are kept, indexed from
+								*	HiResWindow::kDecodeFirstLine.
+								*/
+	const uint16_t*			GetEdgeLeft(void) const
+								{return(sDualEdgeMode ? sDecodeLineData.edgeLeft : nullptr);}
+	const uint16_t*			GetEdgeRight(void) const
+								{return(sDualEdgeMode ? sDecodeLineData.edgeRight : nullptr);}
+	const uint16_t*			GetStreamingKeyData(void) const
+								{return(sKeyData);}
+	const uint32_t*			GetStreamingKeyDataQ8(void) const
+								{return(sSubPixelMode ? sDecodeLineData.keyDataQ8 : nullptr);}
 	bool					HiResInProgress(void) const
 								{return(mHiResInProgress);}
+	void					DumpScanTiming(void) const;
+	void					DumpRegWriteStats(void);
+								// Hi-res lines lost because the line ring was full
+	static uint32_t			LineRingOverruns(void)
+								{return(sLineRing.Overruns());}
 protected:
 	HardwareTimer	mXCLKTimer;
 	TwoWire&		mWire;
+	RegWriter<TwoWire>	mRegWriter;
 	uint32_t		mPreviewSuspended;
 	bool			mDCMIInitialized;
 	bool			mPreviewIsStreaming;
@@ -97,9 +185,69 @@ protected:
 	PreviewModeCallback	mEnterPreviewModeCB;
 	ScanStatusCallback	mScanStatusCB;
 	char			mStatusMessage[128];
+	enum EScanState
+	{
+		eScanPowerUp,
+		eScanResetWait,
+		eScanLoadRegs,
+		eScanWarmUp,
+		eScanSample,
+		eScanIdle,
+		eNumScanStates
+	};
+	EScanState		mScanState;
+	uint32_t		mScanStateTime[eNumScanStates];	// micros() entered
+	uint32_t		mScanStartTime;
+	uint32_t		mSampleStartTime;	// micros() the current sample frame started
+	uint32_t		mFramesDiscardedSeen;
+	struct SRetryStats
+	{
+		uint32_t	softRetries;
+		uint32_t	softRetryTime;		// us
+		uint32_t	hardRetries;
+		uint32_t	hardRetryTime;		// us
+		uint32_t	hardRetryStart;		// micros() of the failure, 0 = none pending
+	} mRetryStats;
+	const uint16_t*	mRegArray;
+	uint32_t		mRegArrayIndex;
 	static DCMI_HandleTypeDef sHDCMI;
 	static uint16_t	s2LineBuf[];
 	static uint16_t	sKeyData[];
+	static volatile uint32_t	sLinesReceived;
+	enum
+	{
+		kDecodeLines		= HiResWindow::kDecodeEndLine - HiResWindow::kDecodeFirstLine,
+		kMaxMedianFrames	= 5
+	};
+	/*
+	*	The optional per-line data is only kept for the decode lines.  The
+	*	sub-pixel widths of a single frame and the widths of the median
+	*	frames are never needed at the same time, so they share a buffer.
+	*	The widths are stored a line at a time so that the median of each
+	*	line can replace the lines before it (see MedianOfSampledFrames.)
+	*/
+	struct SDecodeLineData
+	{
+		union
+		{
+			uint32_t	keyDataQ8[kDecodeLines];
+			uint16_t	frameWidthsQ4[kDecodeLines][kMaxMedianFrames];
+		};
+		uint16_t	edgeLeft[kDecodeLines];
+		uint16_t	edgeRight[kDecodeLines];
+	};
+	static SDecodeLineData	sDecodeLineData;
+	static bool				IsDecodeLine(
+								uint32_t				inFrameLine)
+								{return(inFrameLine >= HiResWindow::kDecodeFirstLine &&
+										inFrameLine < HiResWindow::kDecodeEndLine);}
+	static bool		sDualEdgeMode;
+	static uint8_t	sMedianFrames;
+	static uint8_t	sFramesSampled;
+	static volatile uint8_t	sFramesDiscarded;
+	static volatile uint32_t	sSampleAttempt;
+	static uint32_t	sDiscardError;
+	static uint32_t	sDiscardErrorLine;
 	static uint32_t	sLineLength;
 	static uint32_t	sLineCount;
 	static uint32_t	sFrameIndex;
@@ -109,10 +257,31 @@ protected:
 	static uint32_t	kErrorCountThreshold;
 	static uint32_t	sError;
 	static uint32_t	sErrorLine;
+	static HiResWindow	sHiResWindow;
+	typedef LineRing<8, OV5640::kHRXOutputSize> HiResLineRing;
+	static HiResLineRing	sLineRing;
+	static uint16_t	sOverrunLine[];
+	static uint8_t	sDMATargetSlot[2];
+	static LineFrameTracker	sLineFrames;
 	static uint16_t	sBWThreshold;
 	static uint16_t	sPreviewBWThreshold;
-	static bool		sPreviewIsRGB;
+	static uint16_t	sWhiteMargin;
+	static uint16_t	sScanBWThreshold;
+	static uint32_t	sHistogram[];
+	static bool		sAutoBWThreshold;
+	static EPreviewFormat	sPreviewFormat;
+	static GrayLUT	sGrayLUT;
+	static bool		sGrayStretch;
+	struct SLineCycles
+	{
+		uint32_t	lines;
+		uint32_t	maxCycles;
+		uint64_t	cycles;
+	};
+	static SLineCycles	sPreviewLineCycles[];
+	static PreviewAlign	sPreviewAlign;
 	static bool		sHiResFrameCaptured;
+	static bool		sSubPixelMode;
 	enum
 	{
 		eChipIDHReg		= 0x300A,
@@ -122,14 +291,20 @@ protected:
 	};
 	void					DMA_Init(void);
 	void					DCMI_Init(void);
-	void					ResetCamera(void);
+	void					ResetCamera(
+								bool					inWait = true);
+	void					SetScanState(
+								EScanState				inScanState);
+	void					UpdateScanState(void);
+	bool					WriteRegArrayStep(
+								uint32_t				inMaxRegs);
 	uint8_t					ReadReg(
 								uint16_t				inAddress) const;
 	void					WriteReg(
 								uint16_t				inAddress,
-								uint8_t					inValue) const;
+								uint8_t					inValue);
 	void					WriteRegArray(
-								const uint16_t*			inRegArray) const;
+								const uint16_t*			inRegArray);
 	static HAL_StatusTypeDef StartDMA(
 								DCMI_HandleTypeDef*		inHDCMI,
 								uint32_t				inDCMI_Mode,
@@ -137,13 +312,48 @@ protected:
 								uint32_t				inLineBufLen,
 								uint32_t				inNumLines,
 								bool					inIsPreview);
+	static inline void		CopyPreviewPixels(
+								const uint16_t*			inLine,
+								uint32_t				inCount);
 	static void				PreviewLineCompleteCallback(
 								DMA_HandleTypeDef*		inHDMA);
-	static void				HiResLineCompleteCallback(
+	void					MedianOfSampledFrames(void);
+	static uint16_t			OtsuThreshold(void);
+	static uint16_t*		NextHiResLineBuf(
+								uint32_t				inTarget);
+	static void				HiResM0CompleteCallback(
+								DMA_HandleTypeDef*		inHDMA);
+	static void				HiResM1CompleteCallback(
 								DMA_HandleTypeDef*		inHDMA);
+	static void				HiResLineReceived(
+								DMA_HandleTypeDef*		inHDMA,
+								uint32_t				inTarget);
+	static void				ScanHiResLine(
+								const uint16_t*			inLine,
+								uint32_t				inWindowLine,
+								uint32_t				inFrameIndex);
+	static void				HiResFrameComplete(
+								uint32_t				inFrameIndex);
+	static uint32_t			SubPixelEdgeQ8(
+								const uint16_t*			inLine,
+								uint32_t				inIndex);
+	struct HiResLines	// LineFrameTracker handler for sLineFrames
+	{
+		static void			LinesLost(
+								uint32_t				inFrameIndex,
+								uint32_t				inFirstLostLine);
+		static bool			ScanLine(
+								const uint16_t*			inLine,
+								uint32_t				inWindowLine,
+								uint32_t				inFrameIndex);
+		static void			FrameComplete(
+								uint32_t				inFrameIndex)
+								{HiResFrameComplete(inFrameIndex);}
+	};
 public:
 	static void				DMAErrorCallback(
 								DMA_HandleTypeDef*		inHDMA);
+	static void				ProcessLineRing(void);
 };
 
 /*
@@ -154,6 +364,7 @@ extern "C"
 {
 	void DMA2_Stream1_IRQHandler(void);
 	void DCMI_IRQHandler(void);
+	void PendSV_Handler(void);
 }
 
 #endif // DCMI_OV5640_h
@@ -0,0 +1,167 @@
+/*
+*	FlatDetector.cpp, Copyright Jonathan Mackey 2025
+*	Locates the key flat closest to the bow within the hi-res key data.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "FlatDetector.h"
+#include <string.h>
+
+/******************************** FlatDetector ********************************/
+FlatDetector::FlatDetector(void)
+	: mKeyData(nullptr), mFlatStart(0), mFlatEnd(0), mDone(true)
+{
+}
+
+/*********************************** Begin ************************************/
+/*
+*	A ring buffer is used to average the delta between each data entry pair to
+*	determine the slope.  A flat is the area between a slope ending and the
+*	next slope starting.  Flats less than 20 entries long are ignored.
+*/
+void FlatDetector::Begin(
+	const uint16_t*	inKeyData)
+{
+	mKeyData = inKeyData;
+	mSloping = 0;
+	mFlatStart = 0;
+	mFlatEnd = 0;
+	mDeltaAcc = 0;
+	memset(mDeltaRingBuffer, 0, sizeof(mDeltaRingBuffer));
+	mDeltaRingIndex = 0;
+	mIsInSlope = false;
+	mEndIndex = kScanEnd;
+	mDone = inKeyData == nullptr;
+	if (!mDone)
+	{
+		mIndex = kScanStart;
+		mDepth = NextDepth(mKeyData, mIndex, mEndIndex, mIndex);
+		mNextDepth = NextDepth(mKeyData, mIndex, mEndIndex, mIndex);
+	}
+}
+
+/*********************************** Resume ***********************************/
+void FlatDetector::Resume(
+	uint32_t	inEndIndex)
+{
+	mFlatStart = 0;
+	mFlatEnd = 0;
+	mEndIndex = inEndIndex;
+	mDone = mKeyData == nullptr || mIndex <= mEndIndex;
+	if (!mDone)
+	{
+		// Step stopped without advancing to the next entry.
+		mNextDepth = NextDepth(mKeyData, mIndex, mEndIndex, mIndex);
+	}
+}
+
+/************************************ Step ************************************/
+bool FlatDetector::Step(
+	uint32_t	inMaxSteps)
+{
+	for (uint32_t step = 0; !mDone; mNextDepth = NextDepth(mKeyData, mIndex, mEndIndex, mIndex))
+	{
+		if (mIndex <= mEndIndex)
+		{
+			mDone = true;
+			break;
+		}
+		int32_t	delta = mDepth - mNextDepth;
+		mDepth = mNextDepth;
+		mDeltaAcc -= mDeltaRingBuffer[mDeltaRingIndex];
+		mDeltaRingBuffer[mDeltaRingIndex++] = delta;
+		mDeltaAcc += delta;
+		if (mDeltaRingIndex == kRingBufferSize)
+		{
+			mDeltaRingIndex = 0;
+		}
+
+		if (mDeltaAcc/5)
+		{
+			if (mSloping < 6)
+			{
+				mSloping++;
+			} else
+			{
+				mIsInSlope = true;
+				if (mFlatStart)
+				{
+					mFlatEnd = mIndex;
+					if ((mFlatStart - mFlatEnd) < 20)
+					{
+						mFlatStart = 0;
+						mFlatEnd = 0;
+					} else
+					{
+						mDone = true;
+						break;
+					}
+				}
+			}
+		} else if (mSloping)
+		{
+			mSloping--;
+			if (mIsInSlope && mSloping == 0)
+			{
+				if (mFlatStart == 0)
+				{
+					mFlatStart = mIndex;
+				}
+			}
+		}
+		step++;
+		if (step == inMaxSteps)
+		{
+			/*
+			*	Advance to the next entry before returning so that the next
+			*	call resumes at the top of the loop.
+			*/
+			mNextDepth = NextDepth(mKeyData, mIndex, mEndIndex, mIndex);
+			break;
+		}
+	}
+	return(mDone);
+}
+
+/********************************** NextDepth *********************************/
+/*
+*	Returns the next depth within a range, skipping any invalid depths in the
+*	data.
+*/
+uint32_t FlatDetector::NextDepth(
+	const uint16_t*	inKeyData,
+	uint32_t		inIndex,
+	uint32_t		inMinIndex,
+	uint32_t&		outNextIndex)
+{
+	uint32_t	depth;
+	while (inIndex > inMinIndex)
+	{
+		depth = inKeyData[inIndex];
+		inIndex--;
+		if (depth > 100 &&
+			depth < 600)
+		{
+			outNextIndex = inIndex;
+			return(depth);
+		}
+	}
+	outNextIndex = inMinIndex;
+	return(0);
+}
@@ -0,0 +1,94 @@
+/*
+*	FlatDetector.h, Copyright Jonathan Mackey 2025
+*	Locates the key flat closest to the bow within the hi-res key data.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef FlatDetector_h
+#define FlatDetector_h
+
+#include <inttypes.h>
+
+/*
+*	The slope/flat state machine formerly contained in
+*	XKeyView::UpdatePinCenters.  All of the state is held in the object so
+*	that the search can be run in steps (see XKeyView::StreamKeyData.)
+*
+*	The search walks from the bow (kScanStart) toward the tip (kScanEnd), so
+*	it can start as soon as line kScanStart of the frame has been received.
+*	FlatSegmenter resumes the search after each flat found to locate the
+*	remaining flats.
+*/
+class FlatDetector
+{
+public:
+	enum
+	{
+		kScanStart	= 1700,
+		kScanEnd	= 1300		// Index to stop at if a flat isn't located.
+	};
+							FlatDetector(void);
+	void					Begin(
+								const uint16_t*			inKeyData);
+	/*
+	*	Continues the search from the end of the flat found toward
+	*	inEndIndex, keeping the slope state.
+	*/
+	void					Resume(
+								uint32_t				inEndIndex);
+	/*
+	*	Processes up to inMaxSteps entries (0 = no limit.)  Returns true when
+	*	the search has finished.
+	*/
+	bool					Step(
+								uint32_t				inMaxSteps = 0);
+	bool					Done(void) const
+								{return(mDone);}
+	bool					FlatFound(void) const
+								{return(mFlatStart != 0 && mFlatEnd != 0);}
+	uint32_t				FlatStart(void) const
+								{return(mFlatStart);}
+	uint32_t				FlatEnd(void) const
+								{return(mFlatEnd);}
+								// The next entry to be searched
+	uint32_t				Index(void) const
+								{return(mIndex);}
+	static uint32_t			NextDepth(
+								const uint16_t*			inKeyData,
+								uint32_t				inIndex,
+								uint32_t				inMinIndex,
+								uint32_t&				outNextIndex);
+protected:
+	static const uint32_t	kRingBufferSize = 10;
+	const uint16_t*	mKeyData;
+	uint32_t		mIndex;
+	uint32_t		mEndIndex;
+	uint32_t		mSloping;
+	uint32_t		mFlatStart;
+	uint32_t		mFlatEnd;
+	int32_t			mDepth;
+	int32_t			mNextDepth;
+	int32_t			mDeltaAcc;
+	int32_t			mDeltaRingBuffer[kRingBufferSize];
+	uint32_t		mDeltaRingIndex;
+	bool			mIsInSlope;
+	bool			mDone;
+};
+
+#endif // FlatDetector_h
@@ -0,0 +1,214 @@
+/*
+*	FlatSegmenter.cpp, Copyright Jonathan Mackey 2025
+*	Locates every key flat along the blade and fits the pin spacing.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "FlatSegmenter.h"
+#include "LineFit.h"
+#include <math.h>
+
+/******************************* FlatSegmenter ********************************/
+FlatSegmenter::FlatSegmenter(void)
+	: mNumFlats(0), mNumExtraPinFlats(0), mPitchQ16(0), mPinFlatMask(0), mPitchFitted(false),
+	  mDone(true)
+{
+}
+
+/*********************************** Begin ************************************/
+/*
+*	The first flat is searched for within the FlatDetector's default range so
+*	that a scan without a flat near the bow is rejected as before.  The search
+*	for the remaining flats continues from the end of the previous flat to
+*	kBladeEnd.
+*/
+void FlatSegmenter::Begin(
+	const uint16_t*	inKeyData)
+{
+	mNumFlats = 0;
+	mPinFlatMask = 0;
+	mPitchFitted = false;
+	mFlatDetector.Begin(inKeyData);
+	mDone = mFlatDetector.Done();
+}
+
+/************************************ Step ************************************/
+bool FlatSegmenter::Step(
+	uint32_t	inMaxSteps)
+{
+	uint32_t	stepsLeft = inMaxSteps;
+	while (!mDone)
+	{
+		uint32_t	index = mFlatDetector.Index();
+		if (mFlatDetector.Step(stepsLeft))
+		{
+			if (mFlatDetector.FlatFound())
+			{
+				mFlatStart[mNumFlats] = mFlatDetector.FlatStart();
+				mFlatEnd[mNumFlats] = mFlatDetector.FlatEnd();
+				mNumFlats++;
+				mFlatDetector.Resume(kBladeEnd);
+				mDone = mNumFlats == kMaxFlats || mFlatDetector.Done();
+			} else
+			{
+				mDone = true;
+			}
+		}
+		/*
+		*	A flat found ends the FlatDetector's Step early.  The search
+		*	continues with the steps left, so that each call advances by
+		*	inMaxSteps entries however many flats are found.
+		*/
+		if (inMaxSteps)
+		{
+			uint32_t	stepsTaken = index - mFlatDetector.Index();
+			if (stepsTaken >= stepsLeft)
+			{
+				break;
+			}
+			stepsLeft -= stepsTaken;
+		}
+	}
+	return(mDone);
+}
+
+/************************************ Fit *************************************/
+/*
+*	Each flat is reduced to a measured pin center.  The first flat is pin 0 (as
+*	when only the first flat was used.)  The following flats are assigned to
+*	the nearest pin predicted by the fit so far.  A flat is rejected if it
+*	isn't close to a pin, or if it's longer than one and a half times the
+*	median flat length (or half the nominal pitch.)  A long flat is the uncut
+*	blade or a shallow cut whose slopes are too gradual to be detected, so its
+*	center isn't a reliable pin center.  Flats where pins past inNumPins
+*	would be are counted (see NumExtraPinFlats.)  The
+*	first pin center and the pitch are fitted by least squares
+*	(center = first center - pin * pitch.)
+*/
+bool FlatSegmenter::Fit(
+	uint32_t	inNumPins,
+	uint32_t	inNominalPitch)
+{
+	// The +15 accounts for the delay introduced by the FlatDetector's ring buffer.
+	const uint32_t	kFlatDelay = 15;
+	const float		kMaxPinOffset = 0.2;	// In pitches
+	const float		kMaxPitchError = 0.15;
+	const float		kMinPinCenter = 16;		// Room for XKeyView::MeanWidthQ8
+	uint32_t	center[kMaxFlats];
+	uint32_t	numCenters = 0;
+	uint32_t	maxFlatLen = MedianFlatLen() * 3 / 2;
+	mPinFlatMask = 0;
+	mNumExtraPinFlats = 0;
+	mPitchFitted = false;
+	if (inNumPins > kMaxPins)
+	{
+		inNumPins = kMaxPins;
+	}
+	if (maxFlatLen > inNominalPitch/2)
+	{
+		maxFlatLen = inNominalPitch/2;
+	}
+	for (uint32_t i = 0; i < mNumFlats; i++)
+	{
+		uint32_t	flatLen = mFlatStart[i] - mFlatEnd[i];
+		if (i == 0 ||
+			flatLen <= maxFlatLen)
+		{
+			center[numCenters++] = mFlatStart[i] - (flatLen/2) + kFlatDelay;
+		}
+	}
+	if (numCenters == 0 ||
+		inNominalPitch == 0)
+	{
+		return(false);
+	}
+
+	LineFit	pitchFit;
+	uint32_t	pinFlatCenter[kMaxPins];
+	float	firstCenter = center[0];
+	float	pitch = inNominalPitch;
+	int32_t	lastPin = 0;
+	pitchFit.Add(0, center[0]);
+	pinFlatCenter[0] = center[0];
+	mPinFlatMask = 1;
+	for (uint32_t i = 1; i < numCenters; i++)
+	{
+		float	pinOffset = (firstCenter - (float)center[i]) / pitch;
+		int32_t	pin = (int32_t)(pinOffset + 0.5);
+		if (fabsf(pinOffset - pin) > kMaxPinOffset)
+		{
+			continue;
+		}
+		if (pin >= (int32_t)inNumPins)
+		{
+			mNumExtraPinFlats++;
+		} else if (pin > lastPin)
+		{
+			pitchFit.Add(pin, center[i]);
+			pinFlatCenter[pin] = center[i];
+			mPinFlatMask |= (1 << pin);
+			lastPin = pin;
+			if (pitchFit.IsValid())
+			{
+				firstCenter = pitchFit.Intercept();
+				pitch = -pitchFit.Slope();
+			}
+		}
+	}
+	mPitchFitted = pitchFit.IsValid() &&
+		fabsf(pitch - inNominalPitch) <= (inNominalPitch * kMaxPitchError);
+	if (!mPitchFitted)
+	{
+		firstCenter = center[0];
+		pitch = inNominalPitch;
+	}
+	if ((firstCenter - (pitch * (inNumPins - 1))) < kMinPinCenter)
+	{
+		mPinFlatMask = 0;
+		mPitchFitted = false;
+		return(false);
+	}
+	mPitchQ16 = (uint32_t)(pitch * 65536 + 0.5f);
+	for (uint32_t i = 0; i < inNumPins; i++)
+	{
+		float	pinCenter = firstCenter - (pitch * i);
+		mPinCenter[i] = (uint32_t)(pinCenter + 0.5f);
+		mPinResidual[i] = PinHasFlat(i) ?
+			(int32_t)lroundf((float)pinFlatCenter[i] - pinCenter) : 0;
+	}
+	return(true);
+}
+
+/******************************** MedianFlatLen *******************************/
+uint32_t FlatSegmenter::MedianFlatLen(void) const
+{
+	uint32_t	flatLen[kMaxFlats];
+	for (uint32_t i = 0; i < mNumFlats; i++)
+	{
+		// Insertion sort, there are only a few flats.
+		uint32_t	thisLen = mFlatStart[i] - mFlatEnd[i];
+		uint32_t	j = i;
+		for (; j > 0 && flatLen[j-1] > thisLen; j--)
+		{
+			flatLen[j] = flatLen[j-1];
+		}
+		flatLen[j] = thisLen;
+	}
+	return(mNumFlats ? flatLen[mNumFlats/2] : 0);
+}
@@ -0,0 +1,118 @@
+/*
+*	FlatSegmenter.h, Copyright Jonathan Mackey 2025
+*	Locates every key flat along the blade and fits the pin spacing.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef FlatSegmenter_h
+#define FlatSegmenter_h
+
+#include "FlatDetector.h"
+#include "SKeySpecU32.h"
+
+/*
+*	Runs the FlatDetector from the bow (FlatDetector::kScanStart) to the tip
+*	(kBladeEnd), restarting it after each flat found, so that every flat of
+*	the blade is located.  Like the FlatDetector, the search can be run in
+*	steps.
+*
+*	Fit then assigns each flat to a pin and fits the first pin center and the
+*	pin pitch (in lines) by least squares.  The pitch doesn't depend on the
+*	centers scale, so an error in the centers scale doesn't accumulate toward
+*	the tip.
+*/
+class FlatSegmenter
+{
+public:
+	enum
+	{
+		kBladeEnd	= 450,		// Lowest index searched (see XKeyView::UpdateSkew)
+		kMaxFlats	= 12,
+		kMaxPins	= SKeySpecU32::kMaxPins
+	};
+							FlatSegmenter(void);
+	void					Begin(
+								const uint16_t*			inKeyData);
+	/*
+	*	Processes up to inMaxSteps entries (0 = no limit.)  Returns true when
+	*	the search has finished.
+	*/
+	bool					Step(
+								uint32_t				inMaxSteps = 0);
+	bool					Done(void) const
+								{return(mDone);}
+								// Entries left to search, at most
+	uint32_t				EntriesLeft(void) const
+								{return(mDone ? 0 : mFlatDetector.Index() - kBladeEnd);}
+	uint32_t				NumFlats(void) const
+								{return(mNumFlats);}
+	uint32_t				FlatStart(
+								uint32_t				inFlat) const
+								{return(mFlatStart[inFlat]);}
+	uint32_t				FlatEnd(
+								uint32_t				inFlat) const
+								{return(mFlatEnd[inFlat]);}
+	/*
+	*	inNominalPitch is the pin spacing in lines according to the centers
+	*	scale.  It's used to assign the flats to pins, and when fewer than two
+	*	pins have a flat, the centers are extrapolated from the first flat
+	*	using it.  Returns false if no flats were found, or if the last pin
+	*	center isn't within the key data (the key has fewer pins.)
+	*/
+	bool					Fit(
+								uint32_t				inNumPins,
+								uint32_t				inNominalPitch);
+	bool					PitchIsFitted(void) const
+								{return(mPitchFitted);}
+								// Pin pitch in lines, 16.16
+	uint32_t				PitchQ16(void) const
+								{return(mPitchQ16);}
+	uint32_t				PinCenter(
+								uint32_t				inPin) const
+								{return(mPinCenter[inPin]);}
+	bool					PinHasFlat(
+								uint32_t				inPin) const
+								{return((mPinFlatMask & (1 << inPin)) != 0);}
+								// Flat center - fitted center, in lines
+	int32_t					PinResidual(
+								uint32_t				inPin) const
+								{return(mPinResidual[inPin]);}
+								/*
+								*	Flats past the last pin that are where
+								*	the following pins would be.
+								*/
+	uint32_t				NumExtraPinFlats(void) const
+								{return(mNumExtraPinFlats);}
+protected:
+	FlatDetector	mFlatDetector;
+	uint32_t		mNumFlats;
+	uint32_t		mNumExtraPinFlats;
+	uint32_t		mFlatStart[kMaxFlats];
+	uint32_t		mFlatEnd[kMaxFlats];
+	uint32_t		mPitchQ16;
+	uint32_t		mPinCenter[kMaxPins];
+	int32_t			mPinResidual[kMaxPins];
+	uint8_t			mPinFlatMask;
+	bool			mPitchFitted;
+	bool			mDone;
+
+	uint32_t				MedianFlatLen(void) const;
+};
+
+#endif // FlatSegmenter_h
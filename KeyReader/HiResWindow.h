@@ -0,0 +1,135 @@
+/*
+*	HiResWindow.h, Copyright Jonathan Mackey 2025
+*	The region of the hi-res frame captured by the DCMI.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef HiResWindow_h
+#define HiResWindow_h
+
+#include <inttypes.h>
+
+/*
+*	The decoder only examines the lines between the tip end of the blade
+*	search (FlatSegmenter::kBladeEnd) and just past the start of the flat
+*	search (FlatDetector::kScanStart.)  The default window starts well below
+*	kBladeEnd because the last pin center of a key that isn't fully seated
+*	can be below it (the root depth is still read there.)  The DCMI crop
+*	feature drops the lines and columns outside of the window before they're
+*	transferred, so the DMA and the line callback only handle the lines of
+*	the window.
+*
+*	The streamed flat search (XKeyView::StreamKeyData) can't start until line
+*	kScanStart has been received, so only the lines of the window past it
+*	overlap with the search.  The search is paced to finish by the last line
+*	of the window.  The fewer lines past kScanStart, the more of the search
+*	is done per main loop call: about 170 entries per call with the default
+*	window, the whole search in one call if the window ends at kScanStart.
+*
+*	The lines of the window are still stored at their frame line index
+*	within the key data, so the decoder's indexes don't change.  FrameLine
+*	maps the line count of the DMA transfer to the frame line index.  The
+*	columns are mapped back the same way for the absolute edge positions.
+*
+*	The crop registers are in DCMI pixel clocks.  With 8 bit data each YUYV
+*	pixel takes two pixel clocks.  The sizes are less one.
+*
+*	No HAL dependencies so that the remapping can be modeled on the host
+*	(see KeyScanReplay -w.)
+*/
+class HiResWindow
+{
+public:
+	enum
+	{
+		kFrameLines			= 1918,	// OV5640::kHRYOutputSize
+		kFrameColumns		= 1000,	// OV5640::kHRXOutputSize
+		kDecodeFirstLine	= 300,
+		kDecodeEndLine		= 1760
+	};
+							HiResWindow(void)
+								{SetToDecodeLines();}
+	void					SetToFullFrame(void)
+								{Set(0, kFrameLines, 0, kFrameColumns);}
+	void					SetToDecodeLines(void)
+								{Set(kDecodeFirstLine, kDecodeEndLine - kDecodeFirstLine,
+										0, kFrameColumns);}
+	/*
+	*	The columns must be even (the line buffer is scanned a word, two
+	*	pixels, at a time.)  Returns false and leaves the window unchanged
+	*	if the window isn't within the frame.
+	*/
+	bool					Set(
+								uint32_t				inFirstLine,
+								uint32_t				inNumLines,
+								uint32_t				inFirstColumn,
+								uint32_t				inNumColumns)
+							{
+								bool	success = inNumLines != 0 &&
+									(inFirstLine + inNumLines) <= kFrameLines &&
+									inNumColumns != 0 &&
+									(inFirstColumn + inNumColumns) <= kFrameColumns &&
+									((inFirstColumn | inNumColumns) & 1) == 0;
+								if (success)
+								{
+									mFirstLine = inFirstLine;
+									mNumLines = inNumLines;
+									mFirstColumn = inFirstColumn;
+									mNumColumns = inNumColumns;
+								}
+								return(success);
+							}
+	bool					IsFullFrame(void) const
+								{return(mNumLines == kFrameLines &&
+										mNumColumns == kFrameColumns);}
+	uint32_t				FirstLine(void) const
+								{return(mFirstLine);}
+	uint32_t				NumLines(void) const
+								{return(mNumLines);}
+	uint32_t				EndLine(void) const
+								{return(mFirstLine + mNumLines);}
+	uint32_t				FirstColumn(void) const
+								{return(mFirstColumn);}
+	uint32_t				NumColumns(void) const
+								{return(mNumColumns);}
+	bool					ContainsLine(
+								uint32_t				inFrameLine) const
+								{return(inFrameLine >= mFirstLine &&
+										inFrameLine < EndLine());}
+								// inWindowLine is the DMA line count
+	uint32_t				FrameLine(
+								uint32_t				inWindowLine) const
+								{return(mFirstLine + inWindowLine);}
+	uint32_t				FrameColumn(
+								uint32_t				inWindowColumn) const
+								{return(mFirstColumn + inWindowColumn);}
+								// DCMI_CWSTRTR: VST[28:16], HOFFCNT[13:0]
+	uint32_t				CropStartReg(void) const
+								{return((mFirstLine << 16) | (mFirstColumn * 2));}
+								// DCMI_CWSIZER: VLINE[29:16], CAPCNT[13:0]
+	uint32_t				CropSizeReg(void) const
+								{return(((mNumLines - 1) << 16) | ((mNumColumns * 2) - 1));}
+protected:
+	uint16_t	mFirstLine;
+	uint16_t	mNumLines;
+	uint16_t	mFirstColumn;
+	uint16_t	mNumColumns;
+};
+
+#endif // HiResWindow_h
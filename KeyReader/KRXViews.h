@@ -60,6 +60,9 @@ static const char kLoadKRSettingsStr[] =	"Press OK to load file\n"
 											"KRSettings.txt.  The board\n"
 											"will restart if successful.";
 static const char kAdjustmentsSavedStr[] = "Adjustments saved.";
+static const char kCalibrationFailedStr[] = "Unable to calibrate from\n"
+											"this scan.  Check the key\n"
+											"and scan again.";
 static const char kTimeSetStr[] = "Time set.";
 											
 static const char kFailedToReadPrefsStr[] = "Failed to read preferences from EEPROM";
@@ -68,6 +71,9 @@ static const char kSaveLastScanToSDStr[] = "Save last scan to SD:";
 static const char kNoScanDataAvailableStr[] = "No scan data available.";
 static const char kDataFilePrefix[] = "const uint16_t kTestKey[] =\n{\n";
 static const char kDataFileSuffix[] = "};\n";
+static const char kDataFileQ8Prefix[] = "\nconst uint32_t kTestKeyQ8[] =\n{\n";
+static const char kDataFileLeftPrefix[] = "\nconst uint16_t kTestKeyLeft[] =\n{\n";
+static const char kDataFileRightPrefix[] = "\nconst uint16_t kTestKeyRight[] =\n{\n";
 static const char kSavedScanToSDStr[] = "Saved scan data to %s";
 static const char kShowAdjustmentCtrlsStr[] = "Show adjustment controls";
 
@@ -271,15 +277,20 @@ XMenuItem	kwikseteMenuItem(kKwiksetKW1MenuItem, kKwiksetKW1Str);
 XMenuItem	schlageMenuItem(kSchlageSC1MenuItem, kSchlageSC1Str, &kwikseteMenuItem);
 XMenu		keywayMenu(kKeywayMenuTag,
 				&UI20ptFont, &schlageMenuItem);
+//	Items for the keyways loaded from SD (see KeyReaderSTM32::LoadKeywaysFromSD)
+XMenuItem	loadedKeywayMenuItems[KeywayTable::kMaxKeyways];
 
 //	Preview Format menu
+static const char kGrayscaleStr[] = "Gray";
 static const char kBlackAndWhiteStr[] = "B&W";
 static const char kColorStr[] = "Color";
 
+static const uint16_t	kGrayscaleMenuItem = 3;
 static const uint16_t	kBlackAndWhiteItem = 2;
 static const uint16_t	kColorMenuItem = 1;
 
-XMenuItem	blackAndWhiteItem(kBlackAndWhiteItem, kBlackAndWhiteStr);
+XMenuItem	grayscaleMenuItem(kGrayscaleMenuItem, kGrayscaleStr);
+XMenuItem	blackAndWhiteItem(kBlackAndWhiteItem, kBlackAndWhiteStr, &grayscaleMenuItem);
 XMenuItem	colorMenuItem(kColorMenuItem, kColorStr, &blackAndWhiteItem);
 XMenu		previewFormatMenu(kPreviewFormatMenuTag,
 				&UI20ptFont, &colorMenuItem);
@@ -26,6 +26,7 @@
 #include "AT24CDataStream.h"
 #include "SerialUtils.h"
 #include "ValueReader.h"
+#include "XFontGlyphCache.h"
 
 /*
 *	The pins numbers for the defualt Wire, SPI and Serial objects are defined
@@ -38,6 +39,7 @@ TwoWire Wire2((uint32_t)Config::kSDA2Pin, (uint32_t)Config::kSCL2Pin);	// Used b
 
 #if 1
 XFont	xFont;
+XFontGlyphCache	glyphCache;
 // 8-bit fonts (antialiased)
 #define UI20ptFont	MyriadPro_Regular_20::font
 #include "MyriadPro-Regular_20.h"
@@ -47,9 +49,9 @@ XFont	xFont;
 #include "KRXViews.h"
 
 static const char kKRSettingsPath[] = "KRSettings.txt";
+static const char kKeywaysPath[] = "Keyways.bin";
 
-SKeySpecU32	schlageKeySpec = {"Schlage", 5, 10, 9, 2000000, 150000, 2310000, 1562000};
-SKeySpecU32	kwiksetKeySpec = {"Kwikset", 5, 7, 7, 1910000, 230000, 2470000, 1500000};
+#include "KeySpecs.h"
 
 /***************************** KeyReaderSTM32 *****************************/
 KeyReaderSTM32::KeyReaderSTM32(void)
@@ -59,8 +61,12 @@ KeyReaderSTM32::KeyReaderSTM32(void)
 			Config::kDisplayHeight, Config::kDisplayWidth,
 			0, 0, 0, 0, Config::kInvertTouchX, Config::kInvertTouchY),
 	mButtonDebouncePeriod(DEBOUNCE_DELAY), mButtonPressed(false),
-	mCamera(Wire2), mPreviewWasStoppedForSleep(false),mSendDebugStrings(false)
+	mCamera(Wire2), mPreviewWasStoppedForSleep(false),mSendDebugStrings(false),
+	mIdentifyKeyway(true), mSampleAttempt(0), mAlignDrawPeriod(500),
+	mAlignFramesSeen(0), mAlignDrawnScore(0), mAlignDrawnIsAligned(false),
+	mAutoScan(false), mAutoScanArmed(false)
 {
+	mCalibrationCode[0] = 0;
 }
 
 /************************************ begin ***********************************/
@@ -153,7 +159,7 @@ void KeyReaderSTM32::begin(void)
 		mCamera.begin(std::bind(&XKeyView::EnterPreviewMode, keyView, _1),
 						std::bind(&XKeyView::ExitPreviewMode, keyView, _1),
 						std::bind(&KeyReaderSTM32::KeyDataChanged, this, _1),
-						std::bind(&XKeyView::UpdateStatusMessage, keyView, _1));
+						std::bind(&XKeyView::UpdateStatusMessage, std::ref(keyView), _1));
 
 		mDisplay.begin(Config::kDisplayRotation);	// Init TFT
 		Wire.begin();
@@ -169,6 +175,7 @@ void KeyReaderSTM32::begin(void)
 		}
 	}
 	mTouchScreen.begin(Config::kDisplayRotation);
+	LoadKeywaysFromSD();
 #if 0
 	/*
 	*	I2C address scanning
@@ -289,7 +296,7 @@ void KeyReaderSTM32::begin(void)
 						pinCountPopUp.SelectMenuItem(prefs.mainViewPrefs.pinCountMenuItemTag);
 						previewFormatPopUp.SelectMenuItem(prefs.mainViewPrefs.previewFormatMenuItemTag);
 					}
-					keyView.SetKeySpec(prefs.mainViewPrefs.keywayMenuItemTag == kSchlageSC1MenuItem ? &schlageKeySpec : &kwiksetKeySpec, false);
+					keyView.SetKeySpec(KeySpecForTag(prefs.mainViewPrefs.keywayMenuItemTag), false);
 				}
 			}
 		} else
@@ -312,6 +319,7 @@ void KeyReaderSTM32::begin(void)
 	warningDialog.SetViewChangedDelegate(this);
 	warningDialog.SetMinDialogSize();
 	xFont.SetDisplay(&mDisplay, &UI20ptFont);	// To initialize mDisplay of xFont
+	xFont.SetGlyphCache(&glyphCache);
 	
 	ShowMainView();
 }
@@ -358,6 +366,26 @@ bool KeyReaderSTM32::Update(void)
 		}
 	}
 	CheckButtons();	// Buttons are used to setup the touchscreen.
+	/*
+	*	Decode the key data while the remainder of the hi-res frame is being
+	*	received.
+	*/
+	if (mCamera.HiResInProgress())
+	{
+		/*
+		*	If the sample frame was restarted (a retry) THEN
+		*	the decode of the discarded frame is abandoned.
+		*/
+		if (mSampleAttempt != mCamera.SampleAttempt())
+		{
+			mSampleAttempt = mCamera.SampleAttempt();
+			keyView.ResetStream();
+		}
+		keyView.SetEdgeData(mCamera.GetEdgeLeft(), mCamera.GetEdgeRight());
+		keyView.StreamKeyData(mCamera.GetStreamingKeyData(),
+				mCamera.GetStreamingKeyDataQ8(), mCamera.LinesReceived(),
+				mCamera.GetHiResWindow().EndLine());
+	}
 	mCamera.Update();
 
 	/*
@@ -434,6 +462,24 @@ bool KeyReaderSTM32::Update(void)
 				Serial.printf("Debug Strings %s\n", mSendDebugStrings ? "ON":"OFF");
 				break;
 			}
+			case 'q':
+				/*
+				*	Toggles sub-pixel edge localisation for hi-res scans
+				*	(by default OFF)
+				*/
+				Serial.flush();
+				DCMI_OV5640::SetSubPixelMode(!DCMI_OV5640::SubPixelMode());
+				Serial.printf(".Sub-pixel %s\n", DCMI_OV5640::SubPixelMode() ? "ON":"OFF");
+				break;
+			case 'e':
+				/*
+				*	Toggles saving both blade edges of hi-res scans, used to
+				*	measure and remove the skew of the key (by default OFF)
+				*/
+				Serial.flush();
+				DCMI_OV5640::SetDualEdgeMode(!DCMI_OV5640::DualEdgeMode());
+				Serial.printf(".Dual-edge %s\n", DCMI_OV5640::DualEdgeMode() ? "ON":"OFF");
+				break;
 			case 'T':
 			{
 				char line[255];
@@ -441,6 +487,27 @@ bool KeyReaderSTM32::Update(void)
 				DCMI_OV5640::SetBWThresholdFromStr(line);
 				break;
 			}
+			case 'a':
+				/*
+				*	Toggles the automatic (per scan) B&W threshold
+				*	(by default OFF)
+				*/
+				Serial.flush();
+				DCMI_OV5640::SetAutoBWThreshold(!DCMI_OV5640::AutoBWThreshold());
+				Serial.printf(".Auto BWThreshold %s\n", DCMI_OV5640::AutoBWThreshold() ? "ON":"OFF");
+				break;
+			case 'M':
+			{
+				/*
+				*	Sets the number of frames used by the multi-frame median
+				*	hi-res scan.  0 samples a single frame (the default.)
+				*	Example "M 3"
+				*/
+				char line[255];
+				SerialUtils::LoadLine(254, line);
+				DCMI_OV5640::SetMedianFramesFromStr(line);
+				break;
+			}
 			case 'c':
 			{
 				bool showAdjustments = showAdjustmentsCheckbox.GetState() == XControl::eOn;
@@ -481,10 +548,32 @@ bool KeyReaderSTM32::Update(void)
 				Serial.flush();
 				SaveKeyViewAdjustments();
 				break;
+			case 'K':
+			{
+				/*
+				*	Calibrates the centers and depths scales from the next
+				*	scan.  The key scanned must be of the current keyway and
+				*	of the code that follows, bow to tip.  "K" alone cancels.
+				*	Example "K 29141"
+				*/
+				char line[255];
+				SerialUtils::LoadLine(254, line);
+				SetCalibrationCodeFromStr(line);
+				break;
+			}
 			case 'i':
 				Serial.flush();
 				keyView.Dump(nullptr);
 				break;
+			case 'k':
+				/*
+				*	Toggles the keyway identification done after each scan
+				*	(by default ON)
+				*/
+				Serial.flush();
+				mIdentifyKeyway = !mIdentifyKeyway;
+				Serial.printf(".Identify keyway %s\n", mIdentifyKeyway ? "ON":"OFF");
+				break;
 			case 'w':
 			{
 				/*
@@ -504,6 +593,64 @@ bool KeyReaderSTM32::Update(void)
 				mCamera.SetHueFromStr(line);
 				break;
 			}
+			case 'p':
+				/*
+				*	Prints the time spent in each state of the last scan, and
+				*	the camera register writes since the last p.
+				*/
+				Serial.flush();
+				mCamera.DumpScanTiming();
+				mCamera.DumpRegWriteStats();
+				break;
+			case 'g':
+				/*
+				*	Prints the cycles taken to copy each preview line to the
+				*	display, per preview format, since the last g.
+				*/
+				Serial.flush();
+				DCMI_OV5640::DumpPreviewLineCycles();
+				break;
+			case 'f':
+				/*
+				*	Prints the glyph cache hits and misses since the last f.
+				*/
+				Serial.flush();
+				Serial.printf(".Glyph cache %u hits, %u misses\n",
+						glyphCache.Hits(), glyphCache.Misses());
+				glyphCache.ResetCounters();
+				break;
+			case 'G':
+				/*
+				*	Toggles the contrast stretch of the grayscale preview
+				*	(by default ON)
+				*/
+				Serial.flush();
+				DCMI_OV5640::SetGrayStretch(!DCMI_OV5640::GrayStretch());
+				Serial.printf(".Gray stretch %s\n", DCMI_OV5640::GrayStretch() ? "ON":"OFF");
+				break;
+			case 'u':
+				/*
+				*	Toggles the auto scan, starting a scan without a touch
+				*	once the previewed key is aligned and motionless
+				*	(by default OFF)
+				*/
+				Serial.flush();
+				mAutoScan = !mAutoScan;
+				Serial.printf(".Auto scan %s\n", mAutoScan ? "ON":"OFF");
+				break;
+			case 'r':
+			{
+				/*
+				*	Sets the region of the hi-res frame transferred by the DCMI.
+				*	"r" alone prints the current window.
+				*
+				*	See DCMI_OV5640::SetHiResWindowFromStr()
+				*/
+				char line[255];
+				SerialUtils::LoadLine(254, line);
+				mCamera.SetHiResWindowFromStr(line);
+				break;
+			}
 			default:
 				Serial.flush();
 				break;
@@ -511,6 +658,17 @@ bool KeyReaderSTM32::Update(void)
 	}
 #endif	
 
+	/*
+	*	Draw the views invalidated during this pass.  Each invalid area is
+	*	drawn once no matter how many times it was invalidated.
+	*/
+	if (!mDisplaySleeping &&
+		rootView.HasInvalidRect())
+	{
+		mCamera.SuspendPreview();
+		rootView.DrawInvalid();
+		mCamera.ResumePreview();
+	}
 	return(false);
 }
 
@@ -525,10 +683,11 @@ void KeyReaderSTM32::WakeUp(void)
 		mDisplaySleeping = false;
 		mDisplay.WakeUp();
 		rootView.Draw(0, 0, 999, 999);
+		rootView.Validate();
 		if (mPreviewWasStoppedForSleep)
 		{
 			mPreviewWasStoppedForSleep = false;
-			mCamera.StartPreviewStream(previewFormatMenu.GetSelectedItem()->Tag() == kColorMenuItem);
+			StartPreview();
 		}
 	}
 	UnixTime::ResetSleepTime();
@@ -664,14 +823,90 @@ void KeyReaderSTM32::UpdateMainView(void)
 	{
 		if (UnixTime::TimeChanged())
 		{
-			mCamera.SuspendPreview();
 			UnixTime::ResetTimeChanged();
 			infoDateValueField.SetValue(UnixTime::Time());
-			mCamera.ResumePreview();
+		}
+		UpdateAlignment();
+		UpdateAutoScan();
+	}
+}
+
+/****************************** UpdateAlignment *******************************/
+/*
+*	Redraws the live alignment score of the preview when it changes.  Drawing
+*	suspends the preview (a dropped frame), so the score is redrawn at most
+*	every mAlignDrawPeriod, and only when it has changed by enough to matter
+*	or the aligned state has changed.
+*/
+void KeyReaderSTM32::UpdateAlignment(void)
+{
+	if (mCamera.PreviewAlignIsValid())
+	{
+		PreviewAlign::SAlignment	alignment;
+		DCMI_OV5640::GetPreviewAlign().GetAlignment(alignment);
+		if (mAlignFramesSeen != alignment.framesScored &&
+			mAlignDrawPeriod.Passed())
+		{
+			mAlignFramesSeen = alignment.framesScored;
+			uint32_t	score = alignment.score;
+			bool		isAligned = alignment.IsAligned();
+			uint32_t	scoreDelta = score > mAlignDrawnScore ?
+								score - mAlignDrawnScore : mAlignDrawnScore - score;
+			if (scoreDelta >= 5 ||
+				isAligned != mAlignDrawnIsAligned)
+			{
+				mAlignDrawnScore = score;
+				mAlignDrawnIsAligned = isAligned;
+				keyView.SetAlignment(score, alignment.tilt, isAligned, true);
+			}
+			mAlignDrawPeriod.Start();
 		}
 	}
 }
 
+/******************************* UpdateAutoScan *******************************/
+/*
+*	When auto scan is on, a scan is started without a touch once the preview
+*	has shown the key aligned and motionless for kAutoScanFrames frames.
+*	Only one scan is started per preview stream, so a key left in place after
+*	its scan isn't scanned again.  The alignment is only scored in the
+*	luminance (B&W and gray) preview formats.
+*/
+void KeyReaderSTM32::UpdateAutoScan(void)
+{
+	const uint32_t	kAutoScanFrames = 5;
+	if (mAutoScan &&
+		mAutoScanArmed &&
+		mCamera.PreviewAlignIsValid())
+	{
+		PreviewAlign::SAlignment	alignment;
+		DCMI_OV5640::GetPreviewAlign().GetAlignment(alignment);
+		if (alignment.stableFrames >= kAutoScanFrames)
+		{
+			Serial.printf(".Auto scan\n");
+			StartScan();
+		}
+	}
+}
+
+/******************************** StartPreview ********************************/
+void KeyReaderSTM32::StartPreview(void)
+{
+	mAutoScanArmed = true;
+	mCamera.StartPreviewStream(PreviewFormatForTag(previewFormatMenu.GetSelectedItem()->Tag()));
+}
+
+/********************************* StartScan **********************************/
+void KeyReaderSTM32::StartScan(void)
+{
+	mAutoScanArmed = false;
+	cancelBtn.Enable();
+	cutBtn.Enable(false, true);		// Nothing to cut
+	mCamera.StopPreviewStream();	// If streaming
+	keyView.ResetStream();
+	mCamera.StartHiResStream(true);
+}
+
 /****************************** ButtonPressedISR ******************************/
 /*
 *	Called via an interrupt.  The button press is handled in CheckButtons()
@@ -787,7 +1022,7 @@ void KeyReaderSTM32::HandleViewChange(
 					cancelBtn.Enable();
 					cutBtn.Enable(false, true);		// Nothing to cut
 					mCamera.StopHiResStream(true);	// If running
-					mCamera.StartPreviewStream(previewFormatMenu.GetSelectedItem()->Tag() == kColorMenuItem);
+					StartPreview();
 				}
 				break;
 			}
@@ -796,10 +1031,21 @@ void KeyReaderSTM32::HandleViewChange(
 				if (inAction == XControl::eOff &&
 					!mCamera.HiResInProgress())
 				{
-					cancelBtn.Enable();
-					cutBtn.Enable(false, true);		// Nothing to cut
-					mCamera.StopPreviewStream();	// If streaming
-					mCamera.StartHiResStream(true);
+					/*
+					*	If the preview shows a clearly misaligned (or missing)
+					*	key THEN don't start a scan that would fail, prompt to
+					*	realign the key instead.
+					*/
+					PreviewAlign::SAlignment	alignment;
+					DCMI_OV5640::GetPreviewAlign().GetAlignment(alignment);
+					if (mCamera.PreviewAlignIsValid() &&
+						!alignment.IsAligned())
+					{
+						keyView.SetAlignment(alignment.score, alignment.tilt, false, true);
+					} else
+					{
+						StartScan();
+					}
 				}
 				break;
 			}
@@ -931,11 +1177,11 @@ void KeyReaderSTM32::SaveMainViewChanges(void)
 		prefs.previewFormatMenuItemTag = previewFormatMenu.GetSelectedItem()->Tag();
 		mPreferences.Write(Config::kMainViewPrefsAddr, sizeof(Config::SMainViewPrefs), (uint8_t*)&prefs);
 		
-		keyView.SetKeySpec(prefs.keywayMenuItemTag == kSchlageSC1MenuItem ? &schlageKeySpec : &kwiksetKeySpec, true);
+		keyView.SetKeySpec(KeySpecForTag(prefs.keywayMenuItemTag), true);
 
 		if (previewFormatChanged)
 		{
-			mCamera.ChangePreviewFormat(previewFormatMenu.GetSelectedItem()->Tag() == kColorMenuItem);
+			mCamera.ChangePreviewFormat(PreviewFormatForTag(previewFormatMenu.GetSelectedItem()->Tag()));
 		}
 	}
 }
@@ -968,8 +1214,125 @@ void KeyReaderSTM32::KeyDataChanged(
 	// When inKeyData is a nullptr, the camera failed to take a hi res image
 	cancelBtn.Enable(false, true);
 	cutBtn.Enable(inKeyData!=nullptr, true);
+	keyView.SetKeyDataQ8(mCamera.GetKeyDataQ8());
+	keyView.SetEdgeData(mCamera.GetEdgeLeft(), mCamera.GetEdgeRight());
 	keyView.SetKeyData(inKeyData, true);
-	if (mSendDebugStrings)keyView.Dump(nullptr);
+	if (mSendDebugStrings)
+	{
+		Serial.printf(".Scan BWThreshold = %hu\n", DCMI_OV5640::GetScanBWThreshold());
+		keyView.Dump(nullptr);
+	}
+	if (inKeyData)
+	{
+		if (mCalibrationCode[0])
+		{
+			CalibrateFromScan();
+		} else if (mIdentifyKeyway)
+		{
+			IdentifyKeyway();
+		}
+	}
+}
+
+/******************************* IdentifyKeyway *******************************/
+/*
+*	Ranks all of the keyways by how well the last scan fits them (see
+*	XKeyView::GetFitCost.)  If the best keyway fits clearly better than the
+*	selected keyway, the best keyway and its pin count are selected and
+*	saved as though the user had selected them, and the scan is decoded
+*	again.  The margin keeps a scan that fits several keyways about as well
+*	from switching away from the keyway the user selected.
+*/
+void KeyReaderSTM32::IdentifyKeyway(void)
+{
+	const uint32_t	kMinCostImprovement = 10;
+	uint8_t		rank[KeywayTable::kMaxKeyways];
+	uint32_t	cost[KeywayTable::kMaxKeyways];
+	uint32_t	numRanked = keyView.RankKeySpecs(mKeyways.KeySpecs(),
+										mKeyways.Count(), rank, cost);
+	if (numRanked)
+	{
+		uint16_t	selectedTag = keywayMenu.GetSelectedItem()->Tag();
+		uint16_t	bestTag = mKeyways.Tag(rank[0]);
+		uint32_t	selectedCost = 0xFFFFFFFF;
+		for (uint32_t i = 0; i < numRanked; i++)
+		{
+			if (mKeyways.Tag(rank[i]) == selectedTag)
+			{
+				selectedCost = cost[i];
+			}
+			if (mSendDebugStrings)
+			{
+				Serial.printf(".%s %u\n", mKeyways.KeySpec(rank[i]).name, cost[i]);
+			}
+		}
+		if (bestTag != selectedTag &&
+			selectedCost > cost[0] &&
+			(selectedCost - cost[0]) > kMinCostImprovement)
+		{
+			keywayPopUp.SelectMenuItem(bestTag);
+			uint16_t	pinCountTag = mKeyways.KeySpec(rank[0]).numPins;
+			if (pinCountMenu.FindMenuItemWithTag(pinCountTag))
+			{
+				pinCountPopUp.SelectMenuItem(pinCountTag);
+			}
+			SaveMainViewChanges();
+		}
+	}
+}
+
+/************************** SetCalibrationCodeFromStr *************************/
+/*
+*	Sets the code of the key used to calibrate the next scan.  Only the digits
+*	of inStr are used.  No digits cancels the calibration.
+*/
+void KeyReaderSTM32::SetCalibrationCodeFromStr(
+	const char*	inStr)
+{
+	uint32_t	codeLen = 0;
+	for (; *inStr && codeLen < sizeof(mCalibrationCode)-1; inStr++)
+	{
+		if (*inStr >= '0' && *inStr <= '9')
+		{
+			mCalibrationCode[codeLen++] = *inStr;
+		}
+	}
+	mCalibrationCode[codeLen] = 0;
+	if (codeLen == 0)
+	{
+		Serial.printf(".Calibration OFF\n");
+	} else
+	{
+		Serial.printf(".Calibrate next scan as %s\n", mCalibrationCode);
+	}
+}
+
+/****************************** CalibrateFromScan *****************************/
+/*
+*	Called after a scan when a calibration code has been set.  The scales
+*	solved by XKeyView::Calibrate replace the current adjustments and are
+*	saved to EEPROM.
+*/
+void KeyReaderSTM32::CalibrateFromScan(void)
+{
+	uint32_t	centersScale, depthsScale;
+	if (keyView.Calibrate(mCalibrationCode, centersScale, depthsScale))
+	{
+		bool showAdjustments = showAdjustmentsCheckbox.GetState() == XControl::eOn;
+		Serial.printf(".Calibrated c %u, d %u (was c %u, d %u)\n",
+							centersScale, depthsScale,
+							keyView.GetCentersScale(), keyView.GetDepthsScale());
+		keyView.SetCentersScale(centersScale, false);
+		keyView.SetDepthsScale(depthsScale, true);
+		pinCentersValueField.SetValue(centersScale, showAdjustments);
+		pinDepthsValueField.SetValue(depthsScale, showAdjustments);
+		SaveKeyViewAdjustments();
+		mCalibrationCode[0] = 0;
+	} else
+	{
+		Serial.printf(".Unable to calibrate from this scan\n");
+		warningDialog.DoMessage(kCalibrationFailedStr);
+	}
 }
 
 /****************************** SaveScanDataToSD ******************************/
@@ -1022,6 +1385,73 @@ void KeyReaderSTM32::SaveScanDataToSD(void)
 						file.write(line , lineIdx);
 					}
 					file.write(kDataFileSuffix , sizeof(kDataFileSuffix)-1);
+					/*
+					*	If the scan was captured in sub-pixel mode, append
+					*	the 24.8 fixed point widths.  Only the decode lines
+					*	are kept, the rest are written as lines where no
+					*	edge was found.
+					*/
+					const uint32_t*	keyDataQ8 = mCamera.GetKeyDataQ8();
+					if (keyDataQ8)
+					{
+						file.write(kDataFileQ8Prefix , sizeof(kDataFileQ8Prefix)-1);
+						lineIdx = 1;
+						for (uint32_t i = 0; i < OV5640::kHRYOutputSize; )
+						{
+							lineIdx += snprintf(line + lineIdx, 100 - lineIdx, "% 6u, ",
+											(i >= HiResWindow::kDecodeFirstLine &&
+											 i < HiResWindow::kDecodeEndLine) ?
+												keyDataQ8[i - HiResWindow::kDecodeFirstLine] : (2 << 8));
+							i++;
+							if ((i & 0x7) != 0)
+							{
+								continue;
+							}
+							line[lineIdx-1] = '\n';
+							file.write(line , lineIdx);
+							lineIdx = 1;
+						}
+						if (lineIdx > 2)
+						{
+							lineIdx--;
+							line[lineIdx-1] = '\n';
+							file.write(line , lineIdx);
+						}
+						file.write(kDataFileSuffix , sizeof(kDataFileSuffix)-1);
+					}
+					/*
+					*	If the scan was captured in dual-edge mode, append
+					*	the edge positions.
+					*/
+					const uint16_t*	edges[] = {mCamera.GetEdgeLeft(), mCamera.GetEdgeRight()};
+					const char*	edgesPrefix[] = {kDataFileLeftPrefix, kDataFileRightPrefix};
+					for (uint32_t e = 0; e < 2 && edges[0]; e++)
+					{
+						file.write(edgesPrefix[e], strlen(edgesPrefix[e]));
+						lineIdx = 1;
+						for (uint32_t i = 0; i < OV5640::kHRYOutputSize; )
+						{
+							lineIdx += snprintf(line + lineIdx, 100 - lineIdx, "% 4u, ",
+											(i >= HiResWindow::kDecodeFirstLine &&
+											 i < HiResWindow::kDecodeEndLine) ?
+												edges[e][i - HiResWindow::kDecodeFirstLine] : 0);
+							i++;
+							if ((i & 0xF) != 0)
+							{
+								continue;
+							}
+							line[lineIdx-1] = '\n';
+							file.write(line , lineIdx);
+							lineIdx = 1;
+						}
+						if (lineIdx > 2)
+						{
+							lineIdx--;
+							line[lineIdx-1] = '\n';
+							file.write(line , lineIdx);
+						}
+						file.write(kDataFileSuffix , sizeof(kDataFileSuffix)-1);
+					}
 					file.close();
 				}
 			} else
@@ -1145,3 +1575,71 @@ void KeyReaderSTM32::LoadKRSettingsFromSD(void)
 		warningDialog.DoMessage(kNoSDCardFoundStr);
 	}
 }
+
+/****************************** LoadKeywaysFromSD *****************************/
+/*
+*	Adds the built in keyways and the keyways in kKeywaysPath, if present, to
+*	mKeyways, then adds a keyway menu item for each keyway from the file that
+*	doesn't already have one.  A keyway from the file with the tag of a built
+*	in keyway replaces it, including its menu item string.
+*	Called once from begin(), the keyways aren't reloaded.
+*/
+void KeyReaderSTM32::LoadKeywaysFromSD(void)
+{
+	mKeyways.Add(kwiksetKeySpec, kKwiksetKW1MenuItem);
+	mKeyways.Add(schlageKeySpec, kSchlageSC1MenuItem);
+	if (digitalRead(Config::kSDDetectPin) == LOW)
+	{
+		SdFat sd;
+		if (sd.begin(Config::kSDSelectPin, SD_SCK_MHZ(4)) &&
+			mKeyways.ReadFile(kKeywaysPath))
+		{
+			Serial.printf(".%u keyways\n", mKeyways.Count());
+		}
+	}
+	/*
+	*	The new items are appended in tag order after the built in items.
+	*/
+	XMenuItem*	lastItem = keywayMenu.GetMenuItems();
+	while (lastItem->NextItem())
+	{
+		lastItem = lastItem->NextItem();
+	}
+	uint32_t	itemsUsed = 0;
+	for (uint32_t i = 0; i < mKeyways.Count(); i++)
+	{
+		if (mKeyways.IsFromFile(i))
+		{
+			XMenuItem*	item = keywayMenu.FindMenuItemWithTag(mKeyways.Tag(i));
+			if (!item)
+			{
+				item = &loadedKeywayMenuItems[itemsUsed++];
+				item->SetTag(mKeyways.Tag(i));
+				keywayMenu.InsertMenuItem(item, lastItem->Tag());
+				lastItem = item;
+			}
+			item->SetString(mKeyways.KeySpec(i).name);
+		}
+	}
+}
+
+/***************************** PreviewFormatForTag ****************************/
+DCMI_OV5640::EPreviewFormat KeyReaderSTM32::PreviewFormatForTag(
+	uint16_t	inTag)
+{
+	return(inTag == kColorMenuItem ? DCMI_OV5640::ePreviewRGB :
+			(inTag == kGrayscaleMenuItem ? DCMI_OV5640::ePreviewGray :
+				DCMI_OV5640::ePreviewBW));
+}
+
+/******************************** KeySpecForTag *******************************/
+/*
+*	Returns the spec of the keyway menu item inTag.  As before the keyways
+*	were loaded from SD, an unknown tag is treated as Kwikset.
+*/
+const SKeySpecU32* KeyReaderSTM32::KeySpecForTag(
+	uint16_t	inTag) const
+{
+	const SKeySpecU32*	keySpec = mKeyways.Find(inTag);
+	return(keySpec ? keySpec : mKeyways.Find(kKwiksetKW1MenuItem));
+}
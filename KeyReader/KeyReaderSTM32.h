@@ -24,6 +24,7 @@
 
 #include "Config.h"
 #include "KRSettings.h"
+#include "KeywayTable.h"
 #include "AT24C.h"
 #include "DataStream.h"
 #include "TFT_ILI9488P.h"
@@ -60,13 +61,27 @@ protected:
 	bool			mPreviewWasStoppedForSleep;
 	MSPeriod		mButtonDebouncePeriod;
 	bool			mSendDebugStrings;
+	bool			mIdentifyKeyway;
 	uint32_t		mButtonPinState;
+	uint32_t		mSampleAttempt;		// Last DCMI_OV5640::SampleAttempt seen
+	MSPeriod		mAlignDrawPeriod;
+	uint32_t		mAlignFramesSeen;	// Last PreviewAlign::FramesScored seen
+	uint32_t		mAlignDrawnScore;
+	bool			mAlignDrawnIsAligned;
+	bool			mAutoScan;			// Start a scan when the key is stable
+	bool			mAutoScanArmed;		// Once per preview stream
 	uint16_t		mX, mY;
+	char			mCalibrationCode[SKeySpecU32::kMaxPins+1];	// Empty when not calibrating
+	KeywayTable		mKeyways;
 	
 protected:
 	bool					NoModalDialogDisplayed(void) const;
 	void					ShowMainView(void);
 	void					UpdateMainView(void);
+	void					UpdateAlignment(void);
+	void					UpdateAutoScan(void);
+	void					StartPreview(void);
+	void					StartScan(void);
 	void					WakeUp(void);
 	void					GoToSleep(void);
 	void					ButtonPressedISR(void);
@@ -77,6 +92,10 @@ protected:
 	void					SaveUtilitiesDialogChanges(void);
 	void					SaveMainViewChanges(void);
 	void					SaveKeyViewAdjustments(void);
+	void					SetCalibrationCodeFromStr(
+								const char*				inStr);
+	void					CalibrateFromScan(void);
+	void					IdentifyKeyway(void);
 	void					KeyDataChanged(
 								const uint16_t*			inKeyData);
 	void					SaveScanDataToSD(void);
@@ -86,6 +105,11 @@ protected:
 								const Config::SKRSettings&	inSettings);
 	void					SaveKRSettingsToSD(void);
 	void					LoadKRSettingsFromSD(void);
+	void					LoadKeywaysFromSD(void);
+	static DCMI_OV5640::EPreviewFormat PreviewFormatForTag(
+								uint16_t				inTag);
+	const SKeySpecU32*		KeySpecForTag(
+								uint16_t				inTag) const;
 };
 
 #endif // KeyReaderSTM32_h
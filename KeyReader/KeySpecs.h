@@ -0,0 +1,36 @@
+/*
+*	KeySpecs.h, Copyright Jonathan Mackey 2025
+*	The key specifications supported by the Key Reader.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef KeySpecs_h
+#define KeySpecs_h
+
+#include "SKeySpecU32.h"
+
+/*
+*	Shared by the firmware (KeyReaderSTM32.cpp) and the host scan replay tool
+*	(KeyScanReplay) so that both decode against the same specifications.
+*	This file should only be included once per executable.
+*/
+SKeySpecU32	schlageKeySpec = {"Schlage", 5, 10, 9, 2000000, 150000, 2310000, 1562000};
+SKeySpecU32	kwiksetKeySpec = {"Kwikset", 5, 7, 7, 1910000, 230000, 2470000, 1500000};
+
+#endif // KeySpecs_h
@@ -0,0 +1,213 @@
+/*
+*	KeywayTable.cpp, Copyright Jonathan Mackey 2025
+*	The keyway specifications, built in and loaded from a binary file on SD.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "KeywayTable.h"
+#ifndef __MACH__
+#include <Arduino.h>
+#include "SdFat.h"
+#include "sdios.h"
+#else
+#include <stdio.h>
+#endif
+#include <string.h>
+
+static const char kKeywayFileMagic[] = "KWY1";
+
+/******************************** KeywayTable *********************************/
+KeywayTable::KeywayTable(void)
+{
+	Clear();
+}
+
+/*********************************** Clear ************************************/
+void KeywayTable::Clear(void)
+{
+	mCount = 0;
+	mFromFileMask = 0;
+	memset(mIndexOfTag, 0xFF, sizeof(mIndexOfTag));
+}
+
+/************************************ Add *************************************/
+/*
+*	Returns false if the tag is out of range or the table is full.
+*/
+bool KeywayTable::Add(
+	const SKeySpecU32&	inKeySpec,
+	uint16_t			inTag,
+	bool				inFromFile)
+{
+	bool	success = inTag != 0 && inTag <= kMaxTag;
+	if (success)
+	{
+		uint32_t	index = mIndexOfTag[inTag];
+		if (index >= mCount)
+		{
+			success = mCount < kMaxKeyways;
+			if (success)
+			{
+				/*
+				*	Insert in tag order.
+				*/
+				index = mCount;
+				for (; index > 0 && mTag[index-1] > inTag; index--)
+				{
+					mKeySpec[index] = mKeySpec[index-1];
+					mTag[index] = mTag[index-1];
+				}
+				uint32_t	belowMask = (1UL << index) - 1;
+				mFromFileMask = (mFromFileMask & belowMask) |
+									((mFromFileMask & ~belowMask) << 1);
+				mTag[index] = inTag;
+				mCount++;
+				for (uint32_t i = index; i < mCount; i++)
+				{
+					mIndexOfTag[mTag[i]] = i;
+				}
+			}
+		}
+		if (success)
+		{
+			mKeySpec[index] = inKeySpec;
+			if (inFromFile)
+			{
+				mFromFileMask |= (1UL << index);
+			} else
+			{
+				mFromFileMask &= ~(1UL << index);
+			}
+		}
+	}
+	return(success);
+}
+
+/******************************* RecordToKeySpec ******************************/
+/*
+*	Returns false if the record isn't usable by XKeyView.
+*/
+bool KeywayTable::RecordToKeySpec(
+	const SKeywayRecord&	inRecord,
+	SKeySpecU32&			outKeySpec)
+{
+	bool	success = inRecord.tag != 0 &&
+						inRecord.tag <= kMaxTag &&
+						inRecord.numPins != 0 &&
+						inRecord.numPins <= SKeySpecU32::kMaxPins &&
+						inRecord.numPinDepths >= 2 &&
+						inRecord.numPinDepths <= SKeySpecU32::kMaxPinDepths &&
+						inRecord.deepestCutIndex <= 9 &&
+						inRecord.pinSpacing != 0;
+	if (success)
+	{
+		memcpy(outKeySpec.name, inRecord.name, sizeof(outKeySpec.name));
+		outKeySpec.name[sizeof(outKeySpec.name)-1] = 0;
+		outKeySpec.numPins = inRecord.numPins;
+		outKeySpec.numPinDepths = inRecord.numPinDepths;
+		outKeySpec.deepestCutIndex = inRecord.deepestCutIndex;
+		outKeySpec.deepestCut = inRecord.deepestCut;
+		outKeySpec.pinDepthInc = inRecord.pinDepthInc;
+		outKeySpec.firstPinCenter = inRecord.firstPinCenter;
+		outKeySpec.pinSpacing = inRecord.pinSpacing;
+		memset(outKeySpec.pinDepth, 0, sizeof(outKeySpec.pinDepth));
+		/*
+		*	The cut indexes go from the deepest cut toward 0 or from 1 up to
+		*	the deepest cut (see SKeySpecU32::CutIndexInc.)  Both must remain
+		*	single digits.
+		*/
+		int32_t	shallowestCutIndex = (int32_t)outKeySpec.deepestCutIndex +
+				((int32_t)outKeySpec.numPinDepths - 1) * outKeySpec.CutIndexInc();
+		success = shallowestCutIndex >= 0 && shallowestCutIndex <= 9;
+		if (success &&
+			inRecord.pinDepth[0])
+		{
+			/*
+			*	XKeyView expects the root depths to increase from the deepest
+			*	cut to the shallowest.
+			*/
+			for (uint32_t i = 0; i < outKeySpec.numPinDepths; i++)
+			{
+				if (i &&
+					inRecord.pinDepth[i] <= inRecord.pinDepth[i-1])
+				{
+					success = false;
+					break;
+				}
+				outKeySpec.pinDepth[i] = inRecord.pinDepth[i];
+			}
+		} else if (inRecord.pinDepthInc == 0)
+		{
+			success = false;
+		}
+	}
+	return(success);
+}
+
+/********************************** ReadFile **********************************/
+bool KeywayTable::ReadFile(
+	const char*	inPath)
+{
+	SKeywayFileHeader	header;
+#ifndef __MACH__
+	SdFile file;
+	bool	success = file.open(inPath, O_RDONLY) &&
+				file.read(&header, sizeof(header)) == sizeof(header);
+#else
+	FILE*	file = fopen(inPath, "rb");
+	bool	success = file != nullptr &&
+				fread(&header, 1, sizeof(header), file) == sizeof(header);
+#endif
+	success = success &&
+				memcmp(header.magic, kKeywayFileMagic, sizeof(header.magic)) == 0 &&
+				header.recordSize >= sizeof(SKeywayRecord);
+	if (success)
+	{
+		uint32_t	skipSize = header.recordSize - sizeof(SKeywayRecord);
+		for (uint32_t i = 0; i < header.count; i++)
+		{
+			SKeywayRecord	record;
+			SKeySpecU32		keySpec;
+#ifndef __MACH__
+			if (file.read(&record, sizeof(record)) != sizeof(record) ||
+				(skipSize && !file.seekCur(skipSize)))
+#else
+			if (fread(&record, 1, sizeof(record), file) != sizeof(record) ||
+				(skipSize && fseek(file, skipSize, SEEK_CUR) != 0))
+#endif
+			{
+				success = false;
+				break;
+			}
+			if (RecordToKeySpec(record, keySpec))
+			{
+				Add(keySpec, record.tag, true);
+			}
+		}
+	}
+#ifndef __MACH__
+	file.close();
+#else
+	if (file)
+	{
+		fclose(file);
+	}
+#endif
+	return(success);
+}
@@ -0,0 +1,115 @@
+/*
+*	KeywayTable.h, Copyright Jonathan Mackey 2025
+*	The keyway specifications, built in and loaded from a binary file on SD.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef KeywayTable_h
+#define KeywayTable_h
+
+#include "SKeySpecU32.h"
+
+/*
+*	Keyway file format (little endian):
+*	SKeywayFileHeader followed by count SKeywayRecord.  recordSize is the size
+*	of each record in the file.  Records larger than SKeywayRecord are allowed
+*	so that fields can be appended without breaking older firmware, the extra
+*	bytes are skipped.
+*/
+struct SKeywayFileHeader
+{
+	char		magic[4];		// "KWY1"
+	uint16_t	count;
+	uint16_t	recordSize;
+};
+
+struct SKeywayRecord
+{
+	uint16_t	tag;			// Keyway menu item tag, 1 to KeywayTable::kMaxTag
+	uint8_t		numPins;
+	uint8_t		numPinDepths;
+	uint8_t		deepestCutIndex;
+	uint8_t		unused[3];
+	char		name[20];		// Also the keyway menu item string
+	// The remaining values are in inches * 10,000,000
+	uint32_t	deepestCut;
+	uint32_t	pinDepthInc;
+	uint32_t	firstPinCenter;
+	uint32_t	pinSpacing;
+	uint32_t	pinDepth[SKeySpecU32::kMaxPinDepths];	// See SKeySpecU32
+};
+
+/*
+*	The keyways are kept sorted by tag.  mIndexOfTag maps each tag to its
+*	index so that Find doesn't need to search.  A keyway added with the tag
+*	of an existing keyway replaces it, which allows the file to correct a
+*	built in keyway.
+*/
+class KeywayTable
+{
+public:
+	enum
+	{
+		kMaxKeyways	= 32,
+		kMaxTag		= 255
+	};
+							KeywayTable(void);
+	void					Clear(void);
+	bool					Add(
+								const SKeySpecU32&		inKeySpec,
+								uint16_t				inTag,
+								bool					inFromFile = false);
+	/*
+	*	It's assumed SdFat.begin was successfully called prior to calling
+	*	ReadFile.  Returns true if the file was opened and valid.  Invalid
+	*	records are skipped.
+	*/
+	bool					ReadFile(
+								const char*				inPath);
+	const SKeySpecU32*		Find(
+								uint16_t				inTag) const
+								{return((inTag <= kMaxTag &&
+										mIndexOfTag[inTag] < mCount) ?
+											&mKeySpec[mIndexOfTag[inTag]] : nullptr);}
+	uint32_t				Count(void) const
+								{return(mCount);}
+	const SKeySpecU32&		KeySpec(
+								uint32_t				inIndex) const
+								{return(mKeySpec[inIndex]);}
+								// All Count() specs, in tag order
+	const SKeySpecU32*		KeySpecs(void) const
+								{return(mKeySpec);}
+	uint16_t				Tag(
+								uint32_t				inIndex) const
+								{return(mTag[inIndex]);}
+	bool					IsFromFile(
+								uint32_t				inIndex) const
+								{return((mFromFileMask & (1UL << inIndex)) != 0);}
+	static bool				RecordToKeySpec(
+								const SKeywayRecord&	inRecord,
+								SKeySpecU32&			outKeySpec);
+protected:
+	SKeySpecU32	mKeySpec[kMaxKeyways];
+	uint16_t	mTag[kMaxKeyways];
+	uint32_t	mFromFileMask;
+	uint8_t		mIndexOfTag[kMaxTag+1];	// 0xFF = no keyway
+	uint8_t		mCount;
+};
+
+#endif // KeywayTable_h
@@ -0,0 +1,91 @@
+/*
+*	LineFit.h, Copyright Jonathan Mackey 2025
+*	Least squares fit of a straight line.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef LineFit_h
+#define LineFit_h
+
+#include <inttypes.h>
+
+/*
+*	Accumulates integer points (x, y) and fits y = intercept + slope * x.
+*	The sums are 64 bit integers so the points can be added in a single pass
+*	without loss of precision (for x and y values < 65536 and fewer than
+*	16384 points.)  Floating point is only used to compute the results.
+*/
+class LineFit
+{
+public:
+							LineFit(void)
+								{Clear();}
+	void					Clear(void)
+								{mN = 0; mSumX = 0; mSumY = 0; mSumXX = 0; mSumXY = 0; mSumYY = 0;}
+	inline void				Add(
+								int32_t					inX,
+								int32_t					inY)
+							{
+								mN++;
+								mSumX += inX;
+								mSumY += inY;
+								mSumXX += (int64_t)inX * inX;
+								mSumXY += (int64_t)inX * inY;
+								mSumYY += (int64_t)inY * inY;
+							}
+	uint32_t				Count(void) const
+								{return(mN);}
+	bool					IsValid(void) const
+								{return(mN > 1 && Sxx() != 0);}
+	float					Slope(void) const
+								{return(IsValid() ? (float)Sxy() / (float)Sxx() : 0);}
+	float					Intercept(void) const
+								{return(mN ? ((float)mSumY - Slope() * (float)mSumX) / mN : 0);}
+	/*
+	*	Returns the mean of the squared residuals (y - fitted y.)
+	*/
+	float					MeanSquaredResidual(void) const
+							{
+								if (!IsValid())
+								{
+									return(0);
+								}
+								float	sxy = (float)Sxy();
+								float	rss = ((float)Syy() - (sxy * sxy) / (float)Sxx()) / mN;
+								return(rss > 0 ? rss / mN : 0);
+							}
+protected:
+	uint32_t	mN;
+	int64_t		mSumX;
+	int64_t		mSumY;
+	int64_t		mSumXX;
+	int64_t		mSumXY;
+	int64_t		mSumYY;
+	/*
+	*	These are N times the centered sums, which keeps them in integers.
+	*/
+	int64_t					Sxx(void) const
+								{return(mN * mSumXX - mSumX * mSumX);}
+	int64_t					Sxy(void) const
+								{return(mN * mSumXY - mSumX * mSumY);}
+	int64_t					Syy(void) const
+								{return(mN * mSumYY - mSumY * mSumY);}
+};
+
+#endif // LineFit_h
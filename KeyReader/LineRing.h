@@ -0,0 +1,210 @@
+/*
+*	LineRing.h, Copyright Jonathan Mackey 2025
+*	Lock-free single producer, single consumer ring of line buffers.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef LineRing_h
+#define LineRing_h
+
+#include <inttypes.h>
+#include <atomic>
+
+/*
+*	The producer (the DMA interrupt) fills the lines, the consumer (a lower
+*	priority interrupt or the main loop) processes them.  No lines are copied,
+*	the producer fills each slot in place.
+*
+*	The producer first Acquires a slot, then fills it, then Publishes it along
+*	with a tag that identifies the line.  More than one slot can be acquired
+*	before the first is published (the DMA in double buffer mode owns two
+*	slots), the slots are published in the order acquired.  When every slot
+*	is either acquired or waiting for the consumer, Acquire fails and the
+*	overrun is counted.  The producer then has nowhere to put the line and
+*	it's lost.  The consumer detects a lost line by a gap in the tags.
+*
+*	The consumer Peeks at the oldest published slot, and Releases it once
+*	it's done with it.
+*
+*	Only mPublished and mReleased are shared.  Each is written by one side
+*	only, with release ordering so that the slot (or its release) is visible
+*	before the index changes.  On the Cortex-M4 these are plain loads and
+*	stores with a DMB.  Nothing here depends on the HAL so that the ring can
+*	be driven by two threads on the host (see KeyScanReplay -b.)
+*
+*	kSlots must be a power of 2.
+*/
+template <uint32_t kSlots, uint32_t kSlotLen>
+class LineRing
+{
+public:
+	static_assert((kSlots & (kSlots - 1)) == 0, "kSlots must be a power of 2");
+							LineRing(void)
+								{Reset();}
+	/*
+	*	Only call Reset when neither the producer nor the consumer is active.
+	*/
+	void					Reset(void)
+							{
+								mAcquired = 0;
+								mOverruns = 0;
+								mPublished.store(0, std::memory_order_relaxed);
+								mReleased.store(0, std::memory_order_relaxed);
+							}
+	uint16_t*				Slot(
+								uint32_t				inSlot)
+								{return(mSlot[inSlot]);}
+	/*
+	*	Producer: Returns false, and counts the overrun, if no slot is free.
+	*/
+	bool					Acquire(
+								uint32_t&				outSlot)
+							{
+								bool	success = (mAcquired -
+									mReleased.load(std::memory_order_acquire)) < kSlots;
+								if (success)
+								{
+									outSlot = mAcquired & (kSlots - 1);
+									mAcquired++;
+								} else
+								{
+									mOverruns = mOverruns + 1;
+								}
+								return(success);
+							}
+	/*
+	*	Producer: Publishes the oldest acquired slot.
+	*/
+	void					Publish(
+								uint32_t				inTag)
+							{
+								uint32_t	published = mPublished.load(std::memory_order_relaxed);
+								mTag[published & (kSlots - 1)] = inTag;
+								mPublished.store(published + 1, std::memory_order_release);
+							}
+	/*
+	*	Consumer: Returns the oldest published slot, or nullptr if none.
+	*/
+	const uint16_t*			Peek(
+								uint32_t&				outTag)
+							{
+								uint32_t	released = mReleased.load(std::memory_order_relaxed);
+								const uint16_t*	slot = nullptr;
+								if (mPublished.load(std::memory_order_acquire) != released)
+								{
+									outTag = mTag[released & (kSlots - 1)];
+									slot = mSlot[released & (kSlots - 1)];
+								}
+								return(slot);
+							}
+	/*
+	*	Consumer: Releases the slot returned by Peek.
+	*/
+	void					Release(void)
+							{
+								mReleased.store(mReleased.load(std::memory_order_relaxed) + 1,
+												std::memory_order_release);
+							}
+								// Published slots not yet released
+	uint32_t				Pending(void) const
+								{return(mPublished.load(std::memory_order_acquire) -
+										mReleased.load(std::memory_order_acquire));}
+	uint32_t				Overruns(void) const
+								{return(mOverruns);}
+protected:
+	uint16_t	mSlot[kSlots][kSlotLen] __attribute__((aligned(4)));
+	uint32_t	mTag[kSlots];
+	uint32_t	mAcquired;					// Producer only
+	volatile uint32_t	mOverruns;			// Producer only
+	std::atomic<uint32_t>	mPublished;		// Written by the producer
+	std::atomic<uint32_t>	mReleased;		// Written by the consumer
+};
+
+/*
+*	LineFrameTracker follows the frames of the lines taken from the ring by
+*	the consumer, each tagged with (frame index << 16) | window line.  A gap
+*	in the window lines of a frame means lines were lost.  A frame is
+*	complete when its last line is scanned, when Handler::ScanLine ends it
+*	early, or when the first line of the next frame is seen.  In the last
+*	case the frame's last lines were lost, and they're reported before the
+*	frame is completed.  The lines of a completed frame aren't scanned.
+*
+*	Handler provides:
+*		static void LinesLost(uint32_t inFrameIndex, uint32_t inFirstLostLine)
+*		static bool ScanLine(const uint16_t* inLine, uint32_t inWindowLine,
+*								uint32_t inFrameIndex)	// true ends the frame
+*		static void FrameComplete(uint32_t inFrameIndex)
+*
+*	Like LineRing, nothing here depends on the HAL (see KeyScanReplay -b.)
+*/
+class LineFrameTracker
+{
+public:
+							LineFrameTracker(void)
+								{Reset();}
+	void					Reset(void)
+							{
+								mFrameIndex = 0;
+								mNextLine = 0;
+								mFrameDone = false;
+							}
+	template <class Handler>
+	void					Line(
+								const uint16_t*			inLine,
+								uint32_t				inTag,
+								uint32_t				inNumLines)
+							{
+								uint32_t	frameIndex = inTag >> 16;
+								uint32_t	windowLine = inTag & 0xFFFF;
+								if (frameIndex != mFrameIndex)
+								{
+									if (!mFrameDone)
+									{
+										if (mNextLine < inNumLines)
+										{
+											Handler::LinesLost(mFrameIndex, mNextLine);
+										}
+										Handler::FrameComplete(mFrameIndex);
+									}
+									mFrameIndex = frameIndex;
+									mNextLine = 0;
+									mFrameDone = false;
+								}
+								if (!mFrameDone)
+								{
+									if (windowLine != mNextLine)
+									{
+										Handler::LinesLost(frameIndex, mNextLine);
+									}
+									bool	endFrame = Handler::ScanLine(inLine, windowLine, frameIndex);
+									mNextLine = windowLine + 1;
+									if (mNextLine == inNumLines || endFrame)
+									{
+										Handler::FrameComplete(frameIndex);
+										mFrameDone = true;
+									}
+								}
+							}
+protected:
+	uint32_t	mFrameIndex;	// Frame of the line being scanned
+	uint32_t	mNextLine;		// Next window line expected
+	bool		mFrameDone;
+};
+
+#endif // LineRing_h
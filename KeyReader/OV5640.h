@@ -134,6 +134,19 @@ namespace OV5640
 #endif
 		0
 	};
+	/*
+	*	Hi res manual exposure and gain.
+	*/
+	const uint16_t	kHiResExposure[] =
+	{
+		0x3503, 0x07,	// Turn off AGC & AEC (i.e. go to manual mode)
+		//0x3500, 0x00,	// Exposure [19:16]
+		0x3501, 0x14,	// Exposure [15:8]	0x12	0x0E
+		0x3502, 0x00,	// Exposure [7:0]	 0x70
+		//0x350A, 0x00,	// Gain [9:8]
+		0x350B, 0x0A,	// Gain [7:0]	0x10
+		0
+	};
 	#include "OV5640_1080P.h"
 	
 	/*
@@ -0,0 +1,92 @@
+/*
+*	PreviewAlign.cpp, Copyright Jonathan Mackey 2025
+*	Scores the alignment of the key from the blade edges of a preview frame.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "PreviewAlign.h"
+
+/********************************** EndFrame **********************************/
+/*
+*	Scores the frame from the edges of the lines added since BeginFrame, and
+*	counts the stable frames.  Called from the preview DMA interrupt.
+*/
+void PreviewAlign::EndFrame(void)
+{
+	int32_t	score = 0;
+	int32_t	tilt = 0;
+	int32_t	backQ4 = 0;
+	int32_t	frontQ4 = 0;
+	if (mSampleLines &&
+		mLeftFit.IsValid())
+	{
+		bool	backEdgeIsLeft = mLeftFit.MeanSquaredResidual() <=
+									mRightFit.MeanSquaredResidual();
+		const LineFit&	backFit = backEdgeIsLeft ? mLeftFit : mRightFit;
+		const LineFit&	frontFit = backEdgeIsLeft ? mRightFit : mLeftFit;
+		tilt = (int32_t)(backFit.Slope() * 1000);
+		score = (int32_t)((mLeftFit.Count() * 100) / mSampleLines) -
+					(tilt < 0 ? -tilt : tilt) * kTiltPenalty;
+		if (score < 0)
+		{
+			score = 0;
+		}
+		backQ4 = (int32_t)((backFit.Intercept() + backFit.Slope() * kMidLine) * 16);
+		frontQ4 = (int32_t)((frontFit.Intercept() + frontFit.Slope() * kMidLine) * 16);
+	}
+	/*
+	*	If aligned and motionless since the last frame THEN
+	*	count another stable frame.
+	*/
+	if (score >= kMinAlignedScore)
+	{
+		mStableFrames = (Within(backQ4, mBackQ4, kMaxMotion) &&
+							Within(frontQ4, mFrontQ4, kMaxMotion) &&
+							Within(tilt, mTilt, kMaxTiltMotion)) ?
+								mStableFrames + 1 : 1;
+	} else
+	{
+		mStableFrames = 0;
+	}
+	mBackQ4 = backQ4;
+	mFrontQ4 = frontQ4;
+	mScore = score;
+	mTilt = tilt;
+	mFramesScored = mFramesScored + 1;
+	BeginFrame();
+}
+
+/******************************** GetAlignment ********************************/
+/*
+*	EndFrame can interrupt the main loop between the reads of the results.
+*	mFramesScored changes with every frame scored, so if it's the same
+*	before and after the results are read, they're all from the same frame.
+*	Otherwise they're read again.
+*/
+void PreviewAlign::GetAlignment(
+	SAlignment&	outAlignment) const
+{
+	do
+	{
+		outAlignment.framesScored = mFramesScored;
+		outAlignment.score = mScore;
+		outAlignment.tilt = mTilt;
+		outAlignment.stableFrames = mStableFrames;
+	} while (outAlignment.framesScored != mFramesScored);
+}
@@ -0,0 +1,153 @@
+/*
+*	PreviewAlign.h, Copyright Jonathan Mackey 2025
+*	Scores the alignment of the key from the blade edges of a preview frame.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef PreviewAlign_h
+#define PreviewAlign_h
+
+#include <inttypes.h>
+#include "LineFit.h"
+
+/*
+*	Every kLineStep'th preview line between kFirstLine and kEndLine (the
+*	blade, away from the bow and tip) is scanned for the blade edges, as a
+*	hi-res line is scanned but at the preview resolution.  At the end of the
+*	frame a line is fit to each edge, as done by XKeyView::UpdateSkew.  The
+*	straighter edge is the back of the blade, its slope is the tilt.
+*
+*	Both preview axes are scaled down from the sensor by about 8, so the tilt
+*	in preview pixels per 1000 lines is about the same as the hi-res skew.
+*
+*	The score (0 to 100) is the percentage of the sampled lines that have a
+*	blade, less kTiltPenalty points per pixel/1000 lines of tilt.  A score
+*	below kMinAlignedScore is a clearly misaligned (or missing) key, a hi-res
+*	scan of it would fail.
+*
+*	The frame's signature is the position of each edge at the middle sample
+*	line, and the tilt.  When the signature of an aligned frame is within
+*	kMaxMotion of the previous frame's, the key is motionless and the count
+*	of stable frames is incremented, otherwise the count restarts.  The
+*	count is used to start a scan without a touch (see
+*	KeyReaderSTM32::UpdateAutoScan.)
+*
+*	AddLine and EndFrame are called from the preview DMA interrupt, the
+*	results are read by the main loop (see GetAlignment.)  No HAL
+*	dependencies so that the scoring can be run on the host (see
+*	KeyScanReplay -e.)
+*/
+class PreviewAlign
+{
+public:
+	enum
+	{
+		kLineStep			= 4,
+		kFirstLine			= 60,
+		kEndLine			= 180,
+		kMinWidth			= 10,	// Preview pixels
+		kMaxWidth			= 80,
+		kTiltPenalty		= 1,	// Score points per pixel/1000 lines
+		kMinAlignedScore	= 60,
+		kMidLine			= (kFirstLine + kEndLine)/2,
+		kMaxMotion			= 16,	// Q4 preview pixels (1 pixel)
+		kMaxTiltMotion		= 5		// Pixels per 1000 lines
+	};
+							PreviewAlign(void)
+								: mScore(0), mTilt(0), mFramesScored(0),
+								  mStableFrames(0), mBackQ4(0), mFrontQ4(0)
+								{BeginFrame();}
+	void					Reset(void)
+								{
+									mScore = 0;
+									mTilt = 0;
+									mFramesScored = 0;
+									mStableFrames = 0;
+									mBackQ4 = 0;
+									mFrontQ4 = 0;
+									BeginFrame();
+								}
+	void					BeginFrame(void)
+								{
+									mLeftFit.Clear();
+									mRightFit.Clear();
+									mSampleLines = 0;
+								}
+	static bool				IsSampleLine(
+								uint32_t				inLine)
+								{return(inLine >= kFirstLine && inLine < kEndLine &&
+										((inLine - kFirstLine) % kLineStep) == 0);}
+	/*
+	*	inLeft and inRight are the edges found by the scanner, 0 if not found.
+	*/
+	void					AddLine(
+								uint32_t				inLine,
+								uint32_t				inLeft,
+								uint32_t				inRight)
+								{
+									mSampleLines++;
+									if (inRight > inLeft &&
+										(inRight - inLeft) >= kMinWidth &&
+										(inRight - inLeft) <= kMaxWidth)
+									{
+										mLeftFit.Add(inLine, inLeft);
+										mRightFit.Add(inLine, inRight);
+									}
+								}
+	void					EndFrame(void);
+	/*
+	*	The results of the last frame scored.  EndFrame runs in the preview
+	*	DMA interrupt, so the results are read together as a snapshot (see
+	*	GetAlignment) rather than one at a time, so that one frame's score
+	*	is never paired with another frame's tilt.
+	*/
+	struct SAlignment
+	{
+		uint32_t	score;
+		int32_t		tilt;			// Pixels per 1000 lines
+		uint32_t	stableFrames;	// Consecutive aligned frames without motion
+		uint32_t	framesScored;
+		bool		IsAligned(void) const
+						{return(score >= kMinAlignedScore);}
+	};
+	void					GetAlignment(
+								SAlignment&				outAlignment) const;
+								// Changes at the end of each frame
+	uint32_t				FramesScored(void) const
+								{return(mFramesScored);}
+protected:
+	LineFit				mLeftFit;
+	LineFit				mRightFit;
+	uint32_t			mSampleLines;
+	volatile uint32_t	mScore;
+	volatile int32_t	mTilt;
+	volatile uint32_t	mFramesScored;
+	volatile uint32_t	mStableFrames;
+	int32_t				mBackQ4;	// Edges at kMidLine of the last frame
+	int32_t				mFrontQ4;
+
+	static bool				Within(
+								int32_t					inValue,
+								int32_t					inLastValue,
+								int32_t					inTolerance)
+								{return(inValue >= inLastValue - inTolerance &&
+										inValue <= inLastValue + inTolerance);}
+};
+
+#endif // PreviewAlign_h
@@ -0,0 +1,160 @@
+/*
+*	PreviewLine.h, Copyright Jonathan Mackey 2025
+*	Copies a preview line to the display in one of the preview formats.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef PreviewLine_h
+#define PreviewLine_h
+
+#include <inttypes.h>
+
+/*
+*	The preview line is either RGB565 (copied as is), or YUYV where the low
+*	byte of each pixel is the luminance.  In B&W the luminance is thresholded
+*	to black or white.  In grayscale the luminance indexes a 256 entry table
+*	of RGB565 grays (GrayLUT.)  Each pixel written to outDisplay is sent to
+*	the display, outDisplay isn't incremented.
+*
+*	No HAL dependencies so that the cost of each format can be compared on
+*	the host (see KeyScanReplay -g.)
+*/
+namespace PreviewLine
+{
+	inline void CopyRGB565(
+		const uint16_t*		inLine,
+		uint32_t			inLineLen,
+		volatile uint16_t*	outDisplay)
+	{
+		for (uint32_t i = 0; i < inLineLen; i++)
+		{
+			*outDisplay = inLine[i];
+		}
+	}
+
+	inline void CopyBW(
+		const uint16_t*		inLine,
+		uint32_t			inLineLen,
+		uint32_t			inThreshold,
+		volatile uint16_t*	outDisplay)
+	{
+		for (uint32_t i = 0; i < inLineLen; i++)
+		{
+			*outDisplay = (inLine[i] & 0xFF) < inThreshold ? 0:0xFFFF;
+		}
+	}
+
+	inline void CopyGray(
+		const uint16_t*		inLine,
+		uint32_t			inLineLen,
+		const uint16_t*		inLUT,
+		volatile uint16_t*	outDisplay)
+	{
+		for (uint32_t i = 0; i < inLineLen; i++)
+		{
+			*outDisplay = inLUT[inLine[i] & 0xFF];
+		}
+	}
+}
+
+/*
+*	Luminance to RGB565 gray.  With a contrast stretch, luminance inLow and
+*	below is black, inHigh and above is white, and the levels between are
+*	spread over the full gray range.
+*
+*	The stretch limits can be taken from a luminance histogram (see
+*	StretchFromHistogram.)  inBins bins, each 256/inBins levels wide.  The
+*	limits are the levels below which, and above which, 1/64 of the samples
+*	fall, so a few specular or dead pixels don't cancel the stretch.
+*/
+class GrayLUT
+{
+public:
+	enum
+	{
+		kMinStretchRange	= 32	// Less is noise, not contrast
+	};
+							GrayLUT(void)
+								{Build(0, 255);}
+	void					Build(
+								uint32_t				inLow,
+								uint32_t				inHigh)
+							{
+								if (inHigh < inLow + kMinStretchRange)
+								{
+									inLow = 0;
+									inHigh = 255;
+								}
+								mLow = inLow;
+								mHigh = inHigh;
+								uint32_t	range = inHigh - inLow;
+								for (uint32_t y = 0; y < 256; y++)
+								{
+									uint32_t	gray = y <= inLow ? 0 :
+										(y >= inHigh ? 255 : ((y - inLow) * 255 + range/2) / range);
+									mLUT[y] = (uint16_t)(((gray >> 3) << 11) |
+															((gray >> 2) << 5) | (gray >> 3));
+								}
+							}
+	void					StretchFromHistogram(
+								const uint32_t*			inHistogram,
+								uint32_t				inBins)
+							{
+								uint32_t	total = 0;
+								for (uint32_t bin = 0; bin < inBins; bin++)
+								{
+									total += inHistogram[bin];
+								}
+								uint32_t	tail = total / 64;
+								uint32_t	binWidth = 256 / inBins;
+								uint32_t	low = 0;
+								uint32_t	count = 0;
+								for (; low < inBins - 1; low++)
+								{
+									count += inHistogram[low];
+									if (count > tail)
+									{
+										break;
+									}
+								}
+								uint32_t	high = inBins - 1;
+								count = 0;
+								for (; high > low; high--)
+								{
+									count += inHistogram[high];
+									if (count > tail)
+									{
+										break;
+									}
+								}
+								Build(low * binWidth, (high + 1) * binWidth - 1);
+							}
+	const uint16_t*			LUT(void) const
+								{return(mLUT);}
+	uint32_t				Low(void) const
+								{return(mLow);}
+	uint32_t				High(void) const
+								{return(mHigh);}
+protected:
+	uint16_t	mLUT[256];
+	uint16_t	mLow;
+	uint16_t	mHigh;
+};
+
+#endif // PreviewLine_h
@@ -0,0 +1,249 @@
+/*
+*	RegWriter.h, Copyright Jonathan Mackey 2025
+*	Burst writes of 16 bit addressed camera registers with a shadow cache.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef RegWriter_h
+#define RegWriter_h
+
+#include <inttypes.h>
+#include <string.h>
+
+/*
+*	The register arrays (OV5640::kCommonInit, kHiResInit, ...) are address,
+*	value pairs terminated by a 0 address.  Many of the entries are runs of
+*	consecutive addresses.  The camera auto-increments the register address
+*	of a multi-byte write (as used to load its autofocus firmware), so each
+*	run is sent as a single transaction: the 2 address bytes followed by up to
+*	kMaxBurstLen values.  Setting the max burst length to 1 gives the original
+*	one transaction per register.
+*
+*	The shadow cache holds the value last written to each register since the
+*	last software reset.  A write of the value already held is skipped.  The
+*	cache is only updated once the camera has acknowledged the write, a
+*	failed write clears the entries of its registers so that they're written
+*	again.  Only
+*	the leading and trailing unchanged registers of a run are skipped, an
+*	unchanged register within a run costs less than splitting the run.  The
+*	cache is a direct mapped table of kShadowSize entries, a register whose
+*	entry is held by another register is simply written.
+*
+*	Some registers can't be cached or merged into a run:
+*	-	0x3008 system control (software reset, power down).  A reset
+*		invalidates the cache.
+*	-	0x3212 group access and 0x3F00 capture are commands.
+*	-	0x3400-0x3406 (AWB gains) and 0x3500-0x350D (exposure, gain) are
+*		updated by the camera itself when in auto mode, so the cache can't
+*		be trusted.
+*
+*	TWire is TwoWire on the board.  On the host a stand-in that counts the
+*	transactions and models the registers is used (see KeyScanReplay -p.)
+*/
+template <class TWire>
+class RegWriter
+{
+public:
+	enum
+	{
+		kMaxBurstLen	= 30,	// Values, the Wire tx buffer is 32 bytes
+		kShadowSize		= 512	// Power of 2
+	};
+							RegWriter(
+								TWire&					inWire,
+								uint8_t					inDeviceAddr)
+								: mWire(inWire), mDeviceAddr(inDeviceAddr),
+								  mMaxBurstLen(kMaxBurstLen), mShadowEnabled(true)
+								{
+									InvalidateShadow();
+									ResetStats();
+								}
+	void					InvalidateShadow(void)
+								{memset(mShadow, 0, sizeof(mShadow));}
+	void					SetMaxBurstLen(
+								uint32_t				inMaxBurstLen)
+								{mMaxBurstLen = inMaxBurstLen == 0 ? 1 :
+									(inMaxBurstLen > kMaxBurstLen ? kMaxBurstLen : inMaxBurstLen);}
+	void					SetShadowEnabled(
+								bool					inShadowEnabled)
+								{
+									mShadowEnabled = inShadowEnabled;
+									InvalidateShadow();
+								}
+	void					WriteReg(
+								uint16_t				inAddress,
+								uint8_t					inValue)
+								{
+									if (!IsCached(inAddress, inValue))
+									{
+										uint8_t	value = inValue;
+										Write(inAddress, &value, 1);
+									} else
+									{
+										mSkipped++;
+									}
+								}
+	/*
+	*	Writes the registers of inRegArray, up to inMaxRegs registers
+	*	(0 = no limit.)  Returns the position in inRegArray following the last
+	*	register written (the terminating 0 when done.)
+	*/
+	const uint16_t*			WriteRegArray(
+								const uint16_t*			inRegArray,
+								uint32_t				inMaxRegs = 0)
+							{
+								uint8_t	values[kMaxBurstLen];
+								uint32_t	regsLeft = inMaxRegs ? inMaxRegs : 0xFFFFFFFF;
+								while (inRegArray[0] && regsLeft)
+								{
+									/*
+									*	Find the run of consecutive addresses.
+									*/
+									uint16_t	address = inRegArray[0];
+									uint32_t	runLen = 1;
+									if (!IsCommand(address))
+									{
+										for (; runLen < mMaxBurstLen && runLen < regsLeft &&
+												inRegArray[runLen*2] == (uint16_t)(address + runLen) &&
+												!IsCommand(inRegArray[runLen*2]); runLen++){}
+									}
+									/*
+									*	Trim the unchanged registers from both ends.
+									*/
+									uint32_t	first = 0;
+									uint32_t	end = 0;
+									for (uint32_t i = 0; i < runLen; i++)
+									{
+										values[i] = (uint8_t)inRegArray[i*2 + 1];
+										if (!IsCached(address + i, values[i]))
+										{
+											if (end == 0)
+											{
+												first = i;
+											}
+											end = i + 1;
+										}
+									}
+									if (end)
+									{
+										Write(address + first, &values[first], end - first);
+									}
+									mSkipped += runLen - (end - first);
+									inRegArray += runLen*2;
+									regsLeft -= runLen;
+								}
+								return(inRegArray);
+							}
+	/*
+	*	Statistics since the last ResetStats.  Bytes include the device
+	*	address byte of each transaction.
+	*/
+	void					ResetStats(void)
+								{mTransactions = 0; mBytes = 0; mSkipped = 0; mFailures = 0;}
+	uint32_t				Transactions(void) const
+								{return(mTransactions);}
+	uint32_t				Bytes(void) const
+								{return(mBytes);}
+	uint32_t				Skipped(void) const
+								{return(mSkipped);}
+	uint32_t				Failures(void) const
+								{return(mFailures);}
+protected:
+	TWire&		mWire;
+	uint8_t		mDeviceAddr;
+	uint8_t		mMaxBurstLen;
+	bool		mShadowEnabled;
+	uint32_t	mTransactions;
+	uint32_t	mBytes;
+	uint32_t	mSkipped;
+	uint32_t	mFailures;	// Transactions not acknowledged
+	/*
+	*	Each entry is the address in the high 16 bits, the value in the low 8,
+	*	0 = empty (0 isn't a register address.)
+	*/
+	uint32_t	mShadow[kShadowSize];
+
+	static bool				IsCommand(
+								uint16_t				inAddress)
+								{return(inAddress == 0x3008 ||
+										inAddress == 0x3212 ||
+										inAddress == 0x3F00);}
+	static bool				IsVolatile(
+								uint16_t				inAddress)
+								{return(IsCommand(inAddress) ||
+										(inAddress >= 0x3400 && inAddress <= 0x3406) ||
+										(inAddress >= 0x3500 && inAddress <= 0x350D));}
+	/*
+	*	Returns true if inAddress already holds inValue.
+	*/
+	bool					IsCached(
+								uint16_t				inAddress,
+								uint8_t					inValue) const
+							{
+								return(mShadowEnabled &&
+										!IsVolatile(inAddress) &&
+										mShadow[inAddress & (kShadowSize - 1)] ==
+											(((uint32_t)inAddress << 16) | inValue));
+							}
+	/*
+	*	Writes inNumValues registers starting at inAddress as one transaction.
+	*	When acknowledged, the cache entries of the registers are updated to
+	*	the values written.  Otherwise the camera may hold the old value, the
+	*	new value, or neither, so the entries are cleared.  A software reset
+	*	(0x3008 bit 7), acknowledged or not, invalidates the cache.
+	*/
+	void					Write(
+								uint16_t				inAddress,
+								const uint8_t*			inValues,
+								uint32_t				inNumValues)
+							{
+								mWire.beginTransmission(mDeviceAddr);
+								mWire.write((uint8_t)(inAddress >> 8));
+								mWire.write((uint8_t)inAddress);
+								for (uint32_t i = 0; i < inNumValues; i++)
+								{
+									mWire.write(inValues[i]);
+								}
+								bool	acknowledged = mWire.endTransmission(true) == 0;
+								mTransactions++;
+								mBytes += 3 + inNumValues;
+								if (!acknowledged)
+								{
+									mFailures++;
+								}
+								if (inAddress == 0x3008 &&
+									(inValues[0] & 0x80))	// Software reset
+								{
+									InvalidateShadow();
+								} else if (mShadowEnabled)
+								{
+									for (uint32_t i = 0; i < inNumValues; i++)
+									{
+										uint16_t	address = inAddress + i;
+										if (!IsVolatile(address))
+										{
+											mShadow[address & (kShadowSize - 1)] = acknowledged ?
+												(((uint32_t)address << 16) | inValues[i]) : 0;
+										}
+									}
+								}
+							}
+};
+
+#endif // RegWriter_h
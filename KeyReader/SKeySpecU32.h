@@ -26,6 +26,11 @@
 
 struct SKeySpecU32
 {
+	enum
+	{
+		kMaxPins		= 8,
+		kMaxPinDepths	= 10	// Cut indexes are single digits
+	};
 	char		name[20];
 	uint32_t	numPins;
 	uint32_t	numPinDepths;
@@ -35,8 +40,18 @@ struct SKeySpecU32
 	uint32_t	pinDepthInc;
 	uint32_t	firstPinCenter;
 	uint32_t	pinSpacing;
+	/*
+	*	Optional root depths from the deepest cut to the shallowest, for
+	*	keyways whose depths aren't evenly spaced.  When pinDepth[0] is 0 the
+	*	depths are deepestCut + (i * pinDepthInc).
+	*/
+	uint32_t	pinDepth[kMaxPinDepths];
 	
 	int32_t					CutIndexInc(void) const
 								{return(deepestCutIndex > 1 ? -1 : 1);}
+	uint32_t				PinDepth(
+								uint32_t				inIndex) const
+								{return(pinDepth[0] ? pinDepth[inIndex] :
+										deepestCut + (inIndex * pinDepthInc));}
 };
 #endif // SKeySpecU32_h
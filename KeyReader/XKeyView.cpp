@@ -23,14 +23,21 @@
 #include "XRootView.h"
 #include "XKeyView.h"
 #include "XFont.h"
+#include "LineFit.h"
+#include "HiResWindow.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
 #ifdef __MACH__
 namespace OV5640
 {
 	const uint32_t	kHRXOutputSize	= 1000;
 	const uint32_t	kHRYOutputSize	= 1918;
-	
+	const uint32_t	kXOutputSize	= 124;
+	const uint32_t	kYOutputSize	= 240;
+
 };
 #include "DisplayController.h"
 #else
@@ -51,9 +58,14 @@ XKeyView::XKeyView(
 	XView*			inNextView,
 	XFont::Font*	inFont)
 	: XView(inX, inY, inWidth, inHeight, inTag, inNextView, nullptr),
-	  mPinCentersValid(false), mTolerance(5), mKeySpec(nullptr),
-	  mFont(inFont), mCentersScale(6405), mDepthsScale(6633), mKeyData(nullptr),
-	  mInPreviewMode(false), mStatusMessage(nullptr), mShowPinRootDelta(false)
+	  mFont(inFont), mStatusMessage(nullptr), mKeySpec(nullptr),
+	  mKeyData(nullptr), mKeyDataQ8(nullptr), mEdgeLeft(nullptr),
+	  mEdgeRight(nullptr), mSkewSlopeQ16(0), mAlignScore(0), mAlignTilt(0),
+	  mCentersScale(6405), mDepthsScale(6633), mNumAltCodes(0),
+	  mSelectedCode(0), mTolerance(5), mStreamState(eStreamIdle),
+	  mStreamLines(0), mPinCentersValid(false), mInPreviewMode(false),
+	  mShowPinRootDelta(false), mSkewValid(false), mBackEdgeIsLeft(false),
+	  mIsAligned(false), mShowAlignment(false)
 {
 	/*
 	*	The mCentersScale is the vertical scale, and mDepthsScale is the
@@ -70,7 +82,8 @@ XKeyView::XKeyView(
 	*	improve the accuracy of the mDepthsScale.
 	*
 	*	I assume that whenever the camera or the camera focus is changed, these
-	*	values may need to be adjusted.
+	*	values may need to be adjusted.  Both can be solved for from a scan of a
+	*	key of known code, see Calibrate (serial command K.)
 	*/
 
 }
@@ -87,8 +100,14 @@ XFont* XKeyView::MakeFontCurrent(void)
 }
 
 const uint32_t	kDisplayScale = 3;
+const uint8_t	kLowConfidence = 50;
 const uint32_t	kDisplayDataOffset = 375;
 const int16_t	kInset = 2;
+// Origin of the preview image within the view.
+const int16_t	kPreviewLeft = 100;
+const int16_t	kPreviewTop = 2;
+// Width of the alignment score strip left of the preview image.
+const uint16_t	kAlignmentWidth = 98;
 /********************************** DrawSelf **********************************/
 void XKeyView::DrawSelf(void)
 {
@@ -97,40 +116,49 @@ void XKeyView::DrawSelf(void)
 		 mFont)
 	{
 		XFont*	xFont = MakeFontCurrent();
-		display->FillRect(mX, mY, mWidth, mHeight, XFont::eWhite);
+		bool	drawKeyData = mKeyData && !mInPreviewMode;
+		if (drawKeyData)
+		{
+			DrawProfile(display);
+		} else if (mInPreviewMode)
+		{
+			DrawPreviewFrame(display);
+		} else
+		{
+			display->FillRect(mX, mY, mWidth, mHeight, XFont::eWhite);
+		}
 		xFont->SetTextColor(XFont::eBlack);
 		xFont->SetBGTextColor(XFont::eWhite);
 	#if 1
-		if (mKeyData &&
-			!mInPreviewMode)
+		if (drawKeyData)
 		{
-			uint32_t	k = kDisplayDataOffset;
 			int16_t		x = mX+kInset;
 			int16_t		y = mY+kInset;
-			uint16_t	insetH = mHeight - (kInset*2);
 			uint16_t	insetW = mWidth - (kInset*2);
-			for (uint32_t i = 0; i < insetW; i++)
-			{
-				uint32_t	lineHeight = (mKeyData[k]/kDisplayScale) - 75;
-				if (lineHeight < insetH)
-				{
-					display->FillRect(insetW-i+x, y-lineHeight+insetH, 1, lineHeight, XFont::eBlack);
-				}
-				k += (kDisplayScale);
-			}
 			if (mPinCentersValid)
 			{
 				char pinStr[12];
 				for (uint32_t k = 0; k < mKeySpec->numPins; k++)
 				{
 					uint32_t	pinCenter = (mPinCenter[k]-kDisplayDataOffset)/kDisplayScale;
-					display->FillRect(insetW-pinCenter+x, y+20, 1, insetH-20, XFont::eRed);
-					display->MoveToRow(y+5);
+					/*
+					*	DrawCentered doesn't move to the column when txLeft
+					*	is off the left edge, so the column is set just
+					*	right of the pin line.
+					*/
+					display->MoveTo(y+5, insetW-pinCenter+x+1);
 					uint16_t	txLeft = insetW-pinCenter+x-25;
 					pinStr[1] = 0;
-					if (mPinRootIndex[k] < 10)
+					uint8_t	pinRootIndex = SelectedPinIndex(k);
+					/*
+					*	Pins that don't match the decoded code, or have a low
+					*	confidence, are drawn in red.
+					*/
+					xFont->SetTextColor((pinRootIndex != mPinRootIndex[k] ||
+						mPinConfidence[k] < kLowConfidence) ? XFont::eRed : XFont::eBlack);
+					if (pinRootIndex < 10)
 					{
-						pinStr[0] = mPinRootIndex[k] + '0';
+						pinStr[0] = pinRootIndex + '0';
 						/*
 						*	For debugging...
 						*	If showing the pin error deltas
@@ -145,6 +173,18 @@ void XKeyView::DrawSelf(void)
 					}
 					xFont->DrawCentered(pinStr, txLeft, txLeft+50);
 				}
+				xFont->SetTextColor(XFont::eBlack);
+				/*
+				*	If an alternate code is selected THEN
+				*	show its rank, e.g. 2/4 is the first alternate, right of
+				*	the tip.
+				*/
+				if (mSelectedCode)
+				{
+					snprintf(pinStr, 12, "%u/%u", (uint32_t)mSelectedCode + 1, NumCodes());
+					display->MoveTo(y+5, x+insetW-45);
+					xFont->DrawStr(pinStr);
+				}
 			} else if (mStatusMessage && mStatusMessage[0])
 			{
 				display->MoveTo(mY+kInset+5, mX+kInset);
@@ -153,7 +193,7 @@ void XKeyView::DrawSelf(void)
 		#if 0
 			{
 				uint32_t	position = (1750-kDisplayDataOffset)/kDisplayScale;
-				display->FillRect(insetW-position+x, y, 1, insetH, XFont::eGreen);
+				display->FillRect(insetW-position+x, y, 1, mHeight - (kInset*2), XFont::eGreen);
 			}
 		#endif
 		/*
@@ -171,17 +211,122 @@ void XKeyView::DrawSelf(void)
 	}
 }
 
+/******************************** DrawProfile *********************************/
+/*
+*	Draws the background, the key profile (a black column from the bottom of
+*	the inset per displayed sample) and the red pin center lines in a single
+*	pass.  The window is set once to the view's bounds and the rows are
+*	written top to bottom as runs of the same color, rather than clearing the
+*	view then setting a window for each column and pin line.  Runs continue
+*	from the end of one row to the start of the next.
+*/
+void XKeyView::DrawProfile(
+	DisplayController*	inDisplay)
+{
+	uint16_t	insetH = mHeight - (kInset*2);
+	uint16_t	insetW = mWidth - (kInset*2);
+	uint16_t	bottom = kInset + insetH;	// Rows at and below are margin
+	/*
+	*	For each column (local to the view), the first black row and the first
+	*	red row, mHeight when none.
+	*/
+	uint16_t	blackTop[mWidth];
+	uint16_t	redTop[mWidth];
+	for (uint16_t column = 0; column < mWidth; column++)
+	{
+		blackTop[column] = mHeight;
+		redTop[column] = mHeight;
+	}
+	uint32_t	k = kDisplayDataOffset;
+	for (uint32_t i = 0; i < insetW; i++)
+	{
+		uint32_t	lineHeight = (mKeyData[k]/kDisplayScale) - 75;
+		if (lineHeight < insetH)
+		{
+			blackTop[insetW-i+kInset] = bottom - lineHeight;
+		}
+		k += (kDisplayScale);
+	}
+	if (mPinCentersValid)
+	{
+		for (uint32_t k = 0; k < mKeySpec->numPins; k++)
+		{
+			int32_t	column = (int32_t)insetW + kInset -
+								(int32_t)((mPinCenter[k]-kDisplayDataOffset)/kDisplayScale);
+			if (column >= 0 && column < mWidth)
+			{
+				redTop[column] = kInset+20;
+			}
+		}
+	}
+	inDisplay->MoveTo(mY, mX);
+	inDisplay->SetColumnRange(mWidth);
+	uint16_t	runColor = XFont::eWhite;
+	uint32_t	runLength = 0;
+	for (uint16_t row = 0; row < mHeight; row++)
+	{
+		/*
+		*	The margin rows are white, a single run.
+		*/
+		if (row >= bottom || row < kInset)
+		{
+			if (runColor != XFont::eWhite)
+			{
+				inDisplay->FillPixels(runLength, runColor);
+				runColor = XFont::eWhite;
+				runLength = 0;
+			}
+			runLength += mWidth;
+			continue;
+		}
+		for (uint16_t column = 0; column < mWidth; column++)
+		{
+			uint16_t	color = row >= redTop[column] ? XFont::eRed :
+									(row >= blackTop[column] ? XFont::eBlack : XFont::eWhite);
+			if (color != runColor)
+			{
+				inDisplay->FillPixels(runLength, runColor);
+				runColor = color;
+				runLength = 0;
+			}
+			runLength++;
+		}
+	}
+	inDisplay->FillPixels(runLength, runColor);
+}
+
 /********************************* SetKeyData *********************************/
 void XKeyView::SetKeyData(
 	const uint16_t*		inKeyData,
 	bool				inUpdate)
 {
-	mKeyData = inKeyData;
-	UpdatePinDepths();
-	UpdatePinCenters();
+	/*
+	*	If StreamKeyData's search of inKeyData hadn't finished when the last
+	*	line was received THEN
+	*	finish it rather than starting over.
+	*/
+	if (mStreamState == eStreamDetecting &&
+		inKeyData == mKeyData)
+	{
+		StepStream(0);
+	}
+	/*
+	*	If inKeyData was already decoded by StreamKeyData while the frame was
+	*	being received THEN
+	*	only the drawing remains.
+	*/
+	if (mStreamState != eStreamDecoded ||
+		inKeyData != mKeyData)
+	{
+		mKeyData = inKeyData;
+		UpdatePinDepths();
+		UpdateSkew();
+		UpdatePinCenters();
+	}
+	mStreamState = eStreamIdle;
 	if (inUpdate)
 	{
-		DrawSelf();
+		Invalidate();
 /*
 	DisplayController*	display = XRootView::GetInstance()->GetDisplay();
 	if (display &&
@@ -206,7 +351,7 @@ void XKeyView::SetKeySpec(
 		{
 			UpdatePinDepths();
 			UpdatePinCenters();
-			DrawSelf();
+			Invalidate();
 		}
 	}
 }
@@ -216,7 +361,82 @@ void XKeyView::UpdateStatusMessage(
 	const char*	inStatusMessage)
 {
 	mStatusMessage = inStatusMessage;
-	DrawSelf();
+	Invalidate();
+}
+
+/******************************** SetAlignment ********************************/
+void XKeyView::SetAlignment(
+	uint32_t	inScore,
+	int32_t		inTilt,
+	bool		inIsAligned,
+	bool		inUpdate)
+{
+	mAlignScore = inScore;
+	mAlignTilt = inTilt;
+	mIsAligned = inIsAligned;
+	mShowAlignment = true;
+	if (inUpdate)
+	{
+		Invalidate(0, 0, kAlignmentWidth, mHeight);
+	}
+}
+
+/****************************** DrawPreviewFrame ******************************/
+/*
+*	Paints the area around the preview image, including the alignment strip.
+*	The image itself is written by the camera stream, so it isn't erased.
+*/
+void XKeyView::DrawPreviewFrame(
+	DisplayController*	inDisplay)
+{
+	const int16_t	kPreviewRight = kPreviewLeft + OV5640::kYOutputSize;
+	const int16_t	kPreviewBottom = kPreviewTop + OV5640::kXOutputSize;
+	if (mShowAlignment)
+	{
+		DrawAlignment();
+		inDisplay->FillRect(mX+kAlignmentWidth, mY,
+							kPreviewLeft-kAlignmentWidth, mHeight, XFont::eWhite);
+	} else
+	{
+		inDisplay->FillRect(mX, mY, kPreviewLeft, mHeight, XFont::eWhite);
+	}
+	inDisplay->FillRect(mX+kPreviewLeft, mY,
+						kPreviewRight-kPreviewLeft, kPreviewTop, XFont::eWhite);
+	inDisplay->FillRect(mX+kPreviewLeft, mY+kPreviewBottom,
+						kPreviewRight-kPreviewLeft, mHeight-kPreviewBottom, XFont::eWhite);
+	inDisplay->FillRect(mX+kPreviewRight, mY,
+						mWidth-kPreviewRight, mHeight, XFont::eWhite);
+}
+
+/******************************* DrawAlignment ********************************/
+/*
+*	Draws the alignment score and tilt to the left of the preview image.  A
+*	misaligned key is drawn in red with a prompt to realign it.
+*/
+void XKeyView::DrawAlignment(void)
+{
+	DisplayController*	display = XRootView::GetInstance()->GetDisplay();
+	if (display &&
+		 mFont)
+	{
+		XFont*	xFont = MakeFontCurrent();
+		char	alignStr[20];
+		display->FillRect(mX, mY, kAlignmentWidth, mHeight, XFont::eWhite);
+		xFont->SetTextColor(mIsAligned ? XFont::eBlack : XFont::eRed);
+		xFont->SetBGTextColor(XFont::eWhite);
+		snprintf(alignStr, sizeof(alignStr), "Align %u", mAlignScore);
+		display->MoveTo(mY+kInset+10, mX+kInset);
+		xFont->DrawStr(alignStr);
+		snprintf(alignStr, sizeof(alignStr), "Tilt %d", mAlignTilt);
+		display->MoveTo(mY+kInset+40, mX+kInset);
+		xFont->DrawStr(alignStr);
+		if (!mIsAligned)
+		{
+			display->MoveTo(mY+kInset+70, mX+kInset);
+			xFont->DrawStr("Realign");
+		}
+		xFont->SetTextColor(XFont::eBlack);
+	}
 }
 
 /****************************** EnterPreviewMode ******************************/
@@ -224,6 +444,7 @@ void XKeyView::EnterPreviewMode(
 	bool	inEraseView)
 {
 	mStatusMessage = nullptr;
+	mShowAlignment = false;
 #ifndef __MACH__
 	TFT_ILI9488P*	display = (TFT_ILI9488P*)XRootView::GetInstance()->GetDisplay();
 	if (display)
@@ -233,8 +454,8 @@ void XKeyView::EnterPreviewMode(
 			display->FillRect(mX, mY, mWidth, mHeight, XFont::eWhite);
 		}
 		display->TemporaryWindow(false, true, false,
-									mX+100, mX+100+OV5640::kYOutputSize,
-									mY+2, mY+2+OV5640::kXOutputSize);
+									mX+kPreviewLeft, mX+kPreviewLeft+OV5640::kYOutputSize,
+									mY+kPreviewTop, mY+kPreviewTop+OV5640::kXOutputSize);
 		mInPreviewMode = true;
 	}
 #endif
@@ -277,9 +498,26 @@ void XKeyView::Dump(void)
 	
 		fprintf(stderr, "Centers Scale = %u, Depths Scale = %u, Tolerance = %u\n",
 								mCentersScale, mDepthsScale, mTolerance);
+		if (mSkewValid)
+		{
+			fprintf(stderr, "Skew = %d px/1000 lines, back edge %s\n",
+				(int32_t)(((int64_t)mSkewSlopeQ16 * 1000) >> 16),
+				mBackEdgeIsLeft ? "left" : "right");
+		}
+		fprintf(stderr, "Flats = %u, Fitted Centers Scale = %u\n",
+				mSegmenter.NumFlats(), GetFittedCentersScale());
 		for (uint32_t i = 0; i < mKeySpec->numPins; i++)
 		{
-			fprintf(stderr, "[%u] % 4d\t%u\t%hhu %d\n", i, mPinCenter[i],  mPinDepth[i], mPinRootIndex[i], mPinRootDelta[i]);
+			fprintf(stderr, "[%u] % 4d\t%u\t%hhu %d\t%d\t%hhu%%\n", i, mPinCenter[i],  mPinDepth[i], mPinRootIndex[i], mPinRootDelta[i], mPinCentersValid ? mSegmenter.PinResidual(i) : 0, mPinConfidence[i]);
+		}
+		for (uint32_t i = 0; i < mNumAltCodes; i++)
+		{
+			fprintf(stderr, "Alt %u: ", i + 1);
+			for (uint32_t k = 0; k < mKeySpec->numPins; k++)
+			{
+				fprintf(stderr, "%hhu", mAltCode[i][k]);
+			}
+			fprintf(stderr, "\n");
 		}
 	}
 }
@@ -317,11 +555,30 @@ void XKeyView::Dump(
 		}
 		buffIdx = snprintf(buff, 1000, "*\n*\tCenters Scale = %u, Depths Scale = %u, Tolerance = %u\n",
 								mCentersScale, mDepthsScale, mTolerance);
+		if (mSkewValid)
+		{
+			buffIdx += snprintf(buff + buffIdx, 1000 - buffIdx, "*\tSkew = %d px/1000 lines, back edge %s\n",
+								(int32_t)(((int64_t)mSkewSlopeQ16 * 1000) >> 16),
+								mBackEdgeIsLeft ? "left" : "right");
+		}
+		buffIdx += snprintf(buff + buffIdx, 1000 - buffIdx, "*\tFlats = %u, Fitted Centers Scale = %u\n",
+								mSegmenter.NumFlats(), GetFittedCentersScale());
 		for (uint32_t i = 0; i < mKeySpec->numPins; i++)
 		{
-			buffIdx += snprintf(buff + buffIdx, 1000 - buffIdx, "*\t[%u] % 4d\t%u\t%u %d\n",
+			buffIdx += snprintf(buff + buffIdx, 1000 - buffIdx, "*\t[%u] % 4d\t%u\t%u %d\t%d\t%u%%\n",
 								i, mPinCenter[i], mPinDepth[i],
-								(uint32_t)mPinRootIndex[i], mPinRootDelta[i]);
+								(uint32_t)mPinRootIndex[i], mPinRootDelta[i],
+								mPinCentersValid ? mSegmenter.PinResidual(i) : 0,
+								(uint32_t)mPinConfidence[i]);
+		}
+		for (uint32_t i = 0; i < mNumAltCodes; i++)
+		{
+			buffIdx += snprintf(buff + buffIdx, 1000 - buffIdx, "*\tAlt %u: ", i + 1);
+			for (uint32_t k = 0; k < mKeySpec->numPins; k++)
+			{
+				buffIdx += snprintf(buff + buffIdx, 1000 - buffIdx, "%u", (uint32_t)mAltCode[i][k]);
+			}
+			buffIdx += snprintf(buff + buffIdx, 1000 - buffIdx, "\n");
 		}
 		buffIdx += snprintf(buff + buffIdx, 1000 - buffIdx, "*/\n\n\n");
 		if (inFile)
@@ -344,7 +601,7 @@ void XKeyView::Dump(
 *		name = Name of the key spec
 *		pins = Number of pins
 *		code = 4, 5, or 6 digit uint32 representing the key depths, bow to tip.
-*		custom = Appearing only when the scanned key does not conform to
+*		custom = Appearing only when the selected code does not conform to
 *				 standard pin depths.  Zero placeholders will be inserted for
 *				 any pins that do match a pin depth.
 *	Custom example: the 2nd and 4th pins are custom, all others match a key spec
@@ -354,6 +611,9 @@ void XKeyView::Dump(
 *		The non-zero numbers are in decimal 22 format, where the last two
 *		digits are 100th of a mm.  e.g. 550 is 5.50mm
 *
+*	The code is the selected code (see SelectCode), by default the decoded
+*	code.  The alternate codes never have custom pins.
+*
 *	The size of outCutKeyCmdStr must be at least 100 bytes.
 */
 bool XKeyView::GetCutKeyCmdStr(
@@ -370,7 +630,7 @@ bool XKeyView::GetCutKeyCmdStr(
 		uint32_t	keyCode = 0;
 		for (uint32_t i = 0; i < mKeySpec->numPins;)
 		{
-			uint32_t	thisRootIndex = mPinRootIndex[i++];
+			uint32_t	thisRootIndex = SelectedPinIndex(i++);
 			if (thisRootIndex == 99)
 			{
 				thisRootIndex = 0;
@@ -378,15 +638,15 @@ bool XKeyView::GetCutKeyCmdStr(
 			}
 			keyCode = (keyCode * 10) + thisRootIndex;
 		}
-		int buffIdx = snprintf(outCutKeyCmdStr, 100, "C {name=%s, pins=%u, code=%05u",
-							mKeySpec->name, mKeySpec->numPins, keyCode);
+		int buffIdx = snprintf(outCutKeyCmdStr, 100, "C {name=%s, pins=%u, code=%0*u",
+							mKeySpec->name, mKeySpec->numPins, (int)mKeySpec->numPins, keyCode);
 		if (highestCustomIndex)
 		{
 			buffIdx += snprintf(outCutKeyCmdStr + buffIdx, 100 - buffIdx, ", custom={");
 			for (uint32_t i = 0; i < highestCustomIndex; i++)
 			{
 				uint32_t	customValue;
-				if (mPinRootIndex[i] == 99)
+				if (SelectedPinIndex(i) == 99)
 				{
 					customValue = (mCustomPin[i] * 254) / 1000000;
 				} else
@@ -425,7 +685,7 @@ void XKeyView::SetTolerance(
 	UpdatePinRootIndexes();
 	if (inUpdate)
 	{
-		DrawSelf();
+		Invalidate();
 	}
 }
 
@@ -438,7 +698,7 @@ void XKeyView::SetCentersScale(
 	UpdatePinCenters();
 	if (inUpdate)
 	{
-		DrawSelf();
+		Invalidate();
 	}
 }
 
@@ -452,26 +712,24 @@ void XKeyView::SetDepthsScale(
 	UpdatePinRootIndexes();
 	if (inUpdate)
 	{
-		DrawSelf();
+		Invalidate();
 	}
 }
 
 /****************************** UpdatePinDepths *******************************/
 void XKeyView::UpdatePinDepths(void)
 {		
-	uint32_t	scaledDepth = mKeySpec->deepestCut;
-	uint32_t	scaledPinDepthInc = mKeySpec->pinDepthInc;
 	for (uint32_t i = 0; i < mKeySpec->numPinDepths; i++)
 	{
+		uint32_t	scaledDepth = mKeySpec->PinDepth(i);
 		mRootDepth[i] = scaledDepth/mDepthsScale;
-		scaledDepth += scaledPinDepthInc;
+		mRootDepthQ8[i] = (scaledDepth << 8)/mDepthsScale;
 	}
 }
 
 /****************************** UpdatePinCenters ******************************/
 void XKeyView::UpdatePinCenters(void)
 {
-	uint32_t	firstPinCenter = 0;
 	mPinCentersValid = false;
 	/*
 	*	The picture taken is a high resolution backlit key but only transition
@@ -485,112 +743,319 @@ void XKeyView::UpdatePinCenters(void)
 	*
 	*	There are 1918 entries/lines of data, but the useful data is in the
 	*	index range 500:1750, and within that range only the pin center indexes
-	*	are used.  A ring buffer is used to average the delta between each data
-	*	entry pair to determine the slope.
+	*	are used.  The FlatDetector uses a ring buffer to average the delta
+	*	between each data entry pair to determine the slope.
 	*
-	*	The routine NextDepth is used to skip any data errors, data that is out
-	*	of bounds.
+	*	The depth at each pin center is the median of the lines around the
+	*	center, skipping any data errors, data that is out of bounds.
 	*
 	*	A key flat is the area that the tip of a pin rests on when the key is
-	*	fully inserted in the lock.  The first task is to locate the first flat,
-	*	the flat closest to the bow.  Once located, the center of this flat is
-	*	the first pin center.  The remaining centers are calculated offsets from
-	*	the first center.  The offset is scaled from the key specification units
-	*	to pixels.
+	*	fully inserted in the lock.  The FlatSegmenter locates every flat from
+	*	the bow to the tip.  The first flat must be found near the bow.  The
+	*	flats are assigned to pins, and the first pin center and the pin pitch
+	*	are fitted to the flat centers.  When fewer than two pins have a flat
+	*	(e.g. all of the pins have the same depth), the remaining centers are
+	*	calculated offsets from the first center.  The offset is the pin
+	*	spacing scaled from the key specification units to pixels.
 	*
 	*	The pixel depths at the pin centers are converted to key indexes OR, if
 	*	the key is custom/outside of tolerance, a value in mm.
 	*/
 	if (mKeyData)
 	{
-		const uint32_t	kScanStart = 1700;
-		const uint32_t	kScanEnd = 1300;	// Index to stop at if a flat isn't located.
-		
-		uint32_t	sloping = 0;
-		uint32_t	flatStart = 0;
-		uint32_t	flatEnd = 0;
-		uint32_t	j = kScanStart;
-		int32_t		depth = NextDepth(j, kScanEnd, j);
-		int32_t		nextDepth = NextDepth(j, kScanEnd, j);
-		int32_t		delta = 0;
-		int32_t		deltaAcc = 0;
-		
-		const uint32_t	kRingBufferSize = 10;
-		int32_t			deltaRingBuffer[kRingBufferSize];
-		memset(deltaRingBuffer, 0, sizeof(deltaRingBuffer));
-		uint32_t		deltaRingIndex = 0;
-
-		bool		isInSlope = false;
-		for (; j > kScanEnd; nextDepth = NextDepth(j, kScanEnd, j))
-		{
-			delta = depth - nextDepth;
-			depth = nextDepth;
-			deltaAcc -= deltaRingBuffer[deltaRingIndex];
-			deltaRingBuffer[deltaRingIndex++] = delta;
-			deltaAcc += delta;
-			if (deltaRingIndex == kRingBufferSize)
+		mSegmenter.Begin(mKeyData);
+		mSegmenter.Step();
+		PinCentersFromFlats();
+	}
+	UpdatePinRootIndexes();
+}
+
+/**************************** PinCentersFromFlats *****************************/
+/*
+*	Sets the pin centers from the flats located by mSegmenter.
+*/
+void XKeyView::PinCentersFromFlats(void)
+{
+	if (!FitPinCenters())
+	{
+		// >>>>>>>  Flat Not Found <<<<<<<
+		UpdateStatusMessage(kFlatNotFoundStr);
+	}
+}
+
+/******************************** FitPinCenters *******************************/
+/*
+*	Fits the pin centers of the key spec to the flats located by mSegmenter.
+*	Unlike PinCentersFromFlats, a failure isn't reported.
+*/
+bool XKeyView::FitPinCenters(void)
+{
+	mPinCentersValid = mSegmenter.Fit(mKeySpec->numPins,
+								mKeySpec->pinSpacing/mCentersScale);
+	if (mPinCentersValid)
+	{
+		for (uint32_t i = 0; i < mKeySpec->numPins; i++)
+		{
+			mPinCenter[i] = mSegmenter.PinCenter(i);
+		}
+	}
+	return(mPinCentersValid);
+}
+
+/*************************** GetFittedCentersScale ****************************/
+uint32_t XKeyView::GetFittedCentersScale(void) const
+{
+	uint32_t	pitchQ16 = mSegmenter.PitchQ16();
+	return(mPinCentersValid && mSegmenter.PitchIsFitted() && pitchQ16 ?
+				(uint32_t)((((uint64_t)mKeySpec->pinSpacing << 16) + pitchQ16/2) / pitchQ16) : 0);
+}
+
+/********************************* Calibrate **********************************/
+/*
+*	Solves for the centers and depths scales from the current scan of a key
+*	of known code.  inCode is the key's code as digits, bow to tip, for the
+*	current key spec, e.g. "29141".
+*
+*	The centers scale is the pin spacing divided by the fitted pin pitch, so
+*	the scan must have at least two flats that could be assigned to pins
+*	(see FlatSegmenter::Fit.)
+*
+*	Each pin's width is proportional to its depth in key units
+*	(width = depth / depthsScale.)  The depths scale is fit by least squares
+*	over all of the pins, using the mean width across the middle of each
+*	flat rather than the few lines used to decode.  If any pin's width
+*	differs from the width of its depth by more than the tolerance, the flats
+*	weren't assigned to the correct pins, or the code doesn't match the key.
+*
+*	Returns false if the scan can't be used.  The current scales aren't
+*	changed.
+*/
+bool XKeyView::Calibrate(
+	const char*	inCode,
+	uint32_t&	outCentersScale,
+	uint32_t&	outDepthsScale)
+{
+	bool		success = false;
+	uint32_t	centersScale = GetFittedCentersScale();
+	if (centersScale &&
+		inCode &&
+		strlen(inCode) == mKeySpec->numPins)
+	{
+		int32_t		cutIndexInc = mKeySpec->CutIndexInc();
+		uint64_t	sumDepthSq = 0;
+		uint64_t	sumWidthDepth = 0;
+		uint32_t	pinsUsed = 0;
+		uint32_t	pinWidthQ8[SKeySpecU32::kMaxPins];
+		uint32_t	pinDepth[SKeySpecU32::kMaxPins];
+		/*
+		*	The skew correction depends on the centers scale, so the
+		*	calibrated centers scale is used.
+		*/
+		uint32_t	savedCentersScale = mCentersScale;
+		mCentersScale = centersScale;
+		uint32_t	skewCosQ16 = SkewCosQ16();
+		mCentersScale = savedCentersScale;
+		for (uint32_t k = 0; k < mKeySpec->numPins; k++)
+		{
+			int32_t	depthIndex = ((int32_t)(inCode[k] - '0') -
+								(int32_t)mKeySpec->deepestCutIndex) * cutIndexInc;
+			if (depthIndex < 0 ||
+				depthIndex >= (int32_t)mKeySpec->numPinDepths)
 			{
-				deltaRingIndex = 0;
+				pinsUsed = 0;
+				break;
 			}
-			
-			if (deltaAcc/5)
+			uint32_t	widthQ8 = MeanWidthQ8(mPinCenter[k]);
+			if (widthQ8)
 			{
-				if (sloping < 6)
-				{
-					sloping++;
-				} else
-				{
-					isInSlope = true;
-					if (flatStart)
-					{
-						flatEnd = (j);
-						if ((flatEnd - flatStart) < 20)
-						{
-							flatStart = 0;
-							flatEnd = 0;
-						} else
-						{
-							break;
-						}
-					}
-				}
-			} else if (sloping)
+				uint64_t	depth = mKeySpec->PinDepth(depthIndex);
+				widthQ8 = ((uint64_t)widthQ8 * skewCosQ16 + 0x8000) >> 16;
+				sumDepthSq += depth * depth;
+				sumWidthDepth += depth * widthQ8;
+				pinWidthQ8[pinsUsed] = widthQ8;
+				pinDepth[pinsUsed] = (uint32_t)depth;
+				pinsUsed++;
+			}
+		}
+		if (pinsUsed >= 2 &&
+			sumWidthDepth)
+		{
+			uint32_t	depthsScale = (uint32_t)(((sumDepthSq << 8) + sumWidthDepth/2) / sumWidthDepth);
+			success = true;
+			for (uint32_t i = 0; i < pinsUsed; i++)
 			{
-				sloping--;
-				if (isInSlope && sloping == 0)
+				int32_t	deltaQ8 = (int32_t)pinWidthQ8[i] -
+								(int32_t)(((uint64_t)pinDepth[i] << 8) / depthsScale);
+				if ((uint32_t)abs(deltaQ8) > (mTolerance << 8))
 				{
-					if (flatStart == 0)
-					{
-						flatStart = j;
-					}
+					success = false;
+					break;
 				}
 			}
+			if (success)
+			{
+				outCentersScale = centersScale;
+				outDepthsScale = depthsScale;
+			}
 		}
-		mPinCentersValid = (flatStart != 0 && flatEnd != 0);
-		if (mPinCentersValid)
+	}
+	return(success);
+}
+
+/********************************** WidthQ8 ***********************************/
+/*
+*	Returns the width of line inLine in 24.8 fixed point.  mKeyDataQ8 only
+*	holds the decode lines, the width of any other line is mKeyData's.
+*/
+uint32_t XKeyView::WidthQ8(
+	uint32_t	inLine) const
+{
+	return((mKeyDataQ8 &&
+			inLine >= HiResWindow::kDecodeFirstLine &&
+			inLine < HiResWindow::kDecodeEndLine) ?
+				mKeyDataQ8[inLine - HiResWindow::kDecodeFirstLine] :
+				(mKeyData[inLine] << 8));
+}
+
+/******************************* MedianWidthQ8 ********************************/
+/*
+*	Returns the median of the valid widths within kHalfWindow lines of
+*	inCenter in 24.8 fixed point, or zero if there are no valid widths.  A
+*	single noisy line, or a center a line or two off, doesn't change the
+*	width of the pin.
+*/
+uint32_t XKeyView::MedianWidthQ8(
+	uint32_t	inCenter) const
+{
+	const uint32_t	kHalfWindow = 2;
+	uint32_t	widthQ8[kHalfWindow*2+1];
+	uint32_t	count = 0;
+	for (uint32_t i = inCenter - kHalfWindow; i <= inCenter + kHalfWindow; i++)
+	{
+		uint32_t	width = mKeyData[i];
+		if (width > 100 &&
+			width < 600)
 		{
-			// The +10 below accounts for the delay introduced by the ring buffer.
-			firstPinCenter = flatStart - ((flatStart - flatEnd)/2) + 15;
-			//fprintf(stderr, "Flat %u:%u %u\n", flatStart, flatEnd, firstPinCenter);
 			/*
-			*	Create a pin centers array scaled to pixels.
+			*	Insertion sort
 			*/
+			uint32_t	thisWidthQ8 = WidthQ8(i);
+			uint32_t	j = count++;
+			for (; j > 0 && widthQ8[j-1] > thisWidthQ8; j--)
 			{
-				uint32_t	scaledCenterInc = mKeySpec->pinSpacing/mCentersScale;
-				uint32_t	pixelPinCenter = firstPinCenter;
-				for (uint32_t i = 0; i < mKeySpec->numPins; i++)
-				{
-					mPinCenter[i] = pixelPinCenter;
-					pixelPinCenter -= scaledCenterInc;
-				}
+				widthQ8[j] = widthQ8[j-1];
+			}
+			widthQ8[j] = thisWidthQ8;
+		}
+	}
+	return(count ? widthQ8[count/2] : 0);
+}
+
+/******************************** MeanWidthQ8 *********************************/
+/*
+*	Returns the mean of the valid widths within kHalfWindow lines of inCenter
+*	in 24.8 fixed point, or zero if there are no valid widths.  The window is
+*	well within the flat of a cut.
+*/
+uint32_t XKeyView::MeanWidthQ8(
+	uint32_t	inCenter) const
+{
+	const uint32_t	kHalfWindow = 8;
+	uint32_t	sumQ8 = 0;
+	uint32_t	count = 0;
+	for (uint32_t i = inCenter - kHalfWindow; i <= inCenter + kHalfWindow; i++)
+	{
+		uint32_t	width = mKeyData[i];
+		if (width > 100 &&
+			width < 600)
+		{
+			sumQ8 += WidthQ8(i);
+			count++;
+		}
+	}
+	return(count ? (sumQ8 + count/2) / count : 0);
+}
+
+/******************************** StreamKeyData *******************************/
+/*
+*	Called from the main loop while the hi-res frame is being received.
+*	inLinesReceived is the number of entries of inKeyData (and inKeyDataQ8)
+*	written so far, and inEndLine the number written when the last line of
+*	the hi-res window has been received.  The flat search starts once the
+*	entry at FlatDetector::kScanStart has been received, and is done in steps
+*	so the main loop isn't held up.  The search continues to the tip, which
+*	has already been received.  Returns true when the key data has been
+*	decoded.
+*
+*	Only the lines of the window past kScanStart remain to overlap with the
+*	search.  The steps of each call are paced from the lines received since
+*	the last call, so that the search finishes by the last line however short
+*	the window is, and never fewer than kStepsPerCall.
+*
+*	If the same inKeyData is later passed to SetKeyData (the end of frame),
+*	it isn't decoded again, and a search that hasn't finished is finished
+*	from where it is.  If a flat isn't found, SetKeyData does the decode so
+*	that the status is reported as usual.
+*/
+bool XKeyView::StreamKeyData(
+	const uint16_t*	inKeyData,
+	const uint32_t*	inKeyDataQ8,
+	uint32_t		inLinesReceived,
+	uint32_t		inEndLine)
+{
+	const uint32_t	kStepsPerCall = 100;
+	uint32_t	linesThisCall = inLinesReceived - mStreamLines;
+	mStreamLines = inLinesReceived;
+	if (mStreamState == eStreamIdle &&
+		inKeyData &&
+		inLinesReceived > FlatDetector::kScanStart)
+	{
+		mKeyData = inKeyData;
+		mKeyDataQ8 = inKeyDataQ8;
+		mPinCentersValid = false;
+		UpdatePinDepths();
+		UpdateSkew();
+		mSegmenter.Begin(inKeyData);
+		mStreamState = eStreamDetecting;
+	}
+	if (mStreamState == eStreamDetecting)
+	{
+		uint32_t	maxSteps = 0;	// The last line, finish the search
+		if (inLinesReceived < inEndLine)
+		{
+			uint32_t	linesLeft = inEndLine - inLinesReceived;
+			maxSteps = (mSegmenter.EntriesLeft() * linesThisCall + linesLeft - 1) / linesLeft;
+			if (maxSteps < kStepsPerCall)
+			{
+				maxSteps = kStepsPerCall;
 			}
+		}
+		StepStream(maxSteps);
+	}
+	return(mStreamState == eStreamDecoded);
+}
+
+/********************************* StepStream *********************************/
+/*
+*	Continues the streamed flat search for up to inMaxSteps entries
+*	(0 = no limit), decoding the key data when the search finishes.
+*/
+void XKeyView::StepStream(
+	uint32_t	inMaxSteps)
+{
+	if (mStreamState == eStreamDetecting &&
+		mSegmenter.Step(inMaxSteps))
+	{
+		if (mSegmenter.NumFlats())
+		{
+			PinCentersFromFlats();
+			UpdatePinRootIndexes();
+			mStreamState = eStreamDecoded;
 		} else
 		{
-			// >>>>>>>  Flat Not Found <<<<<<<
-			UpdateStatusMessage(kFlatNotFoundStr);
+			mStreamState = eStreamNoFlat;
 		}
 	}
-	UpdatePinRootIndexes();
 }
 
 /******************************** UpdatePinRootIndexes *********************************/
@@ -599,69 +1064,391 @@ void XKeyView::UpdatePinRootIndexes(void)
 	if (mPinCentersValid &&
 		mKeyData)
 	{		
-		uint32_t	endIndex, j, thisPinDepth;
+		uint32_t	thisPinDepth;
 		int32_t		cutIndexInc = mKeySpec->CutIndexInc();
+		/*
+		*	When sub-pixel widths are available the comparisons are done in
+		*	24.8 fixed point, otherwise in whole pixels.
+		*/
+		const uint32_t*	rootDepth = mKeyDataQ8 ? mRootDepthQ8 : mRootDepth;
+		uint32_t	fractionBits = mKeyDataQ8 ? 8 : 0;
+		uint32_t	tolerance = mTolerance << fractionBits;
+		/*
+		*	When the key is skewed, the widths measured along each line are
+		*	longer than the actual depths by 1/cos(skew angle.)
+		*/
+		uint32_t	skewCosQ16 = SkewCosQ16();
 		for (uint32_t k = 0; k < mKeySpec->numPins; k++)
 		{
 			/*
 			*	The mRootDepth array goes from the deepest cut to the
 			*	shallowest. The mRootDepth values are in pixels.
-			*	The routine NextDepth() is used to skip over any errors in the
-			*	data. The data index range allows for three attempts before an
-			*	error occurs.
+			*	MedianWidthQ8 skips over any errors in the data.
 			*/ 
-			j = mPinCenter[k];
-			endIndex = j - 2;
-			thisPinDepth = NextDepth(j, endIndex, j);
-			mPinDepth[k] = thisPinDepth;	// Saved for debugging
+			thisPinDepth = MedianWidthQ8(mPinCenter[k]);
+			mPinDepth[k] = (thisPinDepth + 0x80) >> 8;	// Saved for debugging
+			if (!mKeyDataQ8)
+			{
+				thisPinDepth = mPinDepth[k];
+			}
+			if (mSkewValid)
+			{
+				thisPinDepth = ((uint64_t)thisPinDepth * skewCosQ16 + 0x8000) >> 16;
+			}
 			for (uint32_t i = 0; i < mKeySpec->numPinDepths; i++)
 			{
-				uint32_t	pinDepth = mRootDepth[i];
-				if (thisPinDepth > (pinDepth + mTolerance))
+				uint32_t	pinDepth = rootDepth[i];
+				if (thisPinDepth > (pinDepth + tolerance))
 				{
 					continue;
-				} else if (thisPinDepth < (pinDepth - mTolerance))
+				} else if (thisPinDepth < (pinDepth - tolerance))
 				{
-					mCustomPin[k] = thisPinDepth*mDepthsScale;
+					mCustomPin[k] = (thisPinDepth*mDepthsScale) >> fractionBits;
 					mPinRootIndex[k] = 99;
 					break;
 				}
 				mPinRootIndex[k] = mKeySpec->deepestCutIndex + (cutIndexInc * i);
-				mPinRootDelta[k] = (int32_t)pinDepth - thisPinDepth;
+				mPinRootDelta[k] = ((int32_t)pinDepth - (int32_t)thisPinDepth) >> fractionBits;
 				break;
 			}
+			UpdatePinCandidates(k, thisPinDepth, rootDepth, tolerance);
 		}
+		UpdateAltCodes();
 	} else
 	{
 		for (uint32_t k = 0; k < mKeySpec->numPins; k++)
 		{
 			mPinRootIndex[k] = 99;
+			mPinConfidence[k] = 0;
+		}
+		mNumAltCodes = 0;
+	}
+	mSelectedCode = 0;
+}
+
+/***************************** UpdatePinCandidates ****************************/
+/*
+*	Saves the two root depths nearest to inPinDepth as the candidates for
+*	pin inPin, and the confidence of the nearest.  The confidence is 100 when
+*	inPinDepth is on a root depth, falling to 0 halfway between two root
+*	depths.  A pin that doesn't match a root depth within inTolerance
+*	(custom) has a confidence of 0.
+*
+*	inPinDepth, inRootDepth and inTolerance are in the same units, whole or
+*	24.8 fixed point pixels.
+*/
+void XKeyView::UpdatePinCandidates(
+	uint32_t		inPin,
+	uint32_t		inPinDepth,
+	const uint32_t*	inRootDepth,
+	uint32_t		inTolerance)
+{
+	uint32_t	nearestIndex = 0;
+	uint32_t	nearestDelta = 0xFFFFFFFF;
+	uint32_t	nextIndex = 0;
+	uint32_t	nextDelta = 0xFFFFFFFF;
+	for (uint32_t i = 0; i < mKeySpec->numPinDepths; i++)
+	{
+		uint32_t	delta = (uint32_t)abs((int32_t)inPinDepth - (int32_t)inRootDepth[i]);
+		if (delta < nearestDelta)
+		{
+			nextIndex = nearestIndex;
+			nextDelta = nearestDelta;
+			nearestIndex = i;
+			nearestDelta = delta;
+		} else if (delta < nextDelta)
+		{
+			nextIndex = i;
+			nextDelta = delta;
+		}
+	}
+	int32_t	cutIndexInc = mKeySpec->CutIndexInc();
+	mPinCandidate[inPin][0] = mKeySpec->deepestCutIndex + (cutIndexInc * nearestIndex);
+	mPinCandidate[inPin][1] = mKeySpec->deepestCutIndex + (cutIndexInc * nextIndex);
+	mPinCandidateCost[inPin][0] = (uint64_t)nearestDelta * nearestDelta;
+	mPinCandidateCost[inPin][1] = (uint64_t)nextDelta * nextDelta;
+	mPinConfidence[inPin] = nearestDelta > inTolerance ? 0 :
+			(uint8_t)(((uint64_t)(nextDelta - nearestDelta) * 100) / (nextDelta + nearestDelta));
+}
+
+/********************************* GetFitCost *********************************/
+/*
+*	How well the decode fits the key spec, 0 being a perfect fit.  Each pin
+*	costs 100 less its confidence.  When the key has more pins than the
+*	spec, the following pin is past the last pin of the spec, so each flat
+*	found there costs 100, and the width where the next pin would be costs
+*	its confidence (a cut there matches a root depth, the tip doesn't.)
+*	The mean cost per pin is used so that specs with different pin counts
+*	can be compared.  When the pin pitch was fitted, its difference from the
+*	spec's pin spacing, in tenths of a percent, is added.  Returns
+*	0xFFFFFFFF if the data isn't valid.
+*/
+uint32_t XKeyView::GetFitCost(void) const
+{
+	uint32_t	cost = 0xFFFFFFFF;
+	if (mPinCentersValid &&
+		mKeyData)
+	{
+		uint32_t	numPins = mKeySpec->numPins;
+		uint32_t	extraPins = mSegmenter.NumExtraPinFlats();
+		uint32_t	pinCost = extraPins * 100;
+		for (uint32_t k = 0; k < numPins; k++)
+		{
+			pinCost += 100 - mPinConfidence[k];
+		}
+		uint32_t	pitch = (mSegmenter.PitchQ16() + 0x8000) >> 16;
+		if (mPinCenter[numPins-1] > (pitch + 8))
+		{
+			uint32_t	nextPinWidthQ8 = MeanWidthQ8(mPinCenter[numPins-1] - pitch);
+			if (nextPinWidthQ8)
+			{
+				if (mSkewValid)
+				{
+					nextPinWidthQ8 = ((uint64_t)nextPinWidthQ8 * SkewCosQ16() + 0x8000) >> 16;
+				}
+				pinCost += WidthConfidence(nextPinWidthQ8);
+			}
+			extraPins++;
+		}
+		cost = pinCost / (numPins + extraPins);
+		if (mSegmenter.PitchIsFitted())
+		{
+			uint64_t	nominalPitchQ16 = ((uint64_t)mKeySpec->pinSpacing << 16) / mCentersScale;
+			uint64_t	pitchQ16 = mSegmenter.PitchQ16();
+			uint64_t	pitchError = pitchQ16 > nominalPitchQ16 ?
+								pitchQ16 - nominalPitchQ16 : nominalPitchQ16 - pitchQ16;
+			cost += (uint32_t)((pitchError * 1000) / nominalPitchQ16);
+		}
+	}
+	return(cost);
+}
+
+/****************************** WidthConfidence *******************************/
+/*
+*	The confidence that inWidthQ8 (24.8 pixels) is a root depth of the key
+*	spec, as calculated by UpdatePinCandidates.
+*/
+uint8_t XKeyView::WidthConfidence(
+	uint32_t	inWidthQ8) const
+{
+	uint32_t	nearestDelta = 0xFFFFFFFF;
+	uint32_t	nextDelta = 0xFFFFFFFF;
+	for (uint32_t i = 0; i < mKeySpec->numPinDepths; i++)
+	{
+		uint32_t	delta = (uint32_t)abs((int32_t)inWidthQ8 - (int32_t)mRootDepthQ8[i]);
+		if (delta < nearestDelta)
+		{
+			nextDelta = nearestDelta;
+			nearestDelta = delta;
+		} else if (delta < nextDelta)
+		{
+			nextDelta = delta;
+		}
+	}
+	return(nearestDelta > (mTolerance << 8) ? 0 :
+			(uint8_t)(((uint64_t)(nextDelta - nearestDelta) * 100) / (nextDelta + nearestDelta)));
+}
+
+/******************************** RankKeySpecs ********************************/
+/*
+*	The flats located by the last decode don't depend on the key spec, so
+*	only the pin fit and the pin depth lookup are repeated for each spec.
+*/
+uint32_t XKeyView::RankKeySpecs(
+	const SKeySpecU32*	inKeySpecs,
+	uint32_t			inNumKeySpecs,
+	uint8_t*			outRank,
+	uint32_t*			outCost)
+{
+	uint32_t	numRanked = 0;
+	if (mKeyData &&
+		mKeySpec &&
+		mSegmenter.Done() &&
+		mSegmenter.NumFlats())
+	{
+		const SKeySpecU32*	savedKeySpec = mKeySpec;
+		for (uint32_t i = 0; i < inNumKeySpecs; i++)
+		{
+			mKeySpec = &inKeySpecs[i];
+			UpdatePinDepths();
+			FitPinCenters();
+			UpdatePinRootIndexes();
+			uint32_t	cost = GetFitCost();
+			// Insertion sort, there are only a few specs.
+			uint32_t	j = numRanked++;
+			for (; j > 0 && outCost[j-1] > cost; j--)
+			{
+				outCost[j] = outCost[j-1];
+				outRank[j] = outRank[j-1];
+			}
+			outCost[j] = cost;
+			outRank[j] = i;
 		}
+		mKeySpec = savedKeySpec;
+		UpdatePinDepths();
+		FitPinCenters();
+		UpdatePinRootIndexes();
 	}
+	return(numRanked);
 }
 
-/********************************** NextDepth *********************************/
+/******************************* UpdateAltCodes *******************************/
 /*
-*	Returns the next depth within a range, skipping any invalid depths in the
-*	data.
+*	Ranks the codes made from the pin candidates by their cost, the sum of
+*	the squared differences between the measured and root depths, and keeps
+*	the kMaxAltCodes lowest cost codes that differ from the decoded code.
+*	With at most 8 pins there are at most 256 codes to rank.
 */
-uint32_t XKeyView::NextDepth(
+void XKeyView::UpdateAltCodes(void)
+{
+	uint32_t	numPins = mKeySpec->numPins;
+	uint64_t	altCodeCost[kMaxAltCodes];
+	mNumAltCodes = 0;
+	for (uint32_t combo = 0; combo < (1U << numPins); combo++)
+	{
+		uint8_t		code[SKeySpecU32::kMaxPins];
+		uint64_t	cost = 0;
+		bool		sameAsDecoded = true;
+		for (uint32_t k = 0; k < numPins; k++)
+		{
+			uint32_t	candidate = (combo >> k) & 1;
+			code[k] = mPinCandidate[k][candidate];
+			cost += mPinCandidateCost[k][candidate];
+			sameAsDecoded = sameAsDecoded && code[k] == mPinRootIndex[k];
+		}
+		if (sameAsDecoded)
+		{
+			continue;
+		}
+		// Insert in cost order
+		uint32_t	i = mNumAltCodes < kMaxAltCodes ? mNumAltCodes++ : kMaxAltCodes;
+		for (; i > 0 && altCodeCost[i-1] > cost; i--)
+		{
+			if (i < kMaxAltCodes)
+			{
+				altCodeCost[i] = altCodeCost[i-1];
+				memcpy(mAltCode[i], mAltCode[i-1], numPins);
+			}
+		}
+		if (i < kMaxAltCodes)
+		{
+			altCodeCost[i] = cost;
+			memcpy(mAltCode[i], code, numPins);
+		}
+	}
+}
+
+/********************************* SelectCode *********************************/
+/*
+*	Selects the code returned by GetCutKeyCmdStr and drawn.  0 is the decoded
+*	code, 1 to NumCodes()-1 the alternate codes from the most to the least
+*	likely.
+*/
+void XKeyView::SelectCode(
 	uint32_t	inIndex,
-	uint32_t	inMinIndex,
-	uint32_t&	outNextIndex)
+	bool		inUpdate)
 {
-	uint32_t	depth;
-	while (inIndex > inMinIndex)
+	if (inIndex < NumCodes() &&
+		inIndex != mSelectedCode)
 	{
-		depth = mKeyData[inIndex];
-		inIndex--;
-		if (depth > 100 &&
-			depth < 600)
+		mSelectedCode = inIndex;
+		if (inUpdate)
 		{
-			outNextIndex = inIndex;
-			return(depth);
+			Invalidate();
 		}
 	}
-	outNextIndex = inMinIndex;
-	return(0);
+}
+
+/********************************** MouseUp ***********************************/
+/*
+*	Touching the key view steps through the decoded and alternate codes.
+*/
+void XKeyView::MouseUp(
+	int16_t	inGlobalX,
+	int16_t	inGlobalY)
+{
+	if (!mInPreviewMode &&
+		mPinCentersValid &&
+		NumCodes() > 1)
+	{
+		SelectCode((mSelectedCode + 1) % NumCodes(), true);
+	}
+}
+
+/******************************* SelectedPinIndex *****************************/
+/*
+*	Returns the cut index of pin inPin of the selected code, or 99 if the pin
+*	is custom.
+*/
+uint8_t XKeyView::SelectedPinIndex(
+	uint32_t	inPin) const
+{
+	return(mSelectedCode ? mAltCode[mSelectedCode-1][inPin] : mPinRootIndex[inPin]);
+}
+
+/********************************* UpdateSkew *********************************/
+/*
+*	When both edges of the blade are available (dual-edge mode), a line is fit
+*	to each edge over the length of the blade.  The back of the blade is
+*	straight, so the edge with the smallest residual is the back edge, and its
+*	slope is the skew of the key.  The cut edge is only used to determine
+*	which lines are valid.
+*/
+void XKeyView::UpdateSkew(void)
+{
+	mSkewValid = false;
+	mSkewSlopeQ16 = 0;
+	if (mKeyData &&
+		mEdgeLeft &&
+		mEdgeRight)
+	{
+		// The range of lines checked for errors by the hi-res line callback.
+		const uint32_t	kFitStart = 450;
+		const uint32_t	kFitEnd = FlatDetector::kScanStart;
+		const uint32_t	kMinFitLines = 100;
+		LineFit	leftFit;
+		LineFit	rightFit;
+		static_assert(kFitStart >= HiResWindow::kDecodeFirstLine &&
+			kFitEnd < HiResWindow::kDecodeEndLine, "The fit must be within the decode lines");
+		for (uint32_t i = kFitStart; i <= kFitEnd; i++)
+		{
+			uint32_t	width = mKeyData[i];
+			uint16_t	edgeLeft = mEdgeLeft[i - HiResWindow::kDecodeFirstLine];
+			uint16_t	edgeRight = mEdgeRight[i - HiResWindow::kDecodeFirstLine];
+			if (width > 100 &&
+				width < 600 &&
+				edgeLeft &&
+				edgeRight > edgeLeft)
+			{
+				leftFit.Add(i, edgeLeft);
+				rightFit.Add(i, edgeRight);
+			}
+		}
+		if (leftFit.Count() >= kMinFitLines &&
+			leftFit.IsValid())
+		{
+			mBackEdgeIsLeft = leftFit.MeanSquaredResidual() <= rightFit.MeanSquaredResidual();
+			float	slope = mBackEdgeIsLeft ? leftFit.Slope() : rightFit.Slope();
+			mSkewSlopeQ16 = (int32_t)(slope * 65536);
+			mSkewValid = true;
+		}
+	}
+}
+
+/********************************* SkewCosQ16 *********************************/
+/*
+*	Returns the cosine of the skew angle in 16.16 fixed point.  The horizontal
+*	and vertical pixel scales differ, so the slope is converted to key units
+*	before determining the angle.
+*/
+uint32_t XKeyView::SkewCosQ16(void) const
+{
+	uint32_t	cosQ16 = 0x10000;
+	if (mSkewValid &&
+		mCentersScale)
+	{
+		float	tangent = ((float)mSkewSlopeQ16 / 65536) * mDepthsScale / mCentersScale;
+		cosQ16 = (uint32_t)(65536 / sqrtf(1 + (tangent * tangent)) + 0.5f);
+	}
+	return(cosQ16);
 }
@@ -25,9 +25,11 @@
 #include "XView.h"
 #include "XFont.h"
 #include "SKeySpecU32.h"
+#include "FlatSegmenter.h"
 #ifndef __MACH__
 class SdFile;
 #endif
+class DisplayController;
 class XKeyView : public XView
 {
 public:
@@ -40,6 +42,8 @@ public:
 								XView*					inNextView = nullptr,
 								XFont::Font*			inFont = nullptr);
 	virtual void			DrawSelf(void);
+	virtual bool			IsOpaque(void) const
+								{return(true);}
 	void					Setup(
 								uint32_t				inCentersScale,
 								uint32_t				inDepthsScale,
@@ -76,6 +80,41 @@ public:
 	void					SetKeyData(
 								const uint16_t*			inKeyData,
 								bool					inUpdate = false);
+	/*
+	*	The sub-pixel widths and the edge positions only cover the decode
+	*	lines.  Entry 0 is frame line HiResWindow::kDecodeFirstLine.
+	*/
+	void					SetKeyDataQ8(
+								const uint32_t*			inKeyDataQ8)
+								{mKeyDataQ8 = inKeyDataQ8;}
+	void					SetEdgeData(
+								const uint16_t*			inEdgeLeft,
+								const uint16_t*			inEdgeRight)
+								{mEdgeLeft = inEdgeLeft; mEdgeRight = inEdgeRight;}
+								// Back edge slope in pixels per line, 16.16
+	int32_t					GetSkewSlopeQ16(void) const
+								{return(mSkewSlopeQ16);}
+	bool					SkewIsValid(void) const
+								{return(mSkewValid);}
+	/*
+	*	The centers scale implied by the fitted pin pitch, or zero if the
+	*	pitch couldn't be fitted.
+	*/
+	uint32_t				GetFittedCentersScale(void) const;
+	int32_t					GetPinResidual(
+								uint32_t				inPin) const
+								{return(mSegmenter.PinResidual(inPin));}
+	bool					Calibrate(
+								const char*				inCode,
+								uint32_t&				outCentersScale,
+								uint32_t&				outDepthsScale);
+	bool					StreamKeyData(
+								const uint16_t*			inKeyData,
+								const uint32_t*			inKeyDataQ8,
+								uint32_t				inLinesReceived,
+								uint32_t				inEndLine);
+	void					ResetStream(void)
+								{mStreamState = eStreamIdle; mStreamLines = 0;}
 	void					UpdateStatusMessage(
 								const char*				inStatusMessage);
 	void					EnterPreviewMode(
@@ -84,33 +123,128 @@ public:
 								bool					inEraseView = false);
 	bool					InPreviewMode(void) const
 								{return(mInPreviewMode);}
+	/*
+	*	The live alignment score of the preview (see PreviewAlign.)  When
+	*	inUpdate is set, the alignment strip is invalidated and drawn by
+	*	XRootView::DrawInvalid.
+	*/
+	void					SetAlignment(
+								uint32_t				inScore,
+								int32_t					inTilt,
+								bool					inIsAligned,
+								bool					inUpdate);
 	bool					DataIsValid(void) const
 								{return(mPinCentersValid);}
+	virtual void			MouseUp(
+								int16_t					inGlobalX,
+								int16_t					inGlobalY);
+	/*
+	*	The decoded code (0) followed by up to kMaxAltCodes alternate codes,
+	*	most likely first.
+	*/
+	uint32_t				NumCodes(void) const
+								{return(mPinCentersValid ? mNumAltCodes + 1 : 0);}
+	uint32_t				GetSelectedCode(void) const
+								{return(mSelectedCode);}
+	void					SelectCode(
+								uint32_t				inIndex,
+								bool					inUpdate);
+								// 0 to 100, see UpdatePinCandidates
+	uint8_t					GetPinConfidence(
+								uint32_t				inPin) const
+								{return(mPinConfidence[inPin]);}
+	uint32_t				GetFitCost(void) const;
+	/*
+	*	Decodes the current key data against each of inKeySpecs and returns
+	*	the number of specs ranked.  outRank receives the inKeySpecs
+	*	indexes from the lowest to the highest fit cost, and outCost the
+	*	costs.  Both must have room for inNumKeySpecs entries.  The decode
+	*	of the current key spec isn't changed.
+	*/
+	uint32_t				RankKeySpecs(
+								const SKeySpecU32*		inKeySpecs,
+								uint32_t				inNumKeySpecs,
+								uint8_t*				outRank,
+								uint32_t*				outCost);
 protected:
+	enum
+	{
+		kMaxAltCodes	= 3
+	};
+	enum EStreamState
+	{
+		eStreamIdle,
+		eStreamDetecting,
+		eStreamDecoded,
+		eStreamNoFlat
+	};
 	XFont::Font*		mFont;
 	const char*			mStatusMessage;
 	const SKeySpecU32*	mKeySpec;
 	const uint16_t*		mKeyData;
+	const uint32_t*		mKeyDataQ8;	// Optional sub-pixel widths, 24.8, decode lines only
+	const uint16_t*		mEdgeLeft;	// Optional absolute edge positions, decode lines only
+	const uint16_t*		mEdgeRight;
+	int32_t				mSkewSlopeQ16;
+	uint32_t			mAlignScore;
+	int32_t				mAlignTilt;
 	uint32_t			mCentersScale;
 	uint32_t			mDepthsScale;
-	uint32_t			mPinCenter[6];
-	uint32_t			mRootDepth[10];
-	uint8_t				mPinRootIndex[6];
-	int32_t				mPinRootDelta[6];
-	uint32_t			mPinDepth[6];
-	uint32_t			mCustomPin[6];
+	uint32_t			mPinCenter[SKeySpecU32::kMaxPins];
+	uint32_t			mRootDepth[SKeySpecU32::kMaxPinDepths];
+	uint32_t			mRootDepthQ8[SKeySpecU32::kMaxPinDepths];
+	uint8_t				mPinRootIndex[SKeySpecU32::kMaxPins];
+	int32_t				mPinRootDelta[SKeySpecU32::kMaxPins];
+	uint32_t			mPinDepth[SKeySpecU32::kMaxPins];
+	uint32_t			mCustomPin[SKeySpecU32::kMaxPins];
+	uint8_t				mPinConfidence[SKeySpecU32::kMaxPins];
+	uint8_t				mPinCandidate[SKeySpecU32::kMaxPins][2];	// Nearest two cut indexes
+	uint64_t			mPinCandidateCost[SKeySpecU32::kMaxPins][2];
+	uint8_t				mAltCode[kMaxAltCodes][SKeySpecU32::kMaxPins];
+	uint8_t				mNumAltCodes;
+	uint8_t				mSelectedCode;
 	uint32_t			mTolerance;
+	FlatSegmenter		mSegmenter;
+	uint8_t				mStreamState;
+	uint32_t			mStreamLines;	// inLinesReceived of the last StreamKeyData
 	bool				mPinCentersValid;
 	bool				mInPreviewMode;
 	bool				mShowPinRootDelta;
+	bool				mSkewValid;
+	bool				mBackEdgeIsLeft;
+	bool				mIsAligned;
+	bool				mShowAlignment;	// SetAlignment called since EnterPreviewMode
 
 	XFont*					MakeFontCurrent(void);
 	void					UpdatePinDepths(void);
 	void					UpdatePinCenters(void);
+	void					PinCentersFromFlats(void);
+	void					StepStream(
+								uint32_t				inMaxSteps);
+	bool					FitPinCenters(void);
 	void					UpdatePinRootIndexes(void);
-	uint32_t				NextDepth(
-								uint32_t				inIndex,
-								uint32_t				inMinIndex,
-								uint32_t&				outNextIndex);
+	void					UpdatePinCandidates(
+								uint32_t				inPin,
+								uint32_t				inPinDepth,
+								const uint32_t*			inRootDepth,
+								uint32_t				inTolerance);
+	void					UpdateAltCodes(void);
+	uint8_t					SelectedPinIndex(
+								uint32_t				inPin) const;
+	void					UpdateSkew(void);
+	void					DrawAlignment(void);
+	void					DrawPreviewFrame(
+								DisplayController*		inDisplay);
+	void					DrawProfile(
+								DisplayController*		inDisplay);
+	uint32_t				SkewCosQ16(void) const;
+	uint8_t					WidthConfidence(
+								uint32_t				inWidthQ8) const;
+	uint32_t				WidthQ8(
+								uint32_t				inLine) const;
+	uint32_t				MedianWidthQ8(
+								uint32_t				inCenter) const;
+	uint32_t				MeanWidthQ8(
+								uint32_t				inCenter) const;
 };
 #endif // XKeyView_h
@@ -0,0 +1,168 @@
+/*
+*	YUYVLineScanner.h, Copyright Jonathan Mackey 2025
+*	Locates the B&W transitions of the key blade within a YUV422 line.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef YUYVLineScanner_h
+#define YUYVLineScanner_h
+
+#include <inttypes.h>
+
+/*
+*	Each 16 bit pixel of the line is one half of a YUYV pair.  Only the
+*	luminance, the low byte of each pixel, is examined.  A pixel is white when
+*	its luminance is >= the threshold, otherwise it's black.
+*
+*	The scalar routines test one pixel at a time.  The packed routines test a
+*	word of pixels at a time (SWAR, SIMD within a register.)  The luminance
+*	bytes are masked into 16 bit lanes, then (0x8000 - threshold) is added to
+*	every lane.  Because the luminance is <= 255 no lane carries into the next,
+*	and bit 15 of each lane is set only when that pixel is white.  A run of
+*	pixels of the same color is skipped with a single compare per word.
+*
+*	On the STM32 the Word is uint32_t (2 pixels.)  A uint64_t Word (4 pixels)
+*	is faster on 64 bit hosts but not on the Cortex-M4.
+*
+*	These routines are called from an interrupt for every hi-res line, so
+*	everything is inline and nothing depends on the HAL.  This also allows the
+*	scanner to be run and benchmarked on the host.
+*/
+class YUYVLineScanner
+{
+public:
+	/*
+	*	Scan replicates the original three loops of the hi-res line callback:
+	*	find the first white pixel, skip inWhiteMargin pixels, find the first
+	*	black pixel (the left edge of the blade), skip 10 pixels, then find
+	*	the next white pixel (the right edge.)  ioLeft and ioRight are only
+	*	changed when the corresponding edge is found.
+	*/
+	template <typename Word>
+	static inline void		Scan(
+								const uint16_t*			inLine,
+								uint32_t				inLineLen,
+								uint32_t				inThreshold,
+								uint32_t				inWhiteMargin,
+								uint16_t&				ioLeft,
+								uint16_t&				ioRight)
+							{
+								uint32_t i = FirstPacked<Word, true>(inLine, 0, inLineLen, inThreshold);
+								if (i < inLineLen)
+								{
+									i = FirstPacked<Word, false>(inLine, i + inWhiteMargin, inLineLen, inThreshold);
+									if (i < inLineLen)
+									{
+										ioLeft = i;
+										i = FirstPacked<Word, true>(inLine, i + 10, inLineLen, inThreshold);
+										if (i < inLineLen)
+										{
+											ioRight = i;
+										}
+									}
+								}
+							}
+	static inline void		ScanScalar(
+								const uint16_t*			inLine,
+								uint32_t				inLineLen,
+								uint32_t				inThreshold,
+								uint32_t				inWhiteMargin,
+								uint16_t&				ioLeft,
+								uint16_t&				ioRight)
+							{
+								uint32_t i = FirstScalar<true>(inLine, 0, inLineLen, inThreshold);
+								if (i < inLineLen)
+								{
+									i = FirstScalar<false>(inLine, i + inWhiteMargin, inLineLen, inThreshold);
+									if (i < inLineLen)
+									{
+										ioLeft = i;
+										i = FirstScalar<true>(inLine, i + 10, inLineLen, inThreshold);
+										if (i < inLineLen)
+										{
+											ioRight = i;
+										}
+									}
+								}
+							}
+	/*
+	*	Returns the index of the first white (inWhite true) or black pixel
+	*	from inIndex up to inEnd.  Returns inEnd if not found.
+	*/
+	template <bool inWhite>
+	static inline uint32_t	FirstScalar(
+								const uint16_t*			inLine,
+								uint32_t				inIndex,
+								uint32_t				inEnd,
+								uint32_t				inThreshold)
+							{
+								for (; inIndex < inEnd; inIndex++)
+								{
+									if (((inLine[inIndex] & 0xFF) >= inThreshold) == inWhite)
+									{
+										break;
+									}
+								}
+								return(inIndex < inEnd ? inIndex : inEnd);
+							}
+	template <typename Word, bool inWhite>
+	static inline uint32_t	FirstPacked(
+								const uint16_t*			inLine,
+								uint32_t				inIndex,
+								uint32_t				inEnd,
+								uint32_t				inThreshold)
+							{
+								const uint32_t	kPixelsPerWord = sizeof(Word)/2;
+								const Word	kLaneMask = (Word)0x00FF00FF00FF00FFULL;
+								const Word	kSignBits = (Word)0x8000800080008000ULL;
+								const Word	kBias = (Word)0x0001000100010001ULL * (0x8000 - inThreshold);
+								/*
+								*	Test single pixels till inIndex is aligned
+								*	to the word size.
+								*/
+								for (; inIndex < inEnd && (inIndex % kPixelsPerWord); inIndex++)
+								{
+									if (((inLine[inIndex] & 0xFF) >= inThreshold) == inWhite)
+									{
+										return(inIndex);
+									}
+								}
+								const Word*	wordPtr = (const Word*)&inLine[inIndex];
+								for (; inIndex + kPixelsPerWord <= inEnd; inIndex += kPixelsPerWord)
+								{
+									Word	whiteBits = ((*(wordPtr++) & kLaneMask) + kBias) & kSignBits;
+									Word	matchBits = inWhite ? whiteBits : (whiteBits ^ kSignBits);
+									if (matchBits)
+									{
+										// The lowest lane is the first pixel (little endian)
+										return(inIndex + (CountTrailingZeros(matchBits) >> 4));
+									}
+								}
+								return(FirstScalar<inWhite>(inLine, inIndex, inEnd, inThreshold));
+							}
+protected:
+	static inline uint32_t	CountTrailingZeros(
+								uint32_t				inValue)
+								{return(__builtin_ctz(inValue));}
+	static inline uint32_t	CountTrailingZeros(
+								uint64_t				inValue)
+								{return(__builtin_ctzll(inValue));}
+};
+
+#endif // YUYVLineScanner_h
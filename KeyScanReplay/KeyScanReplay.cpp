@@ -0,0 +1,2152 @@
+/*
+*	KeyScanReplay.cpp, Copyright Jonathan Mackey 2025
+*	Host tool that replays saved hi-res scans through the XKeyView decoder.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+/*
+*	The Key Reader's "Save last scan to SD" button writes each hi-res scan as
+*	a header file (see KeyReaderSTM32::SaveScanDataToSD.)  This tool parses
+*	these files and runs them through the same XKeyView decode used on the
+*	board, so decode changes can be evaluated against an archive of scans
+*	without a key or the board.
+*
+*	The sources are compiled for the host using the __MACH__ platform
+*	switch used throughout the libraries.  From this directory:
+*
+*	c++ -std=c++17 -O2 -pthread -D__MACH__ -I. -I../KeyReader -I../libraries/XView \
+*		-I../libraries/XFont -I../libraries/DisplayController \
+*		-I../libraries/DataStream \
+*		*.cpp ../KeyReader/XKeyView.cpp ../KeyReader/FlatDetector.cpp \
+*		../KeyReader/FlatSegmenter.cpp ../KeyReader/KeywayTable.cpp \
+*		../KeyReader/PreviewAlign.cpp ../libraries/XView/XView.cpp \
+*		../libraries/XView/XRootView.cpp ../libraries/XFont/XFont.cpp \
+*		../libraries/DisplayController/DisplayController.cpp \
+*		../libraries/DisplayController/MemoryDisplay.cpp \
+*		../libraries/XFont/XFont16BitDataStream.cpp \
+*		../libraries/XFont/XFontGlyphCache.cpp \
+*		../libraries/DataStream/DataStream.cpp -o KeyScanReplay
+*
+*	Usage: KeyScanReplay [options] file.h ...
+*		-k name		Use key spec name (Schlage, Kwikset) rather than the
+*					spec recorded in each file.
+*		-T path		Load the keyways in the binary keyway file path (as
+*					loaded by the board from Keyways.bin on SD.)  The specs
+*					are found by name.
+*		-M path		Make Keyways.bin in the current directory from the
+*					keyway text file path (see MakeKeywayFile.)  Files are
+*					optional when -M is used.
+*		-c value	Override the centers scale.
+*		-d value	Override the depths scale.
+*		-t value	Override the pin tolerance.
+*		-r count	Decode each scan count times (for timing.)
+*		-l			Decode each scan as it's done on the board, while the
+*					lines of the window (see -w) are being received
+*					(XKeyView::StreamKeyData.)  The summary includes the
+*					number of decodes finished by the last line, and the
+*					decode time from the last line to the result.
+*		-a			Also print the cut key command string of each alternate
+*					code, most likely first.
+*		-i			Identify the keyway: rank all of the keyways (built in
+*					and -T) by how well each scan fits them
+*					(XKeyView::RankKeySpecs), and print the three best with
+*					their fit costs.  The summary includes the number of
+*					scans whose best keyway is the keyway recorded in the
+*					file, and the ranking time.
+*		-v			Dump the decode details of each scan to stderr.
+*		-q			Only print the summary.
+*		-K code		Calibrate: solve the centers and depths scales from each
+*					scan, the scan of a key of the given code (bow to tip.)
+*		-s count	Benchmark the hi-res line scanner (YUYVLineScanner) on
+*					count synthetic lines, comparing the scalar and packed
+*					scans.  Files are optional when -s is used.
+*		-b count	Benchmark the hi-res line ring (LineRing) by passing
+*					count synthetic lines from a producer thread (the DMA)
+*					to a consumer thread (PendSV), with and without consumer
+*					stalls, then check that the lines lost from frames,
+*					including the last lines of a frame, are reported
+*					(LineFrameTracker.)  Files are optional when -b is used.
+*		-g count	Benchmark copying count synthetic preview lines to the
+*					display in each preview format (RGB565, B&W and
+*					grayscale, see PreviewLine.h.)  Files are optional
+*					when -g is used.
+*		-e			Score synthetic preview frames of a key blade at
+*					increasing tilts, motionless and moved, with the key
+*					half out, and without a key (see PreviewAlign.)  Files are optional when -e is
+*					used.
+*		-p			Count the I2C transactions and bytes needed to program
+*					the camera registers for a preview and a scan, one
+*					register per transaction, then with burst writes and
+*					the shadow cache (see RegWriter.)  Then check that a
+*					write that isn't acknowledged is written again by a
+*					retry.  Files are optional when -p is used.
+*		-f dir		Render each decoded scan as drawn by XKeyView into a
+*					MemoryDisplay.  If dir holds an image of the scan
+*					(the file name with a .ppm extension) the rendering is
+*					compared to it, otherwise the image is written.  The
+*					summary includes the pixels written and the window
+*					commands sent per rendering, the glyph cache hits and
+*					misses, and the number of renderings that match their
+*					image.
+*		-F count	Benchmark the font: count passes over a set of UI
+*					strings, timing the glyph lookup (XFont::FindGlyph,
+*					direct index, and the charcode run search it replaces
+*					for ASCII and Latin-1), then MeasureStr and DrawStr
+*					(into a MemoryDisplay, without and with the glyph
+*					cache) in strings per second.  The lookups must agree
+*					for every charcode.  Files are optional when -F is
+*					used.
+*		-w window	Decode each scan as if captured with the DCMI crop
+*					window first,count[,column,columns] (see HiResWindow.)
+*					The lines outside of the window are replaced as done by
+*					DCMI_OV5640.  The columns are only modeled for scans
+*					saved in dual-edge mode.  The summary includes the
+*					number of scans whose windowed decode matches the full
+*					frame decode.
+*		-S dir,count[,centersScale[,noise[,seed]]]
+*					Write count synthetic scans of keys with random codes
+*					to dir, named NN_code.h (see MakeSyntheticScans), then
+*					decode any files given.  The key spec is -k, otherwise
+*					Schlage.  The scans are modeled as captured with
+*					centersScale (default 6405) while the files record the
+*					default, so other scales model a reader that isn't
+*					calibrated.  Noise is the line width standard deviation
+*					in pixels (default 1.0), seed defaults to 1.  The same
+*					arguments always write the same scans.  When decoding
+*					files named this way, the summary includes the number of
+*					scans decoded to the code in their file name.  Files are
+*					optional when -S is used.
+*
+*	For each file one line is printed: the file path followed by the cut key
+*	command string (as sent to the Key Code Cutter), or the reason the scan
+*	couldn't be decoded.  A summary with the decode timing follows.
+*
+*	When calibrating, the solved scales are printed rather than the cut key
+*	command string, followed by their mean over all of the scans.
+*
+*	Scans saved in sub-pixel mode are decoded using their sub-pixel widths.
+*	Scans saved in dual-edge mode have their skew removed.
+*/
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "ScanDataFile.h"
+#include "HiResWindow.h"
+#include "YUYVLineScanner.h"
+#include "LineRing.h"
+#include "OV5640.h"
+#include "RegWriter.h"
+#include "PreviewLine.h"
+#include "PreviewAlign.h"
+#include "XKeyView.h"
+#include "XRootView.h"
+#include "MemoryDisplay.h"
+#include "XFontGlyphCache.h"
+#include "KeywayTable.h"
+#include "KeySpecs.h"
+
+KeywayTable	keyways;
+
+/*
+*	The key view is only drawn when rendering (-f).  Otherwise the root view
+*	is only needed because XKeyView accesses the display via
+*	XRootView::GetInstance(), which returns a null display.
+*
+*	When rendering, the display is a MemoryDisplay the size of the board's
+*	480x320 display, drawn with the board's font and glyph cache.
+*/
+XFont	xFont;
+XFontGlyphCache	glyphCache;
+#include "pgmspace_stub.h"
+#include "MyriadPro-Regular_20.h"
+XKeyView	keyView(0, 0, 440, 128, 0, nullptr, &MyriadPro_Regular_20::font);
+XRootView	rootView(&keyView);
+MemoryDisplay	memoryDisplay(320, 480);
+
+/********************************** FindKeySpec *******************************/
+static const SKeySpecU32* FindKeySpec(
+	const char*	inName)
+{
+	for (uint32_t i = 0; i < keyways.Count(); i++)
+	{
+		if (strcasecmp(keyways.KeySpec(i).name, inName) == 0)
+		{
+			return(&keyways.KeySpec(i));
+		}
+	}
+	return(nullptr);
+}
+
+/******************************* MakeKeywayFile *******************************/
+/*
+*	Converts a keyway text file to the binary keyway file loaded by the board
+*	(see KeywayTable.)  Each line of the text file is one keyway, blank lines
+*	and lines starting with # are ignored:
+*
+*	tag, name, pins, depths, deepest cut index, deepest cut, depth increment,
+*		first pin center, pin spacing[, depth ...]
+*
+*	tag is the keyway menu item tag, 1 to 255.  1 and 2 are the built in
+*	Kwikset and Schlage keyways, using these tags replaces them.  name is the
+*	menu item string (at most 19 characters.)  The lengths are in inches.
+*	The optional depths are the root depths from the deepest cut to the
+*	shallowest for keyways whose depths aren't evenly spaced, the depth
+*	increment is then ignored.  Example:
+*
+*	2, Schlage SC1, 5, 10, 9, .2000, .0150, .2310, .1562
+*/
+static bool MakeKeywayFile(
+	const char*	inTextPath,
+	const char*	inBinaryPath)
+{
+	FILE*	textFile = fopen(inTextPath, "r");
+	if (!textFile)
+	{
+		fprintf(stderr, "Unable to open %s\n", inTextPath);
+		return(false);
+	}
+	SKeywayRecord	record[KeywayTable::kMaxKeyways];
+	SKeywayFileHeader	header = {{'K','W','Y','1'}, 0, sizeof(SKeywayRecord)};
+	char	line[512];
+	uint32_t	lineNum = 0;
+	bool	success = true;
+	while (fgets(line, sizeof(line), textFile))
+	{
+		lineNum++;
+		char*	field = line + strspn(line, " \t");
+		if (*field == '#' || *field == '\n' || *field == '\r' || *field == 0)
+		{
+			continue;
+		}
+		if (header.count == KeywayTable::kMaxKeyways)
+		{
+			fprintf(stderr, "%s:%u More than %u keyways\n", inTextPath,
+									lineNum, (uint32_t)KeywayTable::kMaxKeyways);
+			success = false;
+			break;
+		}
+		SKeywayRecord&	thisRecord = record[header.count];
+		memset(&thisRecord, 0, sizeof(SKeywayRecord));
+		char*	values[9 + SKeySpecU32::kMaxPinDepths];
+		uint32_t	numValues = 0;
+		for (char* value = strtok(field, ",\r\n"); value &&
+				numValues < sizeof(values)/sizeof(char*); value = strtok(nullptr, ",\r\n"))
+		{
+			values[numValues++] = value + strspn(value, " \t");
+		}
+		if (numValues >= 9)
+		{
+			thisRecord.tag = (uint16_t)strtoul(values[0], nullptr, 0);
+			char*	nameEnd = values[1] + strlen(values[1]);
+			while (nameEnd > values[1] &&
+				(nameEnd[-1] == ' ' || nameEnd[-1] == '\t'))
+			{
+				nameEnd--;
+			}
+			*nameEnd = 0;
+			strncpy(thisRecord.name, values[1], sizeof(thisRecord.name)-1);
+			thisRecord.numPins = (uint8_t)strtoul(values[2], nullptr, 0);
+			thisRecord.numPinDepths = (uint8_t)strtoul(values[3], nullptr, 0);
+			thisRecord.deepestCutIndex = (uint8_t)strtoul(values[4], nullptr, 0);
+			thisRecord.deepestCut = (uint32_t)(strtod(values[5], nullptr) * 1e7 + 0.5);
+			thisRecord.pinDepthInc = (uint32_t)(strtod(values[6], nullptr) * 1e7 + 0.5);
+			thisRecord.firstPinCenter = (uint32_t)(strtod(values[7], nullptr) * 1e7 + 0.5);
+			thisRecord.pinSpacing = (uint32_t)(strtod(values[8], nullptr) * 1e7 + 0.5);
+			for (uint32_t i = 9; i < numValues; i++)
+			{
+				thisRecord.pinDepth[i-9] = (uint32_t)(strtod(values[i], nullptr) * 1e7 + 0.5);
+			}
+		}
+		SKeySpecU32	keySpec;
+		if (numValues < 9 ||
+			(numValues > 9 && numValues - 9 != thisRecord.numPinDepths) ||
+			!KeywayTable::RecordToKeySpec(thisRecord, keySpec))
+		{
+			fprintf(stderr, "%s:%u Invalid keyway\n", inTextPath, lineNum);
+			success = false;
+			break;
+		}
+		header.count++;
+	}
+	fclose(textFile);
+	if (success)
+	{
+		FILE*	binaryFile = fopen(inBinaryPath, "wb");
+		success = binaryFile &&
+			fwrite(&header, sizeof(header), 1, binaryFile) == 1 &&
+			fwrite(record, sizeof(SKeywayRecord), header.count, binaryFile) == header.count;
+		if (binaryFile)
+		{
+			fclose(binaryFile);
+		}
+		if (success)
+		{
+			printf("%u keyways written to %s\n", (uint32_t)header.count, inBinaryPath);
+		} else
+		{
+			fprintf(stderr, "Unable to write %s\n", inBinaryPath);
+		}
+	}
+	return(success);
+}
+
+/****************************** MakeSyntheticScans ****************************/
+/*
+*	Writes inCount synthetic hi-res scans of inKeySpec keys with random codes
+*	to inDir, named NN_code.h, in the format saved by the board.  The scans
+*	are modeled as captured with a centers scale of inCentersScale while the
+*	file records the XKeyView default, so a scale other than the default
+*	models a reader that isn't calibrated.  Gaussian noise with a standard
+*	deviation of inNoise is added to each line width.  The same inSeed
+*	always writes the same scans.
+*
+*	Adjacent cuts are limited to the keyway's maximum adjacent cut
+*	specification (MACS), the flat at the root of each cut is the keyway's
+*	flat width.  Keyways other than Kwikset and Schlage have no MACS limit
+*	and a .0200 flat.
+*/
+struct SSyntheticKeyway
+{
+	const char*	name;
+	uint32_t	macs;
+	uint32_t	flatWidth;	// inches * 10,000,000
+};
+
+static bool MakeSyntheticScans(
+	const SKeySpecU32*	inKeySpec,
+	const char*			inDir,
+	uint32_t			inCount,
+	uint32_t			inCentersScale,
+	double				inNoise,
+	uint32_t			inSeed)
+{
+	static const SSyntheticKeyway	kKeyways[] =
+	{
+		{"Kwikset", 4, 250000},
+		{"Schlage", 7, 155000}
+	};
+	const uint32_t	kFrameLines = 1918;
+	const uint32_t	kShoulderLine = 1960;	// Off frame, bow side
+	const double	kBladeWidth = 3400000;	// inches * 10,000,000
+	const double	kFlankSlope = 0.81;		// Line width change per line
+	uint32_t	numPins = inKeySpec->numPins;
+	uint32_t	macs = inKeySpec->numPinDepths - 1;
+	double		flatWidth = 200000;
+	for (uint32_t i = 0; i < sizeof(kKeyways)/sizeof(SSyntheticKeyway); i++)
+	{
+		if (strcasecmp(kKeyways[i].name, inKeySpec->name) == 0)
+		{
+			macs = kKeyways[i].macs;
+			flatWidth = kKeyways[i].flatWidth;
+			break;
+		}
+	}
+	uint32_t	defaultCentersScale = keyView.GetCentersScale();
+	uint32_t	depthsScale = keyView.GetDepthsScale();
+	double		centersScale = inCentersScale;
+	/*
+	*	The mt19937 sequence is the same on every host.  The distributions of
+	*	the standard library aren't, so they're done here.
+	*/
+	std::mt19937	random(inSeed);
+	auto	randomIndex = [&random](uint32_t inRange)
+				{return((uint32_t)(random() % inRange));};
+	auto	randomGaussian = [&random](void)
+				{
+					double	u1 = (random() + 1.0) / 4294967296.0;
+					double	u2 = random() / 4294967296.0;
+					return(sqrt(-2 * log(u1)) * cos(2 * M_PI * u2));
+				};
+	uint16_t	keyData[kFrameLines];
+	char		path[1024];
+	for (uint32_t n = 0; n < inCount; n++)
+	{
+		/*
+		*	depthIndex is the index of each cut's root depth, from the
+		*	deepest (see SKeySpecU32::PinDepth.)
+		*/
+		uint32_t	depthIndex[SKeySpecU32::kMaxPins];
+		char		code[SKeySpecU32::kMaxPins+1];
+		for (uint32_t k = 0; k < numPins; k++)
+		{
+			do
+			{
+				depthIndex[k] = randomIndex(inKeySpec->numPinDepths);
+			} while (k && (uint32_t)abs((int32_t)depthIndex[k] -
+									(int32_t)depthIndex[k-1]) > macs);
+			code[k] = (char)('0' + (int32_t)inKeySpec->deepestCutIndex +
+							((int32_t)depthIndex[k] * inKeySpec->CutIndexInc()));
+		}
+		code[numPins] = 0;
+		double	shoulder = kShoulderLine + (int32_t)randomIndex(81) - 40;
+		double	center[SKeySpecU32::kMaxPins];
+		for (uint32_t k = 0; k < numPins; k++)
+		{
+			center[k] = shoulder - (inKeySpec->firstPinCenter +
+							(k * inKeySpec->pinSpacing)) / centersScale;
+		}
+		double	flatHalf = flatWidth / centersScale;
+		double	tipCenter = center[numPins-1];
+		for (uint32_t i = 0; i < kFrameLines; i++)
+		{
+			double	width = kBladeWidth / depthsScale;
+			for (uint32_t k = 0; k < numPins; k++)
+			{
+				double	root = (double)inKeySpec->PinDepth(depthIndex[k]) /
+													depthsScale;
+				double	fromFlat = fabs(i - center[k]) - flatHalf;
+				if (fromFlat > 0)
+				{
+					root += fromFlat * kFlankSlope * centersScale /
+												defaultCentersScale;
+				}
+				if (root < width)
+				{
+					width = root;
+				}
+			}
+			/*
+			*	The tip tapers to nothing past the last cut.
+			*/
+			if (i < tipCenter - 200)
+			{
+				double	taper = (i - (tipCenter - 420)) * 1.2;
+				taper = taper > 0 ? taper : 0;
+				if (taper < width)
+				{
+					width = taper;
+				}
+			}
+			width = floor(width + (randomGaussian() * inNoise) + 0.5);
+			keyData[i] = width > 0 ? (uint16_t)width : 0;
+		}
+		snprintf(path, sizeof(path), "%s/%02u_%s.h", inDir, n, code);
+		FILE*	file = fopen(path, "w");
+		if (!file)
+		{
+			fprintf(stderr, "Unable to write %s\n", path);
+			return(false);
+		}
+		fprintf(file, "/*\n*\t%s Pin Depths:\n*\n*\tCenters Scale = %u, "
+				"Depths Scale = %u, Tolerance = %u\n*/\n"
+				"const uint16_t kTestKey[] = {\n", inKeySpec->name,
+				defaultCentersScale, depthsScale, keyView.GetTolerance());
+		for (uint32_t i = 0; i < kFrameLines; i++)
+		{
+			fprintf(file, i ? ", %u" : "%u", keyData[i]);
+		}
+		fprintf(file, "};\n");
+		fclose(file);
+	}
+	printf("%u %s scans written to %s, Centers Scale = %u, noise = %.1f, "
+			"seed = %u\n", inCount, inKeySpec->name, inDir, inCentersScale,
+			inNoise, inSeed);
+	return(true);
+}
+
+/******************************** FileNameCode ********************************/
+/*
+*	Returns the code in the name of a file written by MakeSyntheticScans
+*	(NN_code.h) in outCode, or false if inPath isn't named this way.
+*/
+static bool FileNameCode(
+	const char*	inPath,
+	char*		outCode,
+	uint32_t	inCodeSize)
+{
+	const char*	name = strrchr(inPath, '/');
+	name = name ? name + 1 : inPath;
+	const char*	code = strchr(name, '_');
+	const char*	ext = strrchr(name, '.');
+	if (!code ||
+		!ext ||
+		strcmp(ext, ".h") != 0 ||
+		ext - code - 1 < 1 ||
+		(uint32_t)(ext - code) > inCodeSize)
+	{
+		return(false);
+	}
+	for (const char* c = name; c < code; c++)
+	{
+		if (*c < '0' || *c > '9')
+		{
+			return(false);
+		}
+	}
+	uint32_t	codeLen = 0;
+	for (code++; code < ext; code++)
+	{
+		if (*code < '0' || *code > '9')
+		{
+			return(false);
+		}
+		outCode[codeLen++] = *code;
+	}
+	outCode[codeLen] = 0;
+	return(true);
+}
+
+/***************************** MakeSyntheticLine ******************************/
+/*
+*	Fills ioLine with a YUYV line similar to a hi-res line: black till the
+*	edge of the light, a white band, the black key blade, then white.  Noise
+*	is added to the luminance, the chroma bytes are random.
+*/
+static void MakeSyntheticLine(
+	uint16_t*	ioLine,
+	uint32_t	inLineLen)
+{
+	uint32_t	lightStart = 20 + (rand() % 100);
+	uint32_t	keyStart = lightStart + 150 + (rand() % 150);
+	uint32_t	keyEnd = keyStart + 100 + (rand() % 350);
+	for (uint32_t i = 0; i < inLineLen; i++)
+	{
+		int32_t	luminance = (i < lightStart || (i >= keyStart && i < keyEnd)) ?
+									40 : 230;
+		luminance += (rand() % 41) - 20;
+		ioLine[i] = (uint16_t)(((rand() & 0xFF) << 8) | luminance);
+	}
+}
+
+/****************************** ScannerBenchmark ******************************/
+static bool ScannerBenchmark(
+	uint32_t	inLineCount)
+{
+	typedef std::chrono::steady_clock	Clock;
+	const uint32_t	kLineLen = 1000;	// OV5640::kHRXOutputSize
+	const uint32_t	kThreshold = 150;
+	const uint32_t	kWhiteMargin = 10;
+	const uint32_t	kNumLines = 64;
+	static uint16_t	lines[kNumLines][kLineLen] __attribute__((aligned(8)));
+	uint32_t	mismatches = 0;
+	uint32_t	checksum[3] = {0};
+	Clock::duration	scanTime[3] = {Clock::duration(0), Clock::duration(0), Clock::duration(0)};
+	static const char* const	kScanName[] = {"Scalar", "Packed 32", "Packed 64"};
+
+	srand(1);
+	for (uint32_t i = 0; i < kNumLines; i++)
+	{
+		MakeSyntheticLine(lines[i], kLineLen);
+		uint16_t	left[3] = {1, 1, 1};
+		uint16_t	right[3] = {2, 2, 2};
+		YUYVLineScanner::ScanScalar(lines[i], kLineLen, kThreshold, kWhiteMargin, left[0], right[0]);
+		YUYVLineScanner::Scan<uint32_t>(lines[i], kLineLen, kThreshold, kWhiteMargin, left[1], right[1]);
+		YUYVLineScanner::Scan<uint64_t>(lines[i], kLineLen, kThreshold, kWhiteMargin, left[2], right[2]);
+		if (left[0] != left[1] || left[0] != left[2] ||
+			right[0] != right[1] || right[0] != right[2])
+		{
+			mismatches++;
+		}
+	}
+	for (uint32_t scan = 0; scan < 3; scan++)
+	{
+		Clock::time_point	startTime = Clock::now();
+		for (uint32_t i = 0; i < inLineCount; i++)
+		{
+			uint16_t	left = 1;
+			uint16_t	right = 2;
+			const uint16_t*	line = lines[i % kNumLines];
+			switch (scan)
+			{
+				case 0:
+					YUYVLineScanner::ScanScalar(line, kLineLen, kThreshold, kWhiteMargin, left, right);
+					break;
+				case 1:
+					YUYVLineScanner::Scan<uint32_t>(line, kLineLen, kThreshold, kWhiteMargin, left, right);
+					break;
+				default:
+					YUYVLineScanner::Scan<uint64_t>(line, kLineLen, kThreshold, kWhiteMargin, left, right);
+					break;
+			}
+			checksum[scan] += right - left;
+		}
+		scanTime[scan] = Clock::now() - startTime;
+	}
+	for (uint32_t scan = 0; scan < 3; scan++)
+	{
+		double	secs = std::chrono::duration<double>(scanTime[scan]).count();
+		printf("%-10s %.1f ns/line (%.2fx), checksum %u\n", kScanName[scan],
+			(secs * 1e9) / inLineCount,
+			secs > 0 ? std::chrono::duration<double>(scanTime[0]).count() / secs : 0.0,
+			checksum[scan]);
+	}
+	if (mismatches)
+	{
+		printf("%u of %u lines scanned differently\n", mismatches, kNumLines);
+	}
+	return(mismatches == 0);
+}
+
+/****************************** PreviewBenchmark ******************************/
+/*
+*	Times copying count synthetic preview lines to a display data register
+*	(a volatile) in each preview format, as done by
+*	DCMI_OV5640::PreviewLineCompleteCallback.  The grayscale LUT is stretched
+*	from a sparse histogram of the lines, as done for each preview frame.
+*	The stretched LUT must be monotonic, and black and white at the limits.
+*/
+static bool PreviewBenchmark(
+	uint32_t	inLineCount)
+{
+	typedef std::chrono::steady_clock	Clock;
+	const uint32_t	kLineLen = OV5640::kXOutputSize;
+	const uint32_t	kThreshold = 150;
+	const uint32_t	kNumLines = 64;
+	const uint32_t	kBins = 64;
+	static uint16_t	lines[kNumLines][kLineLen] __attribute__((aligned(8)));
+	static volatile uint16_t	displayData;
+	static const char* const	kFormatName[] = {"RGB565", "B&W", "Gray"};
+	Clock::duration	copyTime[3];
+	uint32_t	histogram[kBins] = {0};
+	GrayLUT		grayLUT;
+
+	srand(3);
+	for (uint32_t i = 0; i < kNumLines; i++)
+	{
+		MakeSyntheticLine(lines[i], kLineLen);
+		for (uint32_t j = 0; j < kLineLen; j += 4)
+		{
+			histogram[(lines[i][j] & 0xFF) >> 2]++;
+		}
+	}
+	grayLUT.StretchFromHistogram(histogram, kBins);
+	bool	success = grayLUT.LUT()[grayLUT.Low()] == 0 &&
+						grayLUT.LUT()[grayLUT.High()] == 0xFFFF;
+	for (uint32_t y = 1; y < 256; y++)
+	{
+		// Green has the most resolution
+		if (((grayLUT.LUT()[y] >> 5) & 0x3F) < ((grayLUT.LUT()[y-1] >> 5) & 0x3F))
+		{
+			success = false;
+		}
+	}
+	printf("Gray stretch %u..%u%s\n", grayLUT.Low(), grayLUT.High(),
+				success ? "" : ", LUT is invalid");
+	for (uint32_t format = 0; format < 3; format++)
+	{
+		Clock::time_point	startTime = Clock::now();
+		for (uint32_t i = 0; i < inLineCount; i++)
+		{
+			const uint16_t*	line = lines[i % kNumLines];
+			switch (format)
+			{
+				case 0:
+					PreviewLine::CopyRGB565(line, kLineLen, &displayData);
+					break;
+				case 1:
+					PreviewLine::CopyBW(line, kLineLen, kThreshold, &displayData);
+					break;
+				default:
+					PreviewLine::CopyGray(line, kLineLen, grayLUT.LUT(), &displayData);
+					break;
+			}
+		}
+		copyTime[format] = Clock::now() - startTime;
+	}
+	for (uint32_t format = 0; format < 3; format++)
+	{
+		double	secs = std::chrono::duration<double>(copyTime[format]).count();
+		printf("%-6s %.1f ns/line (%.2fx RGB565)\n", kFormatName[format],
+			(secs * 1e9) / inLineCount,
+			std::chrono::duration<double>(copyTime[0]).count() > 0 ?
+				secs / std::chrono::duration<double>(copyTime[0]).count() : 0.0);
+	}
+	return(success);
+}
+
+/******************************** AlignmentCheck ******************************/
+/*
+*	Scores synthetic preview frames of a key blade at increasing tilts, as
+*	done by DCMI_OV5640::PreviewLineCompleteCallback for each preview frame:
+*	the sample lines are scanned by YUYVLineScanner and the edges found are
+*	passed to PreviewAlign.  The back of the blade is straight, the cuts
+*	are modeled as steps in the front edge.
+*
+*	The score must not increase with the tilt, the untilted blade must be
+*	aligned, and the most tilted blade, a frame without a key, and a key
+*	pulled halfway out must not be.  Repeated frames of a motionless key
+*	(only the noise differs) must count as stable frames, and a key moved
+*	by a few pixels must restart the count.
+*/
+static void MakePreviewFrame(
+	uint16_t*	ioFrame,
+	int32_t		inTilt,			// Pixels per 1000 lines
+	uint32_t	inBladeStart,	// First line of the blade
+	bool		inHasKey,
+	int32_t		inShift = 0)	// Pixels across the line
+{
+	const uint32_t	kLineLen = OV5640::kXOutputSize;
+	for (uint32_t line = 0; line < OV5640::kYOutputSize; line++)
+	{
+		uint16_t*	pixel = &ioFrame[line * kLineLen];
+		int32_t	back = 40 + inShift + ((int32_t)line * inTilt) / 1000;
+		int32_t	front = back + 40 - (int32_t)(((line / 20) % 4) * 4);
+		for (uint32_t i = 0; i < kLineLen; i++)
+		{
+			int32_t	luminance = (inHasKey && line >= inBladeStart &&
+									(int32_t)i >= back && (int32_t)i < front) ? 40 : 220;
+			luminance += (rand() % 21) - 10;
+			pixel[i] = (uint16_t)(((rand() & 0xFF) << 8) | luminance);
+		}
+	}
+}
+
+static bool AlignmentCheck(void)
+{
+	const uint32_t	kLineLen = OV5640::kXOutputSize;
+	const uint32_t	kThreshold = 150;
+	const uint32_t	kWhiteMargin = 1;
+	static const int32_t	kTilts[] = {0, 10, 20, 40, 80};
+	const uint32_t	kNumTilts = sizeof(kTilts)/sizeof(kTilts[0]);
+	static uint16_t	frame[OV5640::kYOutputSize * OV5640::kXOutputSize] __attribute__((aligned(8)));
+	PreviewAlign	previewAlign;
+	PreviewAlign::SAlignment	alignment;
+	bool	success = true;
+
+	auto scoreFrame = [&](void)
+	{
+		for (uint32_t line = 0; line < OV5640::kYOutputSize; line++)
+		{
+			if (PreviewAlign::IsSampleLine(line))
+			{
+				uint16_t	left = 0;
+				uint16_t	right = 0;
+				YUYVLineScanner::Scan<uint32_t>(&frame[line * kLineLen], kLineLen,
+										kThreshold, kWhiteMargin, left, right);
+				previewAlign.AddLine(line, left, right);
+			}
+		}
+		previewAlign.EndFrame();
+		previewAlign.GetAlignment(alignment);
+	};
+
+	srand(5);
+	uint32_t	lastScore = 100;
+	for (uint32_t i = 0; i < kNumTilts; i++)
+	{
+		MakePreviewFrame(frame, kTilts[i], 0, true);
+		scoreFrame();
+		int32_t	tiltError = alignment.tilt - kTilts[i];
+		printf("Tilt %2d: score %3u, tilt %3d%s\n", kTilts[i], alignment.score,
+			alignment.tilt, alignment.IsAligned() ? "" : ", realign");
+		if (alignment.score > lastScore ||
+			tiltError < -2 || tiltError > 2)
+		{
+			success = false;
+		}
+		lastScore = alignment.score;
+		if ((i == 0 && !alignment.IsAligned()) ||
+			(i == kNumTilts-1 && alignment.IsAligned()))
+		{
+			success = false;
+		}
+	}
+	const uint32_t	kStableFrames = 5;
+	for (uint32_t i = 0; i < kStableFrames; i++)
+	{
+		MakePreviewFrame(frame, 10, 0, true);
+		scoreFrame();
+	}
+	uint32_t	stableFrames = alignment.stableFrames;
+	MakePreviewFrame(frame, 10, 0, true, 3);
+	scoreFrame();
+	printf("Stable frames %u, %u after moving\n", stableFrames, alignment.stableFrames);
+	success = success && stableFrames == kStableFrames && alignment.stableFrames == 1;
+	MakePreviewFrame(frame, 0, (PreviewAlign::kFirstLine + PreviewAlign::kEndLine)/2, true);
+	scoreFrame();
+	printf("Half out: score %3u%s\n", alignment.score,
+		alignment.IsAligned() ? "" : ", realign");
+	success = success && !alignment.IsAligned();
+	MakePreviewFrame(frame, 0, 0, false);
+	scoreFrame();
+	printf("No key:   score %3u%s\n", alignment.score,
+		alignment.IsAligned() ? "" : ", realign");
+	success = success && !alignment.IsAligned();
+	if (!success)
+	{
+		printf("Alignment scoring failed\n");
+	}
+	return(success);
+}
+
+/******************************** WindowScanData *******************************/
+/*
+*	Models the key data DCMI_OV5640 would produce had the scan been captured
+*	using the crop window inWindow.  The lines outside of the window are set
+*	as lines where no edge was found (as done by StartHiResStream), and the
+*	lines within the window are copied to their frame line, in the order
+*	they're scanned by DCMI_OV5640::ScanHiResLine.
+*
+*	Cropping the columns is only modeled when the scan has its edges.  A line
+*	whose edges aren't both within the columns of the window is treated as
+*	a line where no edge was found.
+*
+*	Returns false if any line of the window isn't within the scan.
+*/
+static bool WindowScanData(
+	const HiResWindow&	inWindow,
+	const ScanDataFile&	inScanData,
+	uint16_t*			outKeyData,
+	uint32_t*			outKeyDataQ8,
+	uint16_t*			outEdgeLeft,
+	uint16_t*			outEdgeRight)
+{
+	uint32_t	keyDataLen = inScanData.KeyDataLen();
+	bool	success = inWindow.EndLine() <= keyDataLen;
+	if (success)
+	{
+		const uint16_t*	keyData = inScanData.KeyData();
+		const uint32_t*	keyDataQ8 = inScanData.KeyDataQ8();
+		const uint16_t*	edgeLeft = inScanData.EdgeLeft();
+		const uint16_t*	edgeRight = inScanData.EdgeRight();
+		for (uint32_t line = 0; line < keyDataLen; line++)
+		{
+			outKeyData[line] = 2;
+			outKeyDataQ8[line] = 2 << 8;
+			outEdgeLeft[line] = 0;
+			outEdgeRight[line] = 0;
+		}
+		uint32_t	firstColumn = inWindow.FirstColumn();
+		uint32_t	endColumn = firstColumn + inWindow.NumColumns();
+		for (uint32_t windowLine = 0; windowLine < inWindow.NumLines(); windowLine++)
+		{
+			uint32_t	frameLine = inWindow.FrameLine(windowLine);
+			if (edgeLeft &&
+				(edgeLeft[frameLine] < firstColumn ||
+				 edgeRight[frameLine] >= endColumn))
+			{
+				continue;
+			}
+			outKeyData[frameLine] = keyData[frameLine];
+			outKeyDataQ8[frameLine] = keyDataQ8 ? keyDataQ8[frameLine] :
+												(keyData[frameLine] << 8);
+			if (edgeLeft)
+			{
+				outEdgeLeft[frameLine] = edgeLeft[frameLine];
+				outEdgeRight[frameLine] = edgeRight[frameLine];
+			}
+		}
+	}
+	return(success);
+}
+
+/******************************** DecodeLines *********************************/
+/*
+*	The firmware only keeps the sub-pixel widths and the edges of the decode
+*	lines, so XKeyView expects them to start at the first decode line.
+*	Returns the entries of inLineData from the first decode line on.
+*/
+template <class T>
+static const T* DecodeLines(
+	const T*	inLineData)
+{
+	return(inLineData ? inLineData + HiResWindow::kDecodeFirstLine : nullptr);
+}
+
+/******************************* LineFrameCheck *******************************/
+/*
+*	Feeds LineFrameTracker the tags of a run of frames as DCMI_OV5640 would,
+*	dropping lines as the ring does when it's full:  a gap inside a frame,
+*	the last lines of a frame, and only the last line of a frame.  Each frame
+*	must be completed once, in order, reported as an error (sError 3) exactly
+*	when lines of it were lost, with the first line lost.
+*/
+struct FrameCheckHandler
+{
+	static const uint32_t	kMaxFrames = 8;
+	static uint32_t	sFramesCompleted;
+	static uint32_t	sCompletedIndex[kMaxFrames];
+	static uint32_t	sErrorLine[kMaxFrames];	// kNoError when none
+	static uint32_t	sLinesScanned;
+	static const uint32_t	kNoError = 0xFFFF;
+	static void		LinesLost(
+						uint32_t				inFrameIndex,
+						uint32_t				inFirstLostLine)
+					{
+						if (inFrameIndex < kMaxFrames &&
+							sErrorLine[inFrameIndex] == kNoError)
+						{
+							sErrorLine[inFrameIndex] = inFirstLostLine;
+						}
+					}
+	static bool		ScanLine(
+						const uint16_t*			/*inLine*/,
+						uint32_t				/*inWindowLine*/,
+						uint32_t				/*inFrameIndex*/)
+					{
+						sLinesScanned++;
+						return(false);
+					}
+	static void		FrameComplete(
+						uint32_t				inFrameIndex)
+					{
+						if (sFramesCompleted < kMaxFrames)
+						{
+							sCompletedIndex[sFramesCompleted] = inFrameIndex;
+						}
+						sFramesCompleted++;
+					}
+};
+uint32_t	FrameCheckHandler::sFramesCompleted;
+uint32_t	FrameCheckHandler::sCompletedIndex[kMaxFrames];
+uint32_t	FrameCheckHandler::sErrorLine[kMaxFrames];
+uint32_t	FrameCheckHandler::sLinesScanned;
+
+static bool LineFrameCheck(void)
+{
+	const uint32_t	kNumLines = 16;
+	const uint32_t	kNumFrames = 5;
+	/*
+	*	The lines of each frame lost, [gapStart, gapEnd).  As in DCMI_OV5640
+	*	the first frame is frame 0.  Frame 1 has a gap, frame 2 lost its
+	*	last lines and frame 3 lost its last line.  Frame 4 is complete, so
+	*	that frame 3 is followed by a frame.
+	*/
+	static const struct
+	{
+		uint32_t	frameIndex;
+		uint32_t	gapStart;
+		uint32_t	gapEnd;
+		uint32_t	expectedErrorLine;
+	} kFrames[kNumFrames] =
+	{
+		{0, 0, 0, FrameCheckHandler::kNoError},
+		{1, 5, 9, 5},
+		{2, 11, kNumLines, 11},
+		{3, kNumLines - 1, kNumLines, kNumLines - 1},
+		{4, 0, 0, FrameCheckHandler::kNoError}
+	};
+	LineFrameTracker	tracker;
+	uint32_t	linesFed = 0;
+	FrameCheckHandler::sFramesCompleted = 0;
+	FrameCheckHandler::sLinesScanned = 0;
+	for (uint32_t i = 0; i < FrameCheckHandler::kMaxFrames; i++)
+	{
+		FrameCheckHandler::sErrorLine[i] = FrameCheckHandler::kNoError;
+	}
+	for (uint32_t f = 0; f < kNumFrames; f++)
+	{
+		for (uint32_t line = 0; line < kNumLines; line++)
+		{
+			if (line >= kFrames[f].gapStart && line < kFrames[f].gapEnd)
+			{
+				continue;
+			}
+			tracker.Line<FrameCheckHandler>(nullptr,
+						(kFrames[f].frameIndex << 16) | line, kNumLines);
+			linesFed++;
+		}
+	}
+	bool	success = FrameCheckHandler::sFramesCompleted == kNumFrames &&
+						FrameCheckHandler::sLinesScanned == linesFed;
+	for (uint32_t f = 0; success && f < kNumFrames; f++)
+	{
+		uint32_t	frameIndex = kFrames[f].frameIndex;
+		success = FrameCheckHandler::sCompletedIndex[f] == frameIndex &&
+			FrameCheckHandler::sErrorLine[frameIndex] == kFrames[f].expectedErrorLine;
+	}
+	printf("Lost line frames: %u of %u frames completed, %s\n",
+			FrameCheckHandler::sFramesCompleted, kNumFrames,
+			success ? "lost lines reported" : "lost lines NOT reported as expected");
+	return(success);
+}
+
+/******************************** RingBenchmark *******************************/
+/*
+*	Drives a LineRing from two threads the way DCMI_OV5640 does.  The producer
+*	thread plays the DMA in double buffer mode: it fills the slots of its two
+*	memory targets with synthetic lines, one per line time, publishes each,
+*	and acquires the next slot for the target (or uses the overrun line when
+*	the ring is full.)  The consumer thread plays PendSV: it scans each line
+*	published, then releases it.  Every 100 lines the consumer stalls for a
+*	number of line times (as when preempted), while holding its slot.  The
+*	line time is 4 times the mean scan time so that the consumer catches up
+*	between stalls.
+*
+*	Each line scanned must have the edges of the line its tag says it is (the
+*	slot wasn't overwritten before it was released), and the number of lines
+*	missing from the tags must equal the ring's overrun count.  The timing is
+*	only representative when the host has more than one CPU.
+*/
+static bool RingBenchmark(
+	uint32_t	inLineCount)
+{
+	typedef std::chrono::steady_clock	Clock;
+	const uint32_t	kLineLen = 1000;	// OV5640::kHRXOutputSize
+	const uint32_t	kThreshold = 150;
+	const uint32_t	kWhiteMargin = 10;
+	const uint32_t	kNumLines = 64;
+	const uint32_t	kStallInterval = 100;
+	typedef LineRing<8, kLineLen> BenchLineRing;	// As DCMI_OV5640::HiResLineRing
+	static BenchLineRing	ring;
+	static uint16_t	lines[kNumLines][kLineLen] __attribute__((aligned(8)));
+	static uint16_t	overrunLine[kLineLen] __attribute__((aligned(8)));
+	uint16_t	expectedLeft[kNumLines];
+	uint16_t	expectedRight[kNumLines];
+	static const uint32_t	kStallLineTimes[] = {0, 4, 12};
+	bool	success = true;
+
+	if (std::thread::hardware_concurrency() < 2)
+	{
+		printf("Single CPU, the threads take turns (the overruns are not representative)\n");
+	}
+	srand(2);
+	for (uint32_t i = 0; i < kNumLines; i++)
+	{
+		MakeSyntheticLine(lines[i], kLineLen);
+		expectedLeft[i] = 1;
+		expectedRight[i] = 2;
+		YUYVLineScanner::Scan<uint32_t>(lines[i], kLineLen, kThreshold,
+							kWhiteMargin, expectedLeft[i], expectedRight[i]);
+	}
+	/*
+	*	The line time from the mean scan time.
+	*/
+	Clock::duration	lineTime;
+	{
+		const uint32_t	kTimedScans = 8192;
+		uint32_t	checksum = 0;
+		Clock::time_point	startTime = Clock::now();
+		for (uint32_t i = 0; i < kTimedScans; i++)
+		{
+			uint16_t	left = 1;
+			uint16_t	right = 2;
+			YUYVLineScanner::Scan<uint32_t>(lines[i % kNumLines], kLineLen,
+								kThreshold, kWhiteMargin, left, right);
+			checksum += right - left;
+		}
+		lineTime = ((Clock::now() - startTime) * 4) / kTimedScans;
+		if (checksum == 0)
+		{
+			lineTime++;
+		}
+	}
+	for (uint32_t run = 0; run < sizeof(kStallLineTimes)/sizeof(uint32_t); run++)
+	{
+		Clock::duration	stallTime = lineTime * kStallLineTimes[run];
+		std::atomic<bool>	producerDone(false);
+		uint32_t	linesScanned = 0;
+		uint32_t	linesMissing = 0;
+		uint32_t	mismatches = 0;
+		uint32_t	maxPending = 0;
+		ring.Reset();
+		Clock::time_point	startTime = Clock::now();
+		std::thread	consumer([&]()
+		{
+			uint32_t	nextTag = 0;
+			uint32_t	tag;
+			for (;;)
+			{
+				const uint16_t*	line = ring.Peek(tag);
+				if (!line)
+				{
+					if (!producerDone.load(std::memory_order_acquire))
+					{
+						std::this_thread::yield();
+						continue;
+					}
+					// The producer may have published after the first Peek
+					line = ring.Peek(tag);
+					if (!line)
+					{
+						break;
+					}
+				}
+				uint32_t	pending = ring.Pending();
+				if (pending > maxPending)
+				{
+					maxPending = pending;
+				}
+				linesMissing += tag - nextTag;
+				nextTag = tag + 1;
+				uint16_t	left = 1;
+				uint16_t	right = 2;
+				YUYVLineScanner::Scan<uint32_t>(line, kLineLen, kThreshold,
+												kWhiteMargin, left, right);
+				if (left != expectedLeft[tag % kNumLines] ||
+					right != expectedRight[tag % kNumLines])
+				{
+					mismatches++;
+				}
+				linesScanned++;
+				if (stallTime.count() &&
+					(tag % kStallInterval) == 0)
+				{
+					Clock::time_point	stallEnd = Clock::now() + stallTime;
+					while (Clock::now() < stallEnd){}
+				}
+				ring.Release();
+			}
+			linesMissing += inLineCount - nextTag;
+		});
+		/*
+		*	The producer, this thread.
+		*/
+		{
+			uint16_t*	targetBuf[2];
+			bool		targetHasSlot[2];
+			for (uint32_t target = 0; target < 2; target++)
+			{
+				uint32_t	slot;
+				targetHasSlot[target] = ring.Acquire(slot);
+				targetBuf[target] = targetHasSlot[target] ? ring.Slot(slot) : overrunLine;
+			}
+			Clock::time_point	lineEnd = Clock::now();
+			for (uint32_t i = 0; i < inLineCount; i++)
+			{
+				uint32_t	target = i & 1;
+				memcpy(targetBuf[target], lines[i % kNumLines], kLineLen * sizeof(uint16_t));
+				lineEnd += lineTime;
+				while (Clock::now() < lineEnd)
+				{
+					std::this_thread::yield();
+				}
+				if (targetHasSlot[target])
+				{
+					ring.Publish(i);
+				}
+				/*
+				*	The last two lines have been given their buffers.
+				*/
+				if (i + 2 < inLineCount)
+				{
+					uint32_t	slot;
+					targetHasSlot[target] = ring.Acquire(slot);
+					targetBuf[target] = targetHasSlot[target] ? ring.Slot(slot) : overrunLine;
+				}
+			}
+			producerDone.store(true, std::memory_order_release);
+		}
+		consumer.join();
+		double	secs = std::chrono::duration<double>(Clock::now() - startTime).count();
+		printf("Stall %2u line times: %u lines in %.1f ms (%.0f ns line time), "
+				"%u scanned, %u overruns, max %u pending, %u mismatches\n",
+				kStallLineTimes[run], inLineCount, secs * 1e3,
+				std::chrono::duration<double>(lineTime).count() * 1e9,
+				linesScanned, ring.Overruns(), maxPending, mismatches);
+		if (linesMissing != ring.Overruns() ||
+			linesScanned + linesMissing != inLineCount)
+		{
+			printf("Lines missing (%u) doesn't match the overruns\n", linesMissing);
+			success = false;
+		}
+		success = success && mismatches == 0;
+	}
+	return(LineFrameCheck() && success);
+}
+
+/********************************* CountingWire *******************************/
+/*
+*	TwoWire stand-in that counts the write transactions and bytes (including
+*	the device address byte), and models the camera registers:  each
+*	transaction writes its values starting at its register address, the
+*	address auto-incrementing.  A software reset clears the registers.  The
+*	transaction set by FailTransaction isn't acknowledged (as when NACKed or
+*	timed out), and its registers are left unchanged.
+*/
+class CountingWire
+{
+public:
+							CountingWire(void)
+								{Reset();}
+	void					Reset(void)
+								{
+									memset(mRegs, 0, sizeof(mRegs));
+									mTransactions = 0;
+									mBytes = 0;
+									mFailTransaction = 0;
+								}
+	/*
+	*	inTransaction is the number of the transaction since Reset, from 1.
+	*	0 = none.
+	*/
+	void					FailTransaction(
+								uint32_t				inTransaction)
+								{mFailTransaction = inTransaction;}
+	void					beginTransmission(
+								uint8_t					/*inDeviceAddr*/)
+								{mLength = 0;}
+	size_t					write(
+								uint8_t					inByte)
+								{
+									if (mLength < sizeof(mBuffer))
+									{
+										mBuffer[mLength++] = inByte;
+									}
+									return(1);
+								}
+	uint8_t					endTransmission(
+								bool					/*inSendStop*/)
+								{
+									mTransactions++;
+									mBytes += mLength + 1;
+									if (mTransactions == mFailTransaction)
+									{
+										return(2);	// NACK on transmit of address
+									}
+									uint16_t	address = (mBuffer[0] << 8) | mBuffer[1];
+									for (uint32_t i = 2; i < mLength; i++, address++)
+									{
+										if (address == 0x3008 &&
+											(mBuffer[i] & 0x80))
+										{
+											memset(mRegs, 0, sizeof(mRegs));
+										}
+										mRegs[address] = mBuffer[i];
+									}
+									return(0);
+								}
+	const uint8_t*			Regs(void) const
+								{return(mRegs);}
+	uint32_t				Transactions(void) const
+								{return(mTransactions);}
+	uint32_t				Bytes(void) const
+								{return(mBytes);}
+protected:
+	uint8_t		mBuffer[32];	// As the Wire tx buffer
+	uint32_t	mLength;
+	uint32_t	mTransactions;
+	uint32_t	mBytes;
+	uint32_t	mFailTransaction;
+	uint8_t		mRegs[0x10000];
+};
+
+/****************************** ProgramScanArrays *****************************/
+/*
+*	Writes the register arrays of a hi-res scan as UpdateScanState does,
+*	8 registers per Update (kRegsPerUpdate), so a run can be split.
+*/
+static void ProgramScanArrays(
+	RegWriter<CountingWire>&	inRegWriter)
+{
+	const uint16_t*	regArray[] = {OV5640::kCommonInit, OV5640::kHiResExposure,
+									OV5640::kHiResInit};
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		const uint16_t*	regs = regArray[i];
+		while (*regs)
+		{
+			regs = inRegWriter.WriteRegArray(regs, 8);
+		}
+	}
+}
+
+/******************************** ProgramPreview ******************************/
+/*
+*	Writes the registers of a YUV preview (see InitPreviewStream.)
+*/
+static void ProgramPreview(
+	RegWriter<CountingWire>&	inRegWriter)
+{
+	inRegWriter.WriteReg(0x3103, 0x11);
+	inRegWriter.WriteReg(0x3008, 0x82);
+	inRegWriter.WriteRegArray(OV5640::kCommonInit);
+	inRegWriter.WriteReg(0x4300, 0x30);
+	inRegWriter.WriteReg(0x501F, 0x00);
+	inRegWriter.WriteReg(0x3503, 0x07);
+	inRegWriter.WriteReg(0x3501, 0x20);
+	inRegWriter.WriteReg(0x3502, 0x00);
+	inRegWriter.WriteReg(0x350B, 0x10);
+	inRegWriter.WriteRegArray(OV5640::kPreviewInit);
+	inRegWriter.WriteReg(0x3008, 0x42);
+}
+
+/******************************** ProgramCamera *******************************/
+/*
+*	Writes the registers as DCMI_OV5640 does for a YUV preview (see
+*	InitPreviewStream) followed by a hi-res scan (see UpdateScanState.)  Each
+*	starts with a software reset (see ResetCamera.)
+*/
+static void ProgramCamera(
+	RegWriter<CountingWire>&	inRegWriter)
+{
+	ProgramPreview(inRegWriter);
+	inRegWriter.WriteReg(0x3103, 0x11);
+	inRegWriter.WriteReg(0x3008, 0x82);
+	ProgramScanArrays(inRegWriter);
+}
+
+/****************************** RegWriterCompare ******************************/
+/*
+*	Programs the camera registers (ProgramCamera) one register per
+*	transaction without the shadow cache, as originally done, then with
+*	burst writes and the shadow cache, each through a CountingWire.  The
+*	transactions and bytes of both are printed.  The registers of both must
+*	end up the same.
+*
+*	Then each transaction of the scan arrays in turn isn't acknowledged.
+*	Writing the scan arrays again without a software reset (as a retry does)
+*	must write the registers of the failed transaction, the shadow cache
+*	mustn't hold the values that weren't written.
+*/
+static bool RegWriterCompare(void)
+{
+	static CountingWire	singleWire;
+	static CountingWire	burstWire;
+	static RegWriter<CountingWire>	singleWriter(singleWire, 0x3C);
+	static RegWriter<CountingWire>	burstWriter(burstWire, 0x3C);
+	singleWriter.SetMaxBurstLen(1);
+	singleWriter.SetShadowEnabled(false);
+	ProgramCamera(singleWriter);
+	ProgramCamera(burstWriter);
+	printf("Single: %u transactions, %u bytes\n", singleWire.Transactions(),
+				singleWire.Bytes());
+	printf("Burst:  %u transactions, %u bytes, %u writes skipped\n",
+				burstWire.Transactions(), burstWire.Bytes(),
+				burstWriter.Skipped());
+	bool	success = burstWriter.Transactions() == burstWire.Transactions() &&
+						burstWriter.Bytes() == burstWire.Bytes();
+	if (!success)
+	{
+		printf("RegWriter counts don't match the wire\n");
+	}
+	if (memcmp(singleWire.Regs(), burstWire.Regs(), 0x10000) != 0)
+	{
+		for (uint32_t address = 0; address < 0x10000; address++)
+		{
+			if (singleWire.Regs()[address] != burstWire.Regs()[address])
+			{
+				printf("Register 0x%04X: 0x%02X, burst 0x%02X\n", address,
+					singleWire.Regs()[address], burstWire.Regs()[address]);
+			}
+		}
+		success = false;
+	}
+	printf("Registers %s\n", success ? "match" : "differ");
+
+	static CountingWire	failWire;
+	static RegWriter<CountingWire>	failWriter(failWire, 0x3C);
+	ProgramPreview(failWriter);
+	failWriter.WriteReg(0x3103, 0x11);
+	failWriter.WriteReg(0x3008, 0x82);
+	uint32_t	firstFailed = failWire.Transactions() + 1;
+	uint32_t	failures = 0;
+	uint32_t	failuresLost = 0;
+	uint32_t	notRewritten = 0;
+	for (uint32_t failed = firstFailed; failed <= burstWire.Transactions(); failed++)
+	{
+		failWire.Reset();
+		failWire.FailTransaction(failed);
+		failWriter.InvalidateShadow();
+		failWriter.ResetStats();
+		ProgramCamera(failWriter);
+		failures += failWriter.Failures();
+		if (memcmp(singleWire.Regs(), failWire.Regs(), 0x10000) != 0)
+		{
+			failuresLost++;
+			ProgramScanArrays(failWriter);
+			if (memcmp(singleWire.Regs(), failWire.Regs(), 0x10000) != 0)
+			{
+				notRewritten++;
+			}
+		}
+	}
+	printf("Failed writes: %u of %u scan transactions failed in turn, "
+				"%u left registers unwritten, %u not rewritten by the retry\n",
+				failures, burstWire.Transactions() - firstFailed + 1,
+				failuresLost, notRewritten);
+	return(success && failures == burstWire.Transactions() - firstFailed + 1 &&
+				failuresLost && notRewritten == 0);
+}
+
+/******************************** FontBenchmark *******************************/
+/*
+*	Times the glyph lookup, MeasureStr and DrawStr of the board's font over a
+*	set of UI strings.  FindGlyph must return the same entry index as the
+*	charcode run search for every charcode.
+*/
+static bool FontBenchmark(
+	uint32_t	inPasses)
+{
+	typedef std::chrono::steady_clock	Clock;
+	static const char* const	kStrings[] =
+	{
+		"10/17/2026", "12:34:56", "29417", "Scan Failed", "Schlage SC1",
+		"Resample 2, err 3 at line 400", "Realign", "2/4", "Tilt -12",
+		"Pin Tolerance", "72\xC2\xB0" "F", "Kwikset KW1\xE2\x80\xA6"
+	};
+	const uint32_t	kNumStrings = sizeof(kStrings)/sizeof(kStrings[0]);
+	XFontGlyphCache*	savedGlyphCache = xFont.GetGlyphCache();
+	xFont.SetDisplay(&memoryDisplay, &MyriadPro_Regular_20::font);
+	xFont.SetGlyphCache(nullptr);
+
+	bool	success = true;
+	for (uint32_t charcode = 0; charcode <= 0xFFFF; charcode++)
+	{
+		if (xFont.FindGlyph(charcode) != xFont.SearchCharcodeRuns(charcode))
+		{
+			printf("Charcode 0x%04X: FindGlyph %u, run search %u\n", charcode,
+				xFont.FindGlyph(charcode), xFont.SearchCharcodeRuns(charcode));
+			success = false;
+		}
+	}
+	/*
+	*	The charcodes of the strings, as decoded by XFont::NextChar.
+	*/
+	uint16_t	charcodes[256];
+	uint32_t	numCharcodes = 0;
+	for (uint32_t i = 0; i < kNumStrings; i++)
+	{
+		const char*	strPtr = kStrings[i];
+		for (uint16_t charcode = XFont::NextChar(strPtr); charcode;
+				charcode = XFont::NextChar(strPtr))
+		{
+			charcodes[numCharcodes++] = charcode;
+		}
+	}
+	volatile uint32_t	sum = 0;	// Keeps the results from being optimized away
+	Clock::duration	lookupTime[2];
+	for (uint32_t search = 0; search < 2; search++)
+	{
+		Clock::time_point	startTime = Clock::now();
+		for (uint32_t pass = 0; pass < inPasses; pass++)
+		{
+			for (uint32_t i = 0; i < numCharcodes; i++)
+			{
+				sum += search ? xFont.SearchCharcodeRuns(charcodes[i]) :
+								xFont.FindGlyph(charcodes[i]);
+			}
+		}
+		lookupTime[search] = Clock::now() - startTime;
+	}
+	Clock::time_point	startTime = Clock::now();
+	for (uint32_t pass = 0; pass < inPasses; pass++)
+	{
+		for (uint32_t i = 0; i < kNumStrings; i++)
+		{
+			uint16_t	height, width;
+			xFont.MeasureStr(kStrings[i], height, width);
+			sum += width;
+		}
+	}
+	Clock::duration	measureTime = Clock::now() - startTime;
+	Clock::duration	drawTime[2];
+	XFontGlyphCache	glyphCache;
+	for (uint32_t cached = 0; cached < 2; cached++)
+	{
+		xFont.SetGlyphCache(cached ? &glyphCache : nullptr);
+		startTime = Clock::now();
+		for (uint32_t pass = 0; pass < inPasses; pass++)
+		{
+			for (uint32_t i = 0; i < kNumStrings; i++)
+			{
+				memoryDisplay.MoveTo((i % 14) * 22, 0);
+				xFont.DrawStr(kStrings[i]);
+			}
+		}
+		drawTime[cached] = Clock::now() - startTime;
+	}
+	xFont.SetGlyphCache(savedGlyphCache);
+
+	double	lookups = (double)inPasses * numCharcodes;
+	double	strings = (double)inPasses * kNumStrings;
+	printf("FindGlyph:  %.1f ns/lookup\n",
+			std::chrono::duration<double>(lookupTime[0]).count() * 1e9 / lookups);
+	printf("Run search: %.1f ns/lookup\n",
+			std::chrono::duration<double>(lookupTime[1]).count() * 1e9 / lookups);
+	printf("MeasureStr: %.0f strings/s\n",
+			strings / std::chrono::duration<double>(measureTime).count());
+	printf("DrawStr:    %.0f strings/s, %.0f strings/s with the glyph cache\n",
+			strings / std::chrono::duration<double>(drawTime[0]).count(),
+			strings / std::chrono::duration<double>(drawTime[1]).count());
+	printf("Lookups %s\n", success ? "match" : "differ");
+	return(success);
+}
+
+/******************************** RenderKeyView *******************************/
+/*
+*	Draws the key view into memoryDisplay, then either compares the rendering
+*	to the image of the scan in inDir, or writes the image when there isn't
+*	one.  Returns false if the image can't be read or written.
+*/
+static bool RenderKeyView(
+	const char*					inPath,
+	const char*					inDir,
+	std::chrono::steady_clock::duration&	ioRenderTime,
+	uint64_t&					ioPixelWrites,
+	uint64_t&					ioWindowCmds,
+	uint32_t&					ioMatches,
+	uint32_t&					ioImagesWritten,
+	bool						inQuiet)
+{
+	typedef std::chrono::steady_clock	Clock;
+	char	imagePath[1024];
+	const char*	name = strrchr(inPath, '/');
+	name = name ? name + 1 : inPath;
+	const char*	extension = strrchr(name, '.');
+	snprintf(imagePath, sizeof(imagePath), "%s/%.*s.ppm", inDir,
+				(int)(extension ? extension - name : strlen(name)), name);
+
+	memoryDisplay.Fill(0);
+	memoryDisplay.ResetCounters();
+	rootView.SetDisplay(&memoryDisplay);
+	Clock::time_point	startTime = Clock::now();
+	/*
+	*	The key view is drawn as the firmware draws it, by invalidating it and
+	*	drawing the invalid area.  Any invalidation by the decode (e.g. a
+	*	status message) is merged, the view is drawn once.
+	*/
+	keyView.Invalidate();
+	rootView.DrawInvalid();
+	ioRenderTime += Clock::now() - startTime;
+	rootView.SetDisplay(nullptr);
+	ioPixelWrites += memoryDisplay.PixelWrites();
+	ioWindowCmds += memoryDisplay.WindowCmds();
+
+	bool	success = true;
+	int32_t	differences = memoryDisplay.ComparePPM(imagePath);
+	if (differences == 0)
+	{
+		ioMatches++;
+	} else if (differences > 0)
+	{
+		if (!inQuiet)
+		{
+			printf("%s\t  Rendering differs from %s by %d pixels\n", inPath,
+					imagePath, differences);
+		}
+	} else if (memoryDisplay.WritePPM(imagePath))
+	{
+		ioImagesWritten++;
+	} else
+	{
+		success = false;
+		fprintf(stderr, "%s\tUnable to write %s\n", inPath, imagePath);
+	}
+	return(success);
+}
+
+/************************************ Usage ***********************************/
+static int Usage(
+	const char*	inToolName)
+{
+	fprintf(stderr, "Usage: %s [-k spec] [-T keyways.bin] [-M keyways.txt] [-c centersScale] [-d depthsScale] "
+					"[-t tolerance] [-r repeat] [-l] [-a] [-i] [-v] [-q] [-p] [-e] [-K code] [-s count] [-b count] [-g count] "
+					"[-F count] [-f dir] [-w first,count[,column,columns]] "
+					"[-S dir,count[,centersScale[,noise[,seed]]]] file.h ...\n", inToolName);
+	return(1);
+}
+
+/************************************ main ************************************/
+int main(
+	int		argc,
+	char*	argv[])
+{
+	typedef std::chrono::steady_clock	Clock;
+	const SKeySpecU32*	overrideSpec = nullptr;
+	uint32_t	centersScale = 0;
+	uint32_t	depthsScale = 0;
+	uint32_t	tolerance = 0;
+	uint32_t	repeat = 1;
+	bool		verbose = false;
+	bool		quiet = false;
+	bool		stream = false;
+	bool		alternates = false;
+	bool		identify = false;
+	bool		regWrites = false;
+	bool		alignment = false;
+	uint32_t	benchmarkLines = 0;
+	uint32_t	ringBenchmarkLines = 0;
+	uint32_t	previewBenchmarkLines = 0;
+	uint32_t	fontBenchmarkPasses = 0;
+	const char*	calibrationCode = nullptr;
+	const char*	renderDir = nullptr;
+	bool		madeKeywayFile = false;
+	const char*	syntheticArgs = nullptr;
+	bool		windowed = false;
+	HiResWindow	window;
+	int			argIndex = 1;
+
+	/*
+	*	The built in keyways have the tags of their keyway menu items
+	*	(see KRXViews.h)
+	*/
+	keyways.Add(kwiksetKeySpec, 1);
+	keyways.Add(schlageKeySpec, 2);
+
+	for (; argIndex < argc && argv[argIndex][0] == '-'; argIndex++)
+	{
+		char	option = argv[argIndex][1];
+		if (option == 'v')
+		{
+			verbose = true;
+			continue;
+		} else if (option == 'q')
+		{
+			quiet = true;
+			continue;
+		} else if (option == 'l')
+		{
+			stream = true;
+			continue;
+		} else if (option == 'a')
+		{
+			alternates = true;
+			continue;
+		} else if (option == 'i')
+		{
+			identify = true;
+			continue;
+		} else if (option == 'p')
+		{
+			regWrites = true;
+			continue;
+		} else if (option == 'e')
+		{
+			alignment = true;
+			continue;
+		} else if (argIndex + 1 >= argc)
+		{
+			return(Usage(argv[0]));
+		}
+		const char*	value = argv[++argIndex];
+		switch (option)
+		{
+			case 'k':
+				overrideSpec = FindKeySpec(value);
+				if (!overrideSpec)
+				{
+					fprintf(stderr, "Unknown key spec \"%s\"\n", value);
+					return(1);
+				}
+				break;
+			case 'c':
+				centersScale = (uint32_t)strtoul(value, nullptr, 0);
+				break;
+			case 'd':
+				depthsScale = (uint32_t)strtoul(value, nullptr, 0);
+				break;
+			case 't':
+				tolerance = (uint32_t)strtoul(value, nullptr, 0);
+				break;
+			case 'r':
+				repeat = (uint32_t)strtoul(value, nullptr, 0);
+				if (repeat == 0)
+				{
+					repeat = 1;
+				}
+				break;
+			case 'K':
+				calibrationCode = value;
+				break;
+			case 'T':
+				if (!keyways.ReadFile(value))
+				{
+					fprintf(stderr, "Unable to read keyways from %s\n", value);
+					return(1);
+				}
+				break;
+			case 'M':
+				if (!MakeKeywayFile(value, "Keyways.bin"))
+				{
+					return(1);
+				}
+				madeKeywayFile = true;
+				break;
+			case 's':
+				benchmarkLines = (uint32_t)strtoul(value, nullptr, 0);
+				break;
+			case 'b':
+				ringBenchmarkLines = (uint32_t)strtoul(value, nullptr, 0);
+				break;
+			case 'g':
+				previewBenchmarkLines = (uint32_t)strtoul(value, nullptr, 0);
+				break;
+			case 'F':
+				fontBenchmarkPasses = (uint32_t)strtoul(value, nullptr, 0);
+				break;
+			case 'f':
+				renderDir = value;
+				break;
+			case 'S':
+				syntheticArgs = value;
+				break;
+			case 'w':
+			{
+				uint32_t	v[4] = {0, 0, 0, HiResWindow::kFrameColumns};
+				char*		end = const_cast<char*>(value);
+				for (uint32_t i = 0; i < 4 && *end; i++)
+				{
+					v[i] = (uint32_t)strtoul(*end == ',' ? end+1 : end, &end, 0);
+				}
+				if (!window.Set(v[0], v[1], v[2], v[3]))
+				{
+					fprintf(stderr, "Invalid window \"%s\"\n", value);
+					return(1);
+				}
+				windowed = true;
+				break;
+			}
+			default:
+				return(Usage(argv[0]));
+		}
+	}
+	if (benchmarkLines)
+	{
+		if (!ScannerBenchmark(benchmarkLines))
+		{
+			return(2);
+		}
+		if (argIndex >= argc)
+		{
+			return(0);
+		}
+	}
+	if (ringBenchmarkLines)
+	{
+		if (!RingBenchmark(ringBenchmarkLines))
+		{
+			return(2);
+		}
+		if (argIndex >= argc)
+		{
+			return(0);
+		}
+	}
+	if (previewBenchmarkLines)
+	{
+		if (!PreviewBenchmark(previewBenchmarkLines))
+		{
+			return(2);
+		}
+		if (argIndex >= argc)
+		{
+			return(0);
+		}
+	}
+	if (fontBenchmarkPasses)
+	{
+		if (!FontBenchmark(fontBenchmarkPasses))
+		{
+			return(2);
+		}
+		if (argIndex >= argc)
+		{
+			return(0);
+		}
+	}
+	if (regWrites)
+	{
+		if (!RegWriterCompare())
+		{
+			return(2);
+		}
+		if (argIndex >= argc)
+		{
+			return(0);
+		}
+	}
+	if (alignment)
+	{
+		if (!AlignmentCheck())
+		{
+			return(2);
+		}
+		if (argIndex >= argc)
+		{
+			return(0);
+		}
+	}
+	if (syntheticArgs)
+	{
+		/*
+		*	dir,count[,centersScale[,noise[,seed]]]
+		*/
+		char		dir[1024];
+		const char*	comma = strchr(syntheticArgs, ',');
+		if (!comma ||
+			(size_t)(comma - syntheticArgs) >= sizeof(dir))
+		{
+			return(Usage(argv[0]));
+		}
+		snprintf(dir, sizeof(dir), "%.*s", (int)(comma - syntheticArgs),
+														syntheticArgs);
+		char*		end;
+		uint32_t	count = (uint32_t)strtoul(comma+1, &end, 0);
+		uint32_t	syntheticCentersScale = keyView.GetCentersScale();
+		double		noise = 1.0;
+		uint32_t	seed = 1;
+		if (*end == ',')
+		{
+			syntheticCentersScale = (uint32_t)strtoul(end+1, &end, 0);
+		}
+		if (*end == ',')
+		{
+			noise = strtod(end+1, &end);
+		}
+		if (*end == ',')
+		{
+			seed = (uint32_t)strtoul(end+1, &end, 0);
+		}
+		if (*end ||
+			syntheticCentersScale == 0)
+		{
+			fprintf(stderr, "Invalid synthetic scans \"%s\"\n", syntheticArgs);
+			return(1);
+		}
+		if (!MakeSyntheticScans(overrideSpec ? overrideSpec : FindKeySpec("Schlage"),
+						dir, count, syntheticCentersScale, noise, seed))
+		{
+			return(2);
+		}
+		if (argIndex >= argc)
+		{
+			return(0);
+		}
+	}
+	if (madeKeywayFile &&
+		argIndex >= argc)
+	{
+		return(0);
+	}
+	if (argIndex >= argc)
+	{
+		return(Usage(argv[0]));
+	}
+
+	ScanDataFile	scanData;
+	uint32_t	filesRead = 0;
+	uint32_t	filesFailed = 0;
+	uint32_t	decoded = 0;
+	uint32_t	withCustomPins = 0;
+	uint32_t	calibrated = 0;
+	uint64_t	centersScaleSum = 0;
+	uint64_t	depthsScaleSum = 0;
+	uint32_t	identified = 0;
+	uint32_t	windowMatches = 0;
+	uint32_t	namedCodes = 0;
+	uint32_t	namedCodeMatches = 0;
+	char		fileNameCode[SKeySpecU32::kMaxPins+1];
+	static uint16_t	windowKeyData[ScanDataFile::eMaxKeyDataLen];
+	static uint32_t	windowKeyDataQ8[ScanDataFile::eMaxKeyDataLen];
+	static uint16_t	windowEdgeLeft[ScanDataFile::eMaxKeyDataLen];
+	static uint16_t	windowEdgeRight[ScanDataFile::eMaxKeyDataLen];
+	char	fullFrameCmdStr[100];
+	Clock::duration	parseTime(0);
+	Clock::duration	decodeTime(0);
+	Clock::duration	frameEndLatency(0);
+	uint32_t	decodedInFrame = 0;
+	Clock::duration	identifyTime(0);
+	char	cutKeyCmdStr[100];
+	uint32_t	rendered = 0;
+	uint32_t	renderMatches = 0;
+	uint32_t	renderImagesWritten = 0;
+	uint64_t	renderPixelWrites = 0;
+	uint64_t	renderWindowCmds = 0;
+	Clock::duration	renderTime(0);
+
+	if (renderDir)
+	{
+		xFont.SetDisplay(&memoryDisplay, &MyriadPro_Regular_20::font);
+		xFont.SetGlyphCache(&glyphCache);
+	}
+	for (; argIndex < argc; argIndex++)
+	{
+		const char*	path = argv[argIndex];
+		Clock::time_point	startTime = Clock::now();
+		bool	success = scanData.Read(path);
+		parseTime += Clock::now() - startTime;
+		if (!success)
+		{
+			filesFailed++;
+			fprintf(stderr, "%s\tUnable to read scan data\n", path);
+			continue;
+		}
+		const SKeySpecU32*	keySpec = overrideSpec ? overrideSpec :
+											FindKeySpec(scanData.SpecName());
+		if (!keySpec)
+		{
+			filesFailed++;
+			fprintf(stderr, "%s\tUnknown key spec \"%s\", use -k\n", path,
+											scanData.SpecName());
+			continue;
+		}
+		filesRead++;
+		bool	namedCode = FileNameCode(path, fileNameCode, sizeof(fileNameCode));
+		if (namedCode)
+		{
+			namedCodes++;
+		}
+		/*
+		*	The adjustments recorded in the file are used unless overridden.
+		*	If the file has no adjustments, the XKeyView defaults are used.
+		*/
+		keyView.SetKeySpec(keySpec, false);
+		if (scanData.HasAdjustments())
+		{
+			keyView.Setup(scanData.CentersScale(), scanData.DepthsScale(),
+												scanData.Tolerance());
+		}
+		keyView.Setup(centersScale ? centersScale : keyView.GetCentersScale(),
+					depthsScale ? depthsScale : keyView.GetDepthsScale(),
+					tolerance ? tolerance : keyView.GetTolerance());
+
+		const uint16_t*	keyData = scanData.KeyData();
+		const uint32_t*	keyDataQ8 = scanData.KeyDataQ8();
+		const uint16_t*	edgeLeft = scanData.EdgeLeft();
+		const uint16_t*	edgeRight = scanData.EdgeRight();
+		if (windowed)
+		{
+			if (!WindowScanData(window, scanData, windowKeyData,
+						windowKeyDataQ8, windowEdgeLeft, windowEdgeRight))
+			{
+				filesFailed++;
+				filesRead--;
+				fprintf(stderr, "%s\tWindow exceeds the scan\n", path);
+				continue;
+			}
+			/*
+			*	The full frame decode to compare the windowed decode to.
+			*/
+			keyView.SetKeyDataQ8(DecodeLines(keyDataQ8));
+			keyView.SetEdgeData(DecodeLines(edgeLeft), DecodeLines(edgeRight));
+			keyView.SetKeyData(keyData);
+			fullFrameCmdStr[0] = 0;
+			if (keyView.DataIsValid())
+			{
+				keyView.GetCutKeyCmdStr(fullFrameCmdStr);
+			}
+			keyData = windowKeyData;
+			keyDataQ8 = keyDataQ8 ? windowKeyDataQ8 : nullptr;
+			edgeLeft = edgeLeft ? windowEdgeLeft : nullptr;
+			edgeRight = edgeRight ? windowEdgeRight : nullptr;
+		}
+		keyDataQ8 = DecodeLines(keyDataQ8);
+		keyView.SetKeyDataQ8(keyDataQ8);
+		keyView.SetEdgeData(DecodeLines(edgeLeft), DecodeLines(edgeRight));
+		startTime = Clock::now();
+		for (uint32_t i = 0; i < repeat; i++)
+		{
+			if (stream)
+			{
+				/*
+				*	The lines of the window (see -w) arrive in groups of 8
+				*	between main loop calls.  The frame ends with the last
+				*	line of the window.  The time SetKeyData takes from then
+				*	is the frame end to result latency of the decode.
+				*/
+				uint32_t	endLine = window.EndLine() < scanData.KeyDataLen() ?
+										window.EndLine() : scanData.KeyDataLen();
+				keyView.ResetStream();
+				for (uint32_t lines = window.FirstLine() + 8; lines < endLine; lines += 8)
+				{
+					keyView.StreamKeyData(keyData, keyDataQ8, lines, endLine);
+				}
+				if (keyView.StreamKeyData(keyData, keyDataQ8, endLine, endLine))
+				{
+					decodedInFrame++;
+				}
+				Clock::time_point	frameEndTime = Clock::now();
+				keyView.SetKeyData(keyData);
+				frameEndLatency += Clock::now() - frameEndTime;
+			} else
+			{
+				keyView.SetKeyData(keyData);
+			}
+		}
+		decodeTime += Clock::now() - startTime;
+		if (windowed)
+		{
+			cutKeyCmdStr[0] = 0;
+			if (keyView.DataIsValid())
+			{
+				keyView.GetCutKeyCmdStr(cutKeyCmdStr);
+			}
+			if (strcmp(cutKeyCmdStr, fullFrameCmdStr) == 0)
+			{
+				windowMatches++;
+			} else if (!quiet)
+			{
+				printf("%s\t  Full frame\t%s\n", path,
+						fullFrameCmdStr[0] ? fullFrameCmdStr : "Flat not found");
+			}
+		}
+
+		if (calibrationCode)
+		{
+			uint32_t	calCentersScale, calDepthsScale;
+			if (keyView.Calibrate(calibrationCode, calCentersScale, calDepthsScale))
+			{
+				calibrated++;
+				centersScaleSum += calCentersScale;
+				depthsScaleSum += calDepthsScale;
+				if (!quiet)
+				{
+					printf("%s\tCenters Scale = %u, Depths Scale = %u\n", path,
+											calCentersScale, calDepthsScale);
+				}
+			} else if (!quiet)
+			{
+				printf("%s\tUnable to calibrate\n", path);
+			}
+		} else if (keyView.DataIsValid())
+		{
+			decoded++;
+			keyView.GetCutKeyCmdStr(cutKeyCmdStr);
+			if (strstr(cutKeyCmdStr, "custom="))
+			{
+				withCustomPins++;
+			}
+			/*
+			*	A decode with custom pins doesn't match the file name code.
+			*/
+			if (namedCode)
+			{
+				char	codeField[20];
+				snprintf(codeField, sizeof(codeField), "code=%s}", fileNameCode);
+				if (strstr(cutKeyCmdStr, codeField))
+				{
+					namedCodeMatches++;
+				}
+			}
+			if (!quiet)
+			{
+				printf("%s\t%s\n", path, cutKeyCmdStr);
+				/*
+				*	The alternate codes are selected, then the decoded code
+				*	is selected again.
+				*/
+				for (uint32_t i = 1; alternates && i < keyView.NumCodes(); i++)
+				{
+					keyView.SelectCode(i, false);
+					keyView.GetCutKeyCmdStr(cutKeyCmdStr);
+					printf("%s\t  Alt %u\t%s\n", path, i, cutKeyCmdStr);
+				}
+				keyView.SelectCode(0, false);
+			}
+		} else if (!quiet)
+		{
+			printf("%s\tFlat not found\n", path);
+		}
+		if (identify &&
+			keyView.DataIsValid())
+		{
+			uint8_t		rank[KeywayTable::kMaxKeyways];
+			uint32_t	cost[KeywayTable::kMaxKeyways];
+			startTime = Clock::now();
+			uint32_t	numRanked = 0;
+			for (uint32_t i = 0; i < repeat; i++)
+			{
+				numRanked = keyView.RankKeySpecs(keyways.KeySpecs(),
+										keyways.Count(), rank, cost);
+			}
+			identifyTime += Clock::now() - startTime;
+			if (numRanked &&
+				&keyways.KeySpec(rank[0]) == keySpec)
+			{
+				identified++;
+			}
+			if (!quiet)
+			{
+				printf("%s\t  Keyway", path);
+				for (uint32_t i = 0; i < numRanked && i < 3; i++)
+				{
+					printf("\t%s (%u)", keyways.KeySpec(rank[i]).name, cost[i]);
+				}
+				printf("\n");
+			}
+		}
+		if (renderDir &&
+			keyView.DataIsValid())
+		{
+			if (!RenderKeyView(path, renderDir, renderTime, renderPixelWrites,
+						renderWindowCmds, renderMatches, renderImagesWritten, quiet))
+			{
+				filesFailed++;
+			}
+			rendered++;
+		}
+		if (verbose)
+		{
+			fprintf(stderr, "%s\n", path);
+			keyView.Dump();
+		}
+	}
+
+	double	parseSecs = std::chrono::duration<double>(parseTime).count();
+	double	decodeSecs = std::chrono::duration<double>(decodeTime).count();
+	uint32_t	decodes = filesRead * repeat;
+	printf("%u scans read, %u unreadable, %u decoded, %u with custom pins, "
+			"%u not decoded\n", filesRead, filesFailed, decoded, withCustomPins,
+			filesRead - decoded);
+	if (namedCodes)
+	{
+		printf("%u of %u scans decoded to the code in their file name\n",
+				namedCodeMatches, namedCodes);
+	}
+	if (calibrated)
+	{
+		printf("%u scans calibrated, Centers Scale = %u, Depths Scale = %u\n",
+			calibrated, (uint32_t)((centersScaleSum + calibrated/2) / calibrated),
+			(uint32_t)((depthsScaleSum + calibrated/2) / calibrated));
+	}
+	if (filesRead)
+	{
+		printf("Parse: %.1f us/scan, Decode: %.2f us/scan (%.0f scans/s)\n",
+			(parseSecs * 1e6) / (filesRead + filesFailed),
+			(decodeSecs * 1e6) / decodes,
+			decodeSecs > 0 ? decodes / decodeSecs : 0.0);
+	}
+	if (stream &&
+		filesRead)
+	{
+		printf("Streamed to line %u: %u of %u decoded by the last line, "
+				"frame end to result: %.2f us/scan\n", window.EndLine(),
+				decodedInFrame, decodes,
+				(std::chrono::duration<double>(frameEndLatency).count() * 1e6) / decodes);
+	}
+	if (identify &&
+		decoded)
+	{
+		double	identifySecs = std::chrono::duration<double>(identifyTime).count();
+		printf("%u of %u identified as the recorded keyway, Identify: %.2f us/scan "
+				"(%u keyways)\n", identified, decoded,
+				(identifySecs * 1e6) / (decoded * repeat), keyways.Count());
+	}
+	if (rendered)
+	{
+		double	renderSecs = std::chrono::duration<double>(renderTime).count();
+		printf("Render: %.1f us, %llu pixel writes, %llu window commands per scan\n",
+				(renderSecs * 1e6) / rendered,
+				(unsigned long long)(renderPixelWrites / rendered),
+				(unsigned long long)(renderWindowCmds / rendered));
+		printf("Glyph cache: %u hits, %u misses\n", glyphCache.Hits(),
+				glyphCache.Misses());
+		printf("%u of %u renderings match their image, %u images written\n",
+				renderMatches, rendered - renderImagesWritten, renderImagesWritten);
+	}
+	if (windowed)
+	{
+		printf("Window L(%u,%u) C(%u,%u): %u%% of the frame transferred, "
+				"CWSTRTR 0x%08X, CWSIZER 0x%08X\n", window.FirstLine(),
+				window.NumLines(), window.FirstColumn(), window.NumColumns(),
+				(window.NumLines() * window.NumColumns() * 100) /
+					(HiResWindow::kFrameLines * HiResWindow::kFrameColumns),
+				window.CropStartReg(), window.CropSizeReg());
+		printf("%u of %u windowed decodes match the full frame\n",
+				windowMatches, filesRead);
+	}
+	return(filesFailed ? 2 : 0);
+}
@@ -0,0 +1,25 @@
+/*
+*	OV5640_1080P.h, Copyright Jonathan Mackey 2025
+*	Host stand-in for the 1080P register settings included by OV5640.h.
+*	The 1080P settings aren't used by the Key Reader, so the stand-in is
+*	empty.  When compiling for the host the KeyReader copy (if present) is
+*	found first.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
@@ -0,0 +1,180 @@
+/*
+*	ScanDataFile.cpp, Copyright Jonathan Mackey 2025
+*	Parses the scan data header files written by
+*	KeyReaderSTM32::SaveScanDataToSD.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "ScanDataFile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static const char kPinDepthsTag[] = " Pin Depths:";
+static const char kCentersScaleTag[] = "Centers Scale =";
+static const char kKeyDataTag[] = "kTestKey[]";
+static const char kKeyDataQ8Tag[] = "kTestKeyQ8[]";
+static const char kEdgeLeftTag[] = "kTestKeyLeft[]";
+static const char kEdgeRightTag[] = "kTestKeyRight[]";
+
+/******************************** ScanDataFile ********************************/
+ScanDataFile::ScanDataFile(void)
+	: mKeyDataLen(0), mKeyDataQ8Len(0), mEdgeLeftLen(0), mEdgeRightLen(0),
+	  mCentersScale(0), mDepthsScale(0), mTolerance(0),
+	  mHasAdjustments(false)
+{
+	mSpecName[0] = 0;
+}
+
+/************************************ Read ************************************/
+/*
+*	The file is a C header containing an optional comment block written by
+*	XKeyView::Dump followed by the kTestKey array of line widths, and when
+*	captured in sub-pixel mode, the kTestKeyQ8 array, and when captured in
+*	dual-edge mode, the kTestKeyLeft and kTestKeyRight arrays.  Returns false if the
+*	file can't be read or the kTestKey array is missing/too long.
+*/
+bool ScanDataFile::Read(
+	const char*	inPath)
+{
+	bool	success = false;
+	mKeyDataLen = 0;
+	mKeyDataQ8Len = 0;
+	mEdgeLeftLen = 0;
+	mEdgeRightLen = 0;
+	mSpecName[0] = 0;
+	mHasAdjustments = false;
+	FILE*	file = fopen(inPath, "rb");
+	if (file)
+	{
+		fseek(file, 0, SEEK_END);
+		long	fileLen = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		if (fileLen > 0)
+		{
+			char*	text = (char*)malloc(fileLen + 1);
+			if (text)
+			{
+				text[fread(text, 1, fileLen, file)] = 0;
+				ParseDumpBlock(text);
+				mKeyDataLen = ParseArray(text, kKeyDataTag, mKeyData);
+				mKeyDataQ8Len = ParseArray(text, kKeyDataQ8Tag, mKeyDataQ8);
+				mEdgeLeftLen = ParseArray(text, kEdgeLeftTag, mEdgeLeft);
+				mEdgeRightLen = ParseArray(text, kEdgeRightTag, mEdgeRight);
+				success = mKeyDataLen > 0;
+				free(text);
+			}
+		}
+		fclose(file);
+	}
+	return(success);
+}
+
+/******************************* ParseDumpBlock *******************************/
+/*
+*	Extracts the key spec name and the XKeyView adjustments in effect when the
+*	scan was saved:
+*		*	Schlage Pin Depths:
+*		...
+*		*	Centers Scale = 6405, Depths Scale = 6633, Tolerance = 5
+*/
+void ScanDataFile::ParseDumpBlock(
+	const char*	inText)
+{
+	const char*	tagPtr = strstr(inText, kPinDepthsTag);
+	if (tagPtr)
+	{
+		const char*	namePtr = tagPtr;
+		// Back up to the start of the line, then skip the "*" and whitespace.
+		while (namePtr > inText && namePtr[-1] != '\n')
+		{
+			namePtr--;
+		}
+		while (namePtr < tagPtr && (*namePtr == '*' || isspace(*namePtr)))
+		{
+			namePtr++;
+		}
+		size_t	nameLen = tagPtr - namePtr;
+		if (nameLen < sizeof(mSpecName))
+		{
+			memcpy(mSpecName, namePtr, nameLen);
+			mSpecName[nameLen] = 0;
+		}
+	}
+	tagPtr = strstr(inText, kCentersScaleTag);
+	if (tagPtr)
+	{
+		unsigned	centersScale, depthsScale, tolerance;
+		mHasAdjustments = sscanf(tagPtr,
+			"Centers Scale = %u, Depths Scale = %u, Tolerance = %u",
+				&centersScale, &depthsScale, &tolerance) == 3;
+		if (mHasAdjustments)
+		{
+			mCentersScale = centersScale;
+			mDepthsScale = depthsScale;
+			mTolerance = tolerance;
+		}
+	}
+}
+
+/********************************* ParseArray *********************************/
+/*
+*	Reads the comma delimited values of the array named inName.  Returns the
+*	number of values read, or zero if the array is missing or has more than
+*	eMaxKeyDataLen values.
+*/
+template <typename T>
+uint32_t ScanDataFile::ParseArray(
+	const char*	inText,
+	const char*	inName,
+	T*			outValues)
+{
+	uint32_t	valuesRead = 0;
+	const char*	dataPtr = strstr(inText, inName);
+	if (dataPtr)
+	{
+		dataPtr = strchr(dataPtr, '{');
+	}
+	if (dataPtr)
+	{
+		dataPtr++;
+		while (*dataPtr)
+		{
+			while (isspace(*dataPtr) || *dataPtr == ',')
+			{
+				dataPtr++;
+			}
+			if (*dataPtr == '}')
+			{
+				return(valuesRead);
+			}
+			char*	endPtr;
+			unsigned long	value = strtoul(dataPtr, &endPtr, 0);
+			if (endPtr == dataPtr ||
+				valuesRead >= eMaxKeyDataLen)
+			{
+				break;
+			}
+			outValues[valuesRead++] = (T)value;
+			dataPtr = endPtr;
+		}
+	}
+	return(0);
+}
@@ -0,0 +1,101 @@
+/*
+*	ScanDataFile.h, Copyright Jonathan Mackey 2025
+*	Parses the scan data header files written by
+*	KeyReaderSTM32::SaveScanDataToSD.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef ScanDataFile_h
+#define ScanDataFile_h
+
+#include <inttypes.h>
+
+class ScanDataFile
+{
+public:
+	enum
+	{
+		eMaxKeyDataLen	= 1918	// OV5640::kHRYOutputSize
+	};
+							ScanDataFile(void);
+	bool					Read(
+								const char*				inPath);
+	const uint16_t*			KeyData(void) const
+								{return(mKeyData);}
+	uint32_t				KeyDataLen(void) const
+								{return(mKeyDataLen);}
+	/*
+	*	The sub-pixel (24.8 fixed point) widths are only present when the scan
+	*	was captured in sub-pixel mode.  Returns nullptr if not present.
+	*/
+	const uint32_t*			KeyDataQ8(void) const
+								{return(mKeyDataQ8Len == mKeyDataLen ?
+													mKeyDataQ8 : nullptr);}
+	/*
+	*	The absolute edge positions are only present when the scan was
+	*	captured in dual-edge mode.  Returns nullptr if not present.
+	*/
+	const uint16_t*			EdgeLeft(void) const
+								{return(mEdgeLeftLen == mKeyDataLen &&
+										mEdgeRightLen == mKeyDataLen ?
+													mEdgeLeft : nullptr);}
+	const uint16_t*			EdgeRight(void) const
+								{return(mEdgeLeftLen == mKeyDataLen &&
+										mEdgeRightLen == mKeyDataLen ?
+													mEdgeRight : nullptr);}
+	/*
+	*	The remaining values are from the XKeyView::Dump comment block, if
+	*	present.  When the file has no comment block, SpecName returns an
+	*	empty string and HasAdjustments returns false.
+	*/
+	const char*				SpecName(void) const
+								{return(mSpecName);}
+	bool					HasAdjustments(void) const
+								{return(mHasAdjustments);}
+	uint32_t				CentersScale(void) const
+								{return(mCentersScale);}
+	uint32_t				DepthsScale(void) const
+								{return(mDepthsScale);}
+	uint32_t				Tolerance(void) const
+								{return(mTolerance);}
+protected:
+	char		mSpecName[20];
+	uint16_t	mKeyData[eMaxKeyDataLen];
+	uint32_t	mKeyDataLen;
+	uint32_t	mKeyDataQ8[eMaxKeyDataLen];
+	uint32_t	mKeyDataQ8Len;
+	uint16_t	mEdgeLeft[eMaxKeyDataLen];
+	uint32_t	mEdgeLeftLen;
+	uint16_t	mEdgeRight[eMaxKeyDataLen];
+	uint32_t	mEdgeRightLen;
+	uint32_t	mCentersScale;
+	uint32_t	mDepthsScale;
+	uint32_t	mTolerance;
+	bool		mHasAdjustments;
+
+	void					ParseDumpBlock(
+								const char*				inText);
+	template <typename T>
+	static uint32_t			ParseArray(
+								const char*				inText,
+								const char*				inName,
+								T*						outValues);
+};
+
+#endif // ScanDataFile_h
@@ -1296,6 +1296,39 @@ bool DisplayController::StreamCopyBlock(
 	return(success);
 }
 
+/********************************* CopyBlock **********************************/
+bool DisplayController::CopyBlock(
+	const void*	inPixels,
+	uint16_t	inRows,
+	uint16_t	inColumns)
+{
+	bool	success = WillFit(inRows, inColumns);
+	if (success)
+	{
+		uint16_t	pixelsToCopy = inRows * inColumns;
+		if (pixelsToCopy)
+		{
+			if (mAddressingMode == eHorizontal)
+			{
+				SetColumnRange(inColumns);
+				CopyPixels(inPixels, pixelsToCopy);
+				SetColumnRange(0, mColumns-1);	// Remove the column range clipping
+				MoveToRow(mRow);	// Leave the page unchanged
+				MoveColumnBy(inColumns); // Advance by inColumns (or wrap to zero if at or past end)
+			} else
+			{
+				MoveToRow(mRow);	// Leave the page unchanged
+				SetRowRange(inRows);
+				CopyPixels(inPixels, pixelsToCopy);
+				MoveToRow(mRow);	// Leave the page unchanged
+				MoveColumnBy(inColumns); // Advance by inColumns (or wrap to zero if at or past end)
+			}
+		}
+	}
+	
+	return(success);
+}
+
 /******************************** Calc565Color ********************************/
 uint16_t DisplayController::Calc565Color(
 	uint8_t		inTint)
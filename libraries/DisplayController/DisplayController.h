@@ -268,6 +268,14 @@ public:
 								uint16_t				inRows,
 								uint16_t				inColumns);
 	/*
+	*	CopyBlock: Same as StreamCopyBlock except the pixels are copied from
+	*	inPixels (in SRAM) via CopyPixels.
+	*/
+	bool					CopyBlock(
+								const void*				inPixels,
+								uint16_t				inRows,
+								uint16_t				inColumns);
+	/*
 	*	StreamCopy: Blindly copies inPixelsToCopy data bytes from inDataStream
 	*	starting at the current row and column.  No checking to see if the data
 	*	will fit on the display without clipping, skewing or wrapping.  The
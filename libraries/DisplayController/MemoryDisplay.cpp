@@ -0,0 +1,393 @@
+/*
+*	MemoryDisplay.cpp, Copyright Jonathan Mackey 2025
+*	Display controller that renders into an in-memory frame buffer.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "MemoryDisplay.h"
+#include "DataStream.h"
+#ifdef __MACH__
+#include <stdio.h>
+#endif
+#include <stdlib.h>
+
+/******************************* MemoryDisplay ********************************/
+/*
+*	At 1 bit per pixel inHeight is in pixels, the display has inHeight/8
+*	rows (pages), as OLED_SSD1306.
+*/
+MemoryDisplay::MemoryDisplay(
+	uint16_t	inHeight,
+	uint16_t	inWidth,
+	uint8_t		inBitsPerPixel)
+	: DisplayController(inBitsPerPixel == 1 ? inHeight/8 : inHeight, inWidth),
+	  mBitsPerPixel(inBitsPerPixel == 1 ? 1 : 16),
+	  mStartRow(0), mStartColumn(0), mPtrRow(0), mPtrColumn(0),
+	  mPixelWrites(0), mWindowCmds(0)
+{
+	mEndRow = mRows-1;
+	mEndColumn = mColumns-1;
+	mBufferSize = (uint32_t)mRows * mColumns * (mBitsPerPixel == 1 ? 1 : 2);
+	mBuffer = (uint8_t*)calloc(mBufferSize, 1);
+}
+
+/******************************* ~MemoryDisplay *******************************/
+MemoryDisplay::~MemoryDisplay(void)
+{
+	free(mBuffer);
+}
+
+/*********************************** MoveTo ***********************************/
+// No bounds checking.  Blind move.
+void MemoryDisplay::MoveTo(
+	uint16_t	inRow,
+	uint16_t	inColumn)
+{
+	if (mBitsPerPixel == 1)
+	{
+		mWindowCmds++;
+		mRow = mPtrRow = inRow;
+		mColumn = mPtrColumn = inColumn;
+	} else
+	{
+		MoveToRow(inRow);
+		mColumn = inColumn;
+	}
+}
+
+/********************************* MoveToRow **********************************/
+// No bounds checking.  Blind move.
+void MemoryDisplay::MoveToRow(
+	uint16_t inRow)
+{
+	mWindowCmds++;
+	if (mBitsPerPixel == 1)
+	{
+		mPtrRow = inRow;
+	} else
+	{
+		mStartRow = inRow;
+		mEndRow = mRows-1;
+	}
+	mRow = inRow;
+}
+
+/******************************** MoveToColumn ********************************/
+// No bounds checking.  Blind move.
+// On a TFT this doesn't make any changes to the controller.
+void MemoryDisplay::MoveToColumn(
+	uint16_t inColumn)
+{
+	if (mBitsPerPixel == 1)
+	{
+		mWindowCmds++;
+		mPtrColumn = inColumn;
+	}
+	mColumn = inColumn;
+}
+
+/******************************* SetColumnRange *******************************/
+void MemoryDisplay::SetColumnRange(
+	uint16_t	inStartColumn,
+	uint16_t	inEndColumn)
+{
+	mWindowCmds++;
+	mStartColumn = inStartColumn;
+	mEndColumn = inEndColumn;
+	mPtrColumn = inStartColumn;
+	if (mBitsPerPixel != 1)
+	{
+		mPtrRow = mStartRow;	// RAMWR
+	}
+}
+
+/******************************* SetRowRange *******************************/
+void MemoryDisplay::SetRowRange(
+	uint16_t	inStartRow,
+	uint16_t	inEndRow)
+{
+	mWindowCmds++;
+	mStartRow = inStartRow;
+	mEndRow = inEndRow;
+	if (mBitsPerPixel == 1)
+	{
+		mPtrRow = inStartRow;
+	}
+}
+
+/***************************** SetAddressingMode ******************************/
+void MemoryDisplay::SetAddressingMode(
+	EAddressingMode	inAddressingMode)
+{
+	if (inAddressingMode != mAddressingMode)
+	{
+		mWindowCmds++;
+		mAddressingMode = inAddressingMode;
+		if (mBitsPerPixel == 1 &&
+			inAddressingMode == eHorizontal)
+		{
+			SetRowRange(mRow, mRows-1);
+		}
+	}
+}
+
+/******************************* AdvancePointer *******************************/
+void MemoryDisplay::AdvancePointer(void)
+{
+	if (mAddressingMode == eHorizontal)
+	{
+		if (mPtrColumn < mEndColumn)
+		{
+			mPtrColumn++;
+		} else
+		{
+			mPtrColumn = mStartColumn;
+			mPtrRow = mPtrRow < mEndRow ? mPtrRow + 1 : mStartRow;
+		}
+	} else
+	{
+		if (mPtrRow < mEndRow)
+		{
+			mPtrRow++;
+		} else
+		{
+			mPtrRow = mStartRow;
+			mPtrColumn = mPtrColumn < mEndColumn ? mPtrColumn + 1 : mStartColumn;
+		}
+	}
+}
+
+/********************************* FillPixels *********************************/
+/*
+*	At 1 bit per pixel inPixelsToFill is in bytes, and any non-zero
+*	inFillColor sets all 8 pixels.
+*/
+void MemoryDisplay::FillPixels(
+	uint32_t	inPixelsToFill,
+	uint16_t	inFillColor)
+{
+	if (mBitsPerPixel == 1)
+	{
+		inFillColor = inFillColor ? 0xFF : 0;
+	}
+	for (; inPixelsToFill; inPixelsToFill--)
+	{
+		WritePixel(inFillColor);
+	}
+}
+
+/******************************** StreamCopy **********************************/
+void MemoryDisplay::StreamCopy(
+	DataStream*	inDataStream,	// A 16 bit data stream, 8 bit at 1 bpp
+	uint16_t	inPixelsToCopy)
+{
+	uint16_t	buffer[96];
+	while (inPixelsToCopy)
+	{
+		uint16_t pixelsToWrite = inPixelsToCopy > 96 ? 96 : inPixelsToCopy;
+		inPixelsToCopy -= pixelsToWrite;
+		inDataStream->Read(pixelsToWrite, buffer);
+		CopyPixels(buffer, pixelsToWrite);
+	}
+}
+
+/******************************** CopyPixels **********************************/
+void MemoryDisplay::CopyPixels(
+	const void*		inPixels,
+	uint16_t		inPixelsToCopy)
+{
+	if (mBitsPerPixel == 1)
+	{
+		const uint8_t*	bytes = (const uint8_t*)inPixels;
+		for (uint16_t i = 0; i < inPixelsToCopy; i++)
+		{
+			WritePixel(bytes[i]);
+		}
+	} else
+	{
+		const uint16_t*	pixels = (const uint16_t*)inPixels;
+		for (uint16_t i = 0; i < inPixelsToCopy; i++)
+		{
+			WritePixel(pixels[i]);
+		}
+	}
+}
+
+/***************************** CopyTintedPattern ******************************/
+/*
+*	Same as TFT_ILI9488P::CopyTintedPattern.  Tints aren't supported at 1 bit
+*	per pixel (nothing is drawn), as with the monochrome controllers.
+*/
+void MemoryDisplay::CopyTintedPattern(
+	uint16_t		inX,
+	uint16_t		inY,
+	const uint8_t*	inTintPattern,
+	uint16_t		inPatternLen,
+	uint16_t		inReps,
+	bool			inVertical,
+	bool			inReverseOrder)
+{
+	if (mBitsPerPixel == 1)
+	{
+		return;
+	}
+	uint16_t	colorPattern[inPatternLen];
+	uint8_t		thisTint;
+	uint8_t		lastTint;
+	uint16_t	color = 0;
+	if (inReverseOrder)
+	{
+		const uint8_t*	patternPtr = &inTintPattern[inPatternLen-1];
+		lastTint = *patternPtr + 1;
+		for (uint16_t i = 0; i < inPatternLen; i++)
+		{
+			thisTint = *(patternPtr--);
+			if (lastTint != thisTint)
+			{
+				lastTint = thisTint;
+				color = Calc565Color(mFGColor, mBGColor, thisTint);
+			}
+			colorPattern[i] = color;
+		}
+	} else
+	{
+		lastTint = inTintPattern[0] + 1;
+		for (uint16_t i = 0; i < inPatternLen; i++)
+		{
+			thisTint = inTintPattern[i];
+			if (lastTint != thisTint)
+			{
+				lastTint = thisTint;
+				color = Calc565Color(mFGColor, mBGColor, thisTint);
+			}
+			colorPattern[i] = color;
+		}
+	}
+	uint16_t	relativeWidth = inVertical ? 1 : inPatternLen;
+	for (uint16_t i = inReps; i; i--)
+	{
+		MoveTo(inY, inX);
+		DisplayController::SetColumnRange(relativeWidth);
+		if (inVertical)
+		{
+			inX++;
+		} else
+		{
+			inY++;
+		}
+		CopyPixels(colorPattern, inPatternLen);
+	}
+}
+
+/********************************** GetPixel **********************************/
+uint16_t MemoryDisplay::GetPixel(
+	uint16_t	inX,
+	uint16_t	inY) const
+{
+	uint16_t	pixel = 0;
+	if (mBitsPerPixel == 1)
+	{
+		if ((inY/8) < mRows && inX < mColumns)
+		{
+			pixel = ((mBuffer[(uint32_t)(inY/8) * mColumns + inX] >> (inY & 7)) & 1) ? 0xFFFF : 0;
+		}
+	} else if (inY < mRows && inX < mColumns)
+	{
+		pixel = ((const uint16_t*)mBuffer)[(uint32_t)inY * mColumns + inX];
+	}
+	return(pixel);
+}
+
+/********************************* Expand565 **********************************/
+void MemoryDisplay::Expand565(
+	uint16_t	inColor,
+	uint8_t*	outRGB)
+{
+	uint8_t	red = inColor >> 11;
+	uint8_t	green = (inColor >> 5) & 0x3F;
+	uint8_t	blue = inColor & 0x1F;
+	outRGB[0] = (red << 3) | (red >> 2);
+	outRGB[1] = (green << 2) | (green >> 4);
+	outRGB[2] = (blue << 3) | (blue >> 2);
+}
+
+#ifdef __MACH__
+/********************************** WritePPM **********************************/
+bool MemoryDisplay::WritePPM(
+	const char*	inPath) const
+{
+	FILE*	file = fopen(inPath, "wb");
+	bool	success = file != nullptr;
+	if (success)
+	{
+		uint16_t	height = mBitsPerPixel == 1 ? mRows*8 : mRows;
+		fprintf(file, "P6\n%u %u\n255\n", mColumns, height);
+		for (uint16_t y = 0; y < height && success; y++)
+		{
+			for (uint16_t x = 0; x < mColumns; x++)
+			{
+				uint8_t	rgb[3];
+				Expand565(GetPixel(x, y), rgb);
+				success = fwrite(rgb, 1, 3, file) == 3;
+			}
+		}
+		success = fclose(file) == 0 && success;
+	}
+	return(success);
+}
+
+/********************************* ComparePPM *********************************/
+int32_t MemoryDisplay::ComparePPM(
+	const char*	inPath) const
+{
+	int32_t	differences = -1;
+	FILE*	file = fopen(inPath, "rb");
+	if (file)
+	{
+		unsigned	width, height, maxValue;
+		uint16_t	displayHeight = mBitsPerPixel == 1 ? mRows*8 : mRows;
+		if (fscanf(file, "P6 %u %u %u", &width, &height, &maxValue) == 3 &&
+			fgetc(file) != EOF &&
+			width == mColumns && height == displayHeight && maxValue == 255)
+		{
+			differences = 0;
+			for (uint16_t y = 0; y < height && differences >= 0; y++)
+			{
+				for (uint16_t x = 0; x < width; x++)
+				{
+					uint8_t	rgb[3];
+					uint8_t	savedRGB[3];
+					if (fread(savedRGB, 1, 3, file) != 3)
+					{
+						differences = -1;
+						break;
+					}
+					Expand565(GetPixel(x, y), rgb);
+					if (memcmp(rgb, savedRGB, 3))
+					{
+						differences++;
+					}
+				}
+			}
+		}
+		fclose(file);
+	}
+	return(differences);
+}
+#endif
@@ -0,0 +1,159 @@
+/*
+*	MemoryDisplay.h, Copyright Jonathan Mackey 2025
+*	Display controller that renders into an in-memory frame buffer.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef MemoryDisplay_h
+#define MemoryDisplay_h
+
+#include "DisplayController.h"
+
+class DataStream;
+
+/*
+*	MemoryDisplay models the address window and write pointer of a display
+*	controller so that the drawing code can be run, measured, and compared
+*	against saved images on the host.
+*
+*	16 bits per pixel behaves as the TFT controllers (TFT_ILI9488P,
+*	TFT_ST77XX):  MoveToRow sets the row range from the row to the last row,
+*	SetColumnRange sets the column range and resets the write pointer to the
+*	start of the window (RAMWR.)  MoveToColumn only sets mColumn.
+*
+*	1 bit per pixel behaves as the monochrome controllers (OLED_SSD1306):
+*	a row is an 8 pixel page, each byte written is a column of 8 pixels (LSB
+*	at the top.)  MoveTo, MoveToRow and MoveToColumn set the write pointer,
+*	SetColumnRange and SetRowRange reset the pointer to the start of their
+*	range.  FillPixels, StreamCopy and CopyPixels are counted in bytes.
+*
+*	The write pointer advances along the column range, wrapping to the next
+*	row of the row range (eHorizontal), or along the row range, wrapping to
+*	the next column (eVertical), then wraps to the start of the window.
+*	SetAddressingMode is honoured at either depth (the TFT drivers ignore
+*	it, XFont only selects eVertical for rotated 1 bit fonts.)
+*
+*	The cost of a draw is counted as the pixels (or bytes) written and the
+*	window commands (row, column, and pointer changes) sent.
+*/
+class MemoryDisplay : public DisplayController
+{
+public:
+							MemoryDisplay(
+								uint16_t				inHeight,
+								uint16_t				inWidth,
+								uint8_t					inBitsPerPixel = 16);
+							~MemoryDisplay(void);
+	virtual uint8_t			BitsPerPixel(void) const
+								{return(mBitsPerPixel);}
+	virtual void			MoveTo(
+								uint16_t				inRow,
+								uint16_t				inColumn);
+	virtual void			MoveToRow(
+								uint16_t				inRow);
+	virtual void			MoveToColumn(
+								uint16_t				inColumn);
+	virtual void			Sleep(void){}
+	virtual void			WakeUp(void){}
+	virtual void			FillPixels(
+								uint32_t				inPixelsToFill,
+								uint16_t				inFillColor);
+	virtual void			SetColumnRange(
+								uint16_t				inStartColumn,
+								uint16_t				inEndColumn);
+	virtual void			SetRowRange(
+								uint16_t				inStartRow,
+								uint16_t				inEndRow);
+	virtual void			StreamCopy(
+								DataStream*				inDataStream,
+								uint16_t				inPixelsToCopy);
+	virtual void			CopyPixels(
+								const void*				inPixels,
+								uint16_t				inPixelsToCopy);
+	virtual void			CopyTintedPattern(
+								uint16_t				inX,
+								uint16_t				inY,
+								const uint8_t*			inPattern,
+								uint16_t				inPatternLen,
+								uint16_t				inReps,
+								bool					inVertical,
+								bool					inReverseOrder);
+	virtual void			SetAddressingMode(
+								EAddressingMode			inAddressingMode = eHorizontal);
+	/*
+	*	GetPixel: Returns the RGB565 color of the pixel at inX, inY.  At 1 bit
+	*	per pixel a set pixel is white (0xFFFF), otherwise black.
+	*/
+	uint16_t				GetPixel(
+								uint16_t				inX,
+								uint16_t				inY) const;
+	uint32_t				PixelWrites(void) const
+								{return(mPixelWrites);}
+	uint32_t				WindowCmds(void) const
+								{return(mWindowCmds);}
+	void					ResetCounters(void)
+								{mPixelWrites = 0; mWindowCmds = 0;}
+#ifdef __MACH__
+	/*
+	*	WritePPM: Writes the frame buffer as a binary PPM (P6) image.
+	*	ComparePPM: Returns the number of pixels that differ from the PPM
+	*	image at inPath, or -1 if the image can't be read or its size differs.
+	*/
+	bool					WritePPM(
+								const char*				inPath) const;
+	int32_t					ComparePPM(
+								const char*				inPath) const;
+#endif
+protected:
+	uint8_t*	mBuffer;
+	uint32_t	mBufferSize;	// Bytes
+	uint8_t		mBitsPerPixel;
+	uint16_t	mStartRow;		// Window (inclusive)
+	uint16_t	mEndRow;
+	uint16_t	mStartColumn;
+	uint16_t	mEndColumn;
+	uint16_t	mPtrRow;		// Write pointer
+	uint16_t	mPtrColumn;
+	uint32_t	mPixelWrites;
+	uint32_t	mWindowCmds;
+
+	inline void				WritePixel(
+								uint16_t				inPixel)
+							{
+								if (mPtrRow < mRows && mPtrColumn < mColumns)
+								{
+									uint32_t	index = (uint32_t)mPtrRow * mColumns + mPtrColumn;
+									if (mBitsPerPixel == 1)
+									{
+										mBuffer[index] = (uint8_t)inPixel;
+									} else
+									{
+										((uint16_t*)mBuffer)[index] = inPixel;
+									}
+								}
+								mPixelWrites++;
+								AdvancePointer();
+							}
+	void					AdvancePointer(void);
+	static void				Expand565(
+								uint16_t				inColor,
+								uint8_t*				outRGB);
+};
+
+#endif // MemoryDisplay_h
@@ -30,6 +30,7 @@
 #include <string.h>
 #include "DataStream.h"
 #include "DisplayController.h"
+#include "XFontGlyphCache.h"
 /*
 *	The font header, charcode runs array, and glyph data offsets array are
 *	assumed to be in near PROGMEM.  The Glyph data is accessed via a DataStream.
@@ -43,7 +44,7 @@ const uint16_t	XFont::kEllipsisCharcode = 0x2026;
 
 /*********************************** XFont ************************************/
 XFont::XFont(void)
-	: mDisplay(nullptr), mFontRows(0),
+	: mDisplay(nullptr), mGlyphCache(nullptr), mFontRows(0),
 	  mHighlightEnabled(false), mFont(nullptr),
 	  mTextColor(0xFFFF), mTextBGColor(0), mStartCol(0)
 {
@@ -79,11 +80,45 @@ void XFont::SetFont(
 					mFontRows = (mFontHeader.height + 7)/8;
 				}
 			}
+			BuildDirectIndex();
 			mEllipsisWidth = LoadGlyph(kEllipsisCharcode) ? mGlyph.advanceX : 0;
 		}
 	}
 }
 
+/****************************** BuildDirectIndex ******************************/
+/*
+*	Fills mDirectIndex from the charcode runs of the current font.  Run i
+*	covers the charcodes from its start for (run[i+1].entryIndex -
+*	run[i].entryIndex) glyphs, the last run is an unused end marker.  The
+*	result is the same as SearchCharcodeRuns for every charcode in the range.
+*/
+void XFont::BuildDirectIndex(void)
+{
+	memset(mDirectIndex, kNotDirect, sizeof(mDirectIndex));
+	const CharcodeRun*	charcodeRun = mFont->charcodeRuns;
+	const CharcodeRun*	endRun = &charcodeRun[mFontHeader.numCharcodeRuns - 1];
+	for (; charcodeRun < endRun; charcodeRun++)
+	{
+		uint16_t	start = pgm_read_word_near(&charcodeRun->start);
+		if (start > 0xFF)
+		{
+			break;	// The runs are sorted
+		}
+		uint16_t	entryIndex = pgm_read_word_near(&charcodeRun->entryIndex);
+		uint16_t	endIndex = pgm_read_word_near(&charcodeRun[1].entryIndex);
+		for (uint16_t charcode = start; entryIndex < endIndex && charcode <= 0xFF;
+				charcode++, entryIndex++)
+		{
+			if (charcode >= kFirstDirectCharcode &&
+				entryIndex < kNotDirect)
+			{
+				mDirectIndex[charcode - kFirstDirectCharcode] = entryIndex;
+			}
+		}
+	}
+}
+
 /********************************* FindGlyph **********************************/
 /*
 *	Returns entryIndex within the glyphDataOffsets for inCharcode.
@@ -91,6 +126,27 @@ void XFont::SetFont(
 */
 uint16_t XFont::FindGlyph(
 	uint16_t	inCharcode)
+{
+	uint16_t	entryIndex = kNotDirect;
+	if ((uint16_t)(inCharcode - kFirstDirectCharcode) < kDirectCharcodes)
+	{
+		entryIndex = mDirectIndex[inCharcode - kFirstDirectCharcode];
+	}
+	if (entryIndex == kNotDirect)
+	{
+		entryIndex = SearchCharcodeRuns(inCharcode);
+	}
+	return(entryIndex);
+}
+
+/***************************** SearchCharcodeRuns *****************************/
+/*
+*	Returns entryIndex within the glyphDataOffsets for inCharcode by a binary
+*	search of the charcode runs.
+*	0xFFFF is returned if the glyph doesn't exist.
+*/
+uint16_t XFont::SearchCharcodeRuns(
+	uint16_t	inCharcode)
 {
 	uint16_t leftIndex = 0;
 	const CharcodeRun*	charcodeRuns = mFont->charcodeRuns;
@@ -219,7 +275,44 @@ bool XFont::DrawCharcode(
 	uint16_t	inCharcode,
 	uint8_t		inFakeMonospaceWidth)
 {
-	bool doContinue = LoadGlyph(inCharcode);
+	bool doContinue;
+	const uint16_t*	cachedPixels = nullptr;
+	/*
+	*	If there's a glyph cache AND
+	*	the glyph is drawn as 16 bit pixels THEN
+	*	use the cached glyph, or cache the glyph as it's unpacked.
+	*/
+	if (mGlyphCache &&
+		mDisplay->BitsPerPixel() == 16 &&
+		!mFontHeader.rotated)
+	{
+		const XFontGlyphCache::Entry*	entry = mGlyphCache->Find(mFont,
+											inCharcode, mTextColor, mTextBGColor);
+		if (entry)
+		{
+			mGlyph = entry->glyph;
+			mCharcode = inCharcode;
+			mCharcodeIndex = entry->entryIndex;
+			cachedPixels = entry->pixels;
+			doContinue = true;
+		} else
+		{
+			doContinue = LoadGlyph(inCharcode);
+			if (doContinue)
+			{
+				uint16_t*	pixelsToCache = mGlyphCache->Add(mFont, inCharcode,
+									mTextColor, mTextBGColor, mCharcodeIndex, mGlyph);
+				if (pixelsToCache)
+				{
+					mFont->glyphData->Read((uint32_t)mGlyph.rows * mGlyph.columns, pixelsToCache);
+					cachedPixels = pixelsToCache;
+				}
+			}
+		}
+	} else
+	{
+		doContinue = LoadGlyph(inCharcode);
+	}
 	while (doContinue)
 	{
 		bool	rotated = mFontHeader.rotated;
@@ -283,7 +376,8 @@ bool XFont::DrawCharcode(
 		{
 			mDisplay->SetAddressingMode(DisplayController::eVertical);
 		}
-		doContinue = mDisplay->StreamCopyBlock(mFont->glyphData, rows, columns);
+		doContinue = cachedPixels ? mDisplay->CopyBlock(cachedPixels, rows, columns) :
+						mDisplay->StreamCopyBlock(mFont->glyphData, rows, columns);
 		if (vertical)
 		{
 			mDisplay->SetAddressingMode(DisplayController::eHorizontal);
@@ -28,6 +28,7 @@
 #include "XFontDataStream.h"
 
 class DisplayController;
+class XFontGlyphCache;
 
 class XFont
 {
@@ -71,6 +72,15 @@ public:
 								Font*					inFont);
 	Font*					GetFont(void) const
 								{return(mFont);}
+	/*
+	*	SetGlyphCache: Glyphs drawn on a 16 bit display are cached in
+	*	inGlyphCache once unpacked.  Pass nullptr (the default) for no cache.
+	*/
+	void					SetGlyphCache(
+								XFontGlyphCache*		inGlyphCache)
+								{mGlyphCache = inGlyphCache;}
+	XFontGlyphCache*		GetGlyphCache(void) const
+								{return(mGlyphCache);}
 	
 	/*
 	*	Relative move by N text rows and the absolute pixel column.
@@ -170,8 +180,16 @@ public:
 	uint8_t					FontRows(void) const
 								{return(mFontRows);}
 	void					DrawLoadedGlyph(void);
+	/*
+	*	FindGlyph: Returns the entry index of inCharcode's glyph, 0xFFFF if the
+	*	font has no glyph for it.  Charcodes kFirstDirectCharcode to 0xFF
+	*	(ASCII and Latin-1) are looked up in mDirectIndex, built by SetFont,
+	*	other charcodes by SearchCharcodeRuns.
+	*/
 	uint16_t				FindGlyph(
 								uint16_t				inCharcode);
+	uint16_t				SearchCharcodeRuns(
+								uint16_t				inCharcode);
 	bool					LoadGlyph(
 								uint16_t				inCharcode);
 	bool					LoadGlyphHeader(
@@ -243,9 +261,16 @@ public:
 	};
 
 protected:
+	enum
+	{
+		kFirstDirectCharcode	= 0x20,
+		kDirectCharcodes		= 0x100 - kFirstDirectCharcode,
+		kNotDirect				= 0xFF	// Search the charcode runs
+	};
 	FontHeader			mFontHeader;
 	Font*				mFont;
 	DisplayController*	mDisplay;
+	XFontGlyphCache*	mGlyphCache;
 	uint16_t			mTextColor;
 	uint16_t			mTextBGColor;
 	uint16_t			mStartCol;	// Starting column of last call to DrawStr
@@ -255,7 +280,14 @@ protected:
 	uint16_t			mCharcodeIndex; // Currently loaded glyph index
 	bool				mHighlightEnabled;
 	uint8_t				mEllipsisWidth;	// 0 if current font has no ellipsis.
+	/*
+	*	The entry index of each charcode from kFirstDirectCharcode to 0xFF,
+	*	kNotDirect if there is no glyph or the index doesn't fit in 8 bits.
+	*/
+	uint8_t				mDirectIndex[kDirectCharcodes];
 	static const uint16_t	kEllipsisCharcode;
+
+	void					BuildDirectIndex(void);
 };
 
 #endif // XFont_h
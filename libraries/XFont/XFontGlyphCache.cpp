@@ -0,0 +1,110 @@
+/*
+*	XFontGlyphCache.cpp, Copyright Jonathan Mackey 2025
+*	Cache of glyphs already expanded to 565 pixels.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "XFontGlyphCache.h"
+
+/****************************** XFontGlyphCache *******************************/
+XFontGlyphCache::XFontGlyphCache(void)
+	: mHits(0), mMisses(0)
+{
+	Clear();
+}
+
+/*********************************** Clear ************************************/
+void XFontGlyphCache::Clear(void)
+{
+	for (uint8_t i = 0; i < kEntries; i++)
+	{
+		mEntry[i].font = nullptr;
+		mEntry[i].lastUsed = 0;
+	}
+	mUseCount = 0;
+}
+
+/************************************ Find ************************************/
+const XFontGlyphCache::Entry* XFontGlyphCache::Find(
+	const XFont::Font*	inFont,
+	uint16_t			inCharcode,
+	uint16_t			inTextColor,
+	uint16_t			inBGTextColor)
+{
+	Entry*	entry = mEntry;
+	Entry*	endEntry = &mEntry[kEntries];
+	for (; entry < endEntry; entry++)
+	{
+		if (entry->charcode == inCharcode &&
+			entry->font == inFont &&
+			entry->textColor == inTextColor &&
+			entry->bgTextColor == inBGTextColor)
+		{
+			break;
+		}
+	}
+	if (entry < endEntry)
+	{
+		mHits++;
+		mUseCount++;
+		entry->lastUsed = mUseCount;
+	} else
+	{
+		mMisses++;
+		entry = nullptr;
+	}
+	return(entry);
+}
+
+/************************************ Add *************************************/
+uint16_t* XFontGlyphCache::Add(
+	const XFont::Font*	inFont,
+	uint16_t			inCharcode,
+	uint16_t			inTextColor,
+	uint16_t			inBGTextColor,
+	uint16_t			inEntryIndex,
+	const GlyphHeader&	inGlyph)
+{
+	uint16_t*	pixels = nullptr;
+	if (inFont &&
+		((uint16_t)inGlyph.rows * inGlyph.columns) <= kMaxGlyphPixels)
+	{
+		/*
+		*	Unused entries have a lastUsed of 0 so they're used first.
+		*/
+		Entry*	lruEntry = mEntry;
+		for (uint8_t i = 1; i < kEntries; i++)
+		{
+			if (mEntry[i].lastUsed < lruEntry->lastUsed)
+			{
+				lruEntry = &mEntry[i];
+			}
+		}
+		mUseCount++;
+		lruEntry->font = inFont;
+		lruEntry->charcode = inCharcode;
+		lruEntry->textColor = inTextColor;
+		lruEntry->bgTextColor = inBGTextColor;
+		lruEntry->entryIndex = inEntryIndex;
+		lruEntry->lastUsed = mUseCount;
+		lruEntry->glyph = inGlyph;
+		pixels = lruEntry->pixels;
+	}
+	return(pixels);
+}
@@ -0,0 +1,96 @@
+/*
+*	XFontGlyphCache.h, Copyright Jonathan Mackey 2025
+*	Cache of glyphs already expanded to 565 pixels.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef XFontGlyphCache_h
+#define XFontGlyphCache_h
+
+#include "XFont.h"
+
+/*
+*	XFontGlyphCache holds up to kEntries glyphs as drawn by XFont on a 16 bit
+*	display: the glyph header (as loaded by XFont::LoadGlyphHeader) and the
+*	rows*columns 565 pixels unpacked by the glyph data stream.  An entry is
+*	keyed on the font, charcode, text color and background text color.  When
+*	all entries are in use, the least recently used entry is replaced.
+*
+*	A glyph of more than kMaxGlyphPixels isn't cached.  kMaxGlyphPixels
+*	covers a 20 pixel font (height by widest glyph.)
+*
+*	XFont uses the cache when set via XFont::SetGlyphCache.  A hit skips
+*	FindGlyph, LoadGlyphHeader and the unpacking of the glyph data.
+*/
+class XFontGlyphCache
+{
+public:
+	enum
+	{
+		kEntries			= 16,
+		kMaxGlyphPixels		= 400
+	};
+	struct Entry
+	{
+		const XFont::Font*	font;	// nullptr when unused
+		uint16_t			charcode;
+		uint16_t			textColor;
+		uint16_t			bgTextColor;
+		uint16_t			entryIndex;	// Of the glyph data offsets
+		uint32_t			lastUsed;
+		GlyphHeader			glyph;
+		uint16_t			pixels[kMaxGlyphPixels];
+	};
+							XFontGlyphCache(void);
+	/*
+	*	Find: Returns the entry for the glyph, or nullptr if it isn't cached.
+	*	The hit or miss is counted.
+	*/
+	const Entry*			Find(
+								const XFont::Font*		inFont,
+								uint16_t				inCharcode,
+								uint16_t				inTextColor,
+								uint16_t				inBGTextColor);
+	/*
+	*	Add: Replaces the least recently used entry with the glyph and returns
+	*	the entry's pixel buffer to be filled with inGlyph.rows*inGlyph.columns
+	*	pixels.  Returns nullptr if the glyph is too large to cache.
+	*/
+	uint16_t*				Add(
+								const XFont::Font*		inFont,
+								uint16_t				inCharcode,
+								uint16_t				inTextColor,
+								uint16_t				inBGTextColor,
+								uint16_t				inEntryIndex,
+								const GlyphHeader&		inGlyph);
+	void					Clear(void);
+	uint32_t				Hits(void) const
+								{return(mHits);}
+	uint32_t				Misses(void) const
+								{return(mMisses);}
+	void					ResetCounters(void)
+								{mHits = 0; mMisses = 0;}
+protected:
+	Entry		mEntry[kEntries];
+	uint32_t	mUseCount;	// Incremented on each hit or add
+	uint32_t	mHits;
+	uint32_t	mMisses;
+};
+
+#endif // XFontGlyphCache_h
@@ -68,7 +68,25 @@ void XColoredView::Draw(
 		DisplayController*	display = XRootView::GetInstance()->GetDisplay();
 		if (display)
 		{
-			display->FillRect(inX, inY, inWidth, inHeight, mColor);
+			/*
+			*	If the area lies within an opaque subview, the subview
+			*	writes every pixel of it, so the fill would only be
+			*	overwritten.
+			*/
+			XView*	subView = mSubViews;
+			for (; subView; subView = subView->NextView())
+			{
+				if (subView->IsVisible() &&
+					subView->IsOpaque() &&
+					subView->Contains(inX, inY, inWidth, inHeight))
+				{
+					break;
+				}
+			}
+			if (!subView)
+			{
+				display->FillRect(inX, inY, inWidth, inHeight, mColor);
+			}
 			DrawSelf();
 			if (mSubViews)
 			{
@@ -145,7 +145,7 @@ void XNumberValueField::OverrideValueString(
 							// mValueString.
 	if (inUpdate)
 	{
-		DrawSelf();
+		Invalidate();
 	}
 }
 
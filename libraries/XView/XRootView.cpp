@@ -36,7 +36,7 @@ XRootView::XRootView(
 	: XView(0, 0, 0, 0, 0, nullptr, inSubViews),
 	  mDisplay(inDisplay),
 	  mViewChangedDelegate(inViewChangedDelegate),
-	  mModalView(nullptr)
+	  mModalView(nullptr), mInvalidRects(0)
 {
 	sInstance = this;
 }
@@ -72,4 +72,109 @@ XView* XRootView::HitTest(
 	return(hitView);
 }
 
+/*********************************** Union ************************************/
+void XRootView::Union(
+	const SRect&	inRect,
+	SRect&			ioRect)
+{
+	if (inRect.left < ioRect.left) ioRect.left = inRect.left;
+	if (inRect.top < ioRect.top) ioRect.top = inRect.top;
+	if (inRect.right > ioRect.right) ioRect.right = inRect.right;
+	if (inRect.bottom > ioRect.bottom) ioRect.bottom = inRect.bottom;
+}
 
+/******************************* AddInvalidRect *******************************/
+/*
+*	inX and inY are global.
+*/
+void XRootView::AddInvalidRect(
+	int16_t		inX,
+	int16_t		inY,
+	uint16_t	inWidth,
+	uint16_t	inHeight)
+{
+	if (inWidth && inHeight)
+	{
+		SRect	rect = {inX, inY, (int16_t)(inX + inWidth), (int16_t)(inY + inHeight)};
+		/*
+		*	Merge rect with every invalid rect it intersects.  The merged rect
+		*	is larger so it's checked against the remaining rects again.
+		*/
+		uint8_t	i = 0;
+		while (i < mInvalidRects)
+		{
+			SRect&	invalidRect = mInvalidRect[i];
+			if (invalidRect.left < rect.right &&
+				rect.left < invalidRect.right &&
+				invalidRect.top < rect.bottom &&
+				rect.top < invalidRect.bottom)
+			{
+				Union(invalidRect, rect);
+				mInvalidRects--;
+				invalidRect = mInvalidRect[mInvalidRects];
+				i = 0;
+			} else
+			{
+				i++;
+			}
+		}
+		if (mInvalidRects < kMaxInvalidRects)
+		{
+			mInvalidRect[mInvalidRects] = rect;
+			mInvalidRects++;
+		} else
+		{
+			/*
+			*	All in use.  Merge with the rect that grows the least.  The
+			*	union may now intersect another rect, so it's added again.
+			*/
+			uint8_t		bestIndex = 0;
+			uint32_t	bestGrowth = 0xFFFFFFFF;
+			for (i = 0; i < mInvalidRects; i++)
+			{
+				SRect	unionRect = mInvalidRect[i];
+				Union(rect, unionRect);
+				uint32_t	growth = Area(unionRect) - Area(mInvalidRect[i]);
+				if (growth < bestGrowth)
+				{
+					bestGrowth = growth;
+					bestIndex = i;
+				}
+			}
+			Union(mInvalidRect[bestIndex], rect);
+			mInvalidRects--;
+			mInvalidRect[bestIndex] = mInvalidRect[mInvalidRects];
+			AddInvalidRect(rect.left, rect.top,
+					rect.right - rect.left, rect.bottom - rect.top);
+		}
+	}
+}
+
+/******************************** DrawInvalid *********************************/
+void XRootView::DrawInvalid(void)
+{
+	/*
+	*	The invalid rects are cleared before drawing so that a view that
+	*	invalidates itself while drawing is drawn on the next pass.
+	*/
+	SRect	invalidRect[kMaxInvalidRects];
+	uint8_t	invalidRects = mInvalidRects;
+	for (uint8_t i = 0; i < invalidRects; i++)
+	{
+		invalidRect[i] = mInvalidRect[i];
+	}
+	mInvalidRects = 0;
+	/*
+	*	The root view is at 0,0 and draws nothing itself (its size may not be
+	*	set), so the global invalid rects are drawn directly by the subviews.
+	*/
+	if (mSubViews)
+	{
+		for (uint8_t i = 0; i < invalidRects; i++)
+		{
+			const SRect&	rect = invalidRect[i];
+			mSubViews->Draw(rect.left, rect.top,
+						rect.right - rect.left, rect.bottom - rect.top);
+		}
+	}
+}
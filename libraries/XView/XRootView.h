@@ -66,12 +66,55 @@ public:
 								{return(mModalView);}
 	static XRootView*		GetInstance(void)
 								{return(sInstance);}
+							/*
+							*	AddInvalidRect is called by XView::Invalidate.
+							*	inX and inY are global.  A rect that intersects
+							*	an existing invalid rect is merged with it so
+							*	that a view is drawn at most once by DrawInvalid.
+							*	When all kMaxInvalidRects are in use the rect is
+							*	merged with the rect that grows the least.
+							*/
+	void					AddInvalidRect(
+								int16_t					inX,
+								int16_t					inY,
+								uint16_t				inWidth,
+								uint16_t				inHeight);
+	bool					HasInvalidRect(void) const
+								{return(mInvalidRects != 0);}
+							/*
+							*	DrawInvalid draws the views that intersect the
+							*	invalid rects, then clears them (validates.)
+							*	Call once per update pass.
+							*/
+	void					DrawInvalid(void);
+	void					Validate(void)
+								{mInvalidRects = 0;}
 protected:
+	enum
+	{
+		kMaxInvalidRects	= 4
+	};
+	struct SRect
+	{
+		int16_t		left;
+		int16_t		top;
+		int16_t		right;		// Exclusive
+		int16_t		bottom;		// Exclusive
+	};
 	DisplayController*		mDisplay;
 	XViewChangedDelegate*	mViewChangedDelegate;
 	XView*					mModalView;
+	SRect					mInvalidRect[kMaxInvalidRects];
+	uint8_t					mInvalidRects;
 	static XRootView*		sInstance;
 
+	static void				Union(
+								const SRect&			inRect,
+								SRect&					ioRect);
+	static uint32_t			Area(
+								const SRect&			inRect)
+								{return((uint32_t)(inRect.right - inRect.left) *
+												(inRect.bottom - inRect.top));}
 	virtual	void			HandleChange(
 							XView*						inView,
 							uint16_t					inAction = 0);
@@ -107,7 +107,7 @@ void XValueField::ValueChanged(
 	
 	if (inUpdate)
 	{
-		DrawSelf();
+		Invalidate();
 	}
 }
 
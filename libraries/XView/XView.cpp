@@ -62,10 +62,7 @@ void XView::Draw(
 	*	the area to be drawn intersects this view's bounds...
 	*/
 	if (mVisible &&
-		mX + mWidth > inX &&
-		inX + inWidth > mX &&
-		mY + mHeight > inY &&
-		inY + inHeight > mY)
+		Intersects(inX, inY, inWidth, inHeight))
 	{
 		DrawSelf();
 		if (mSubViews)
@@ -79,6 +76,24 @@ void XView::Draw(
 	}
 }
 
+/********************************* Invalidate *********************************/
+/*
+*	inX and inY are local to this view.
+*/
+void XView::Invalidate(
+	int16_t		inX,
+	int16_t		inY,
+	uint16_t	inWidth,
+	uint16_t	inHeight)
+{
+	XRootView*	rootView = XRootView::GetInstance();
+	if (rootView)
+	{
+		LocalToGlobal(inX, inY);
+		rootView->AddInvalidRect(inX, inY, inWidth, inHeight);
+	}
+}
+
 /******************************** SetSubViews *********************************/
 void XView::SetSubViews(
 	XView*	inSubView)
@@ -54,6 +54,51 @@ public:
 								uint16_t				inWidth,
 								uint16_t				inHeight);
 	virtual void			DrawSelf(void){}
+	/*
+	*	Invalidate: Adds the area inX, inY, inWidth, inHeight (local to this
+	*	view) to the root view's invalid area.  The invalid area is drawn
+	*	once by XRootView::DrawInvalid, so several changes to a view result
+	*	in a single redraw.  Invalidate() invalidates the entire view.
+	*/
+	void					Invalidate(void)
+								{Invalidate(0, 0, mWidth, mHeight);}
+	void					Invalidate(
+								int16_t					inX,
+								int16_t					inY,
+								uint16_t				inWidth,
+								uint16_t				inHeight);
+	/*
+	*	Intersects: Returns true if the area inX, inY, inWidth, inHeight
+	*	(local to the superview) intersects this view's bounds.
+	*/
+	bool					Intersects(
+								int16_t					inX,
+								int16_t					inY,
+								uint16_t				inWidth,
+								uint16_t				inHeight) const
+								{return(mX + mWidth > inX &&
+										inX + inWidth > mX &&
+										mY + mHeight > inY &&
+										inY + inHeight > mY);}
+	/*
+	*	Contains: Returns true if the area inX, inY, inWidth, inHeight
+	*	(local to the superview) lies entirely within this view's bounds.
+	*/
+	bool					Contains(
+								int16_t					inX,
+								int16_t					inY,
+								uint16_t				inWidth,
+								uint16_t				inHeight) const
+								{return(inX >= mX &&
+										inX + inWidth <= mX + mWidth &&
+										inY >= mY &&
+										inY + inHeight <= mY + mHeight);}
+	/*
+	*	IsOpaque: Returns true if DrawSelf writes every pixel within this
+	*	view's bounds, so a superview needn't fill its background under it.
+	*/
+	virtual bool			IsOpaque(void) const
+								{return(false);}
 	virtual bool			WantsClicks(void) const
 								{return(mVisible && mEnabled);}
 	virtual void			MouseDown(